@@ -2,5 +2,12 @@ HAIR_DEFINES := \
 	-DVHS_COMPUTE_LOCAL_SIZE=256 \
 	-DVHS_PARTICLE_BUFFER_BINDING=0 \
 	-DVHS_VERTEX_BUFFER_BINDING=1 \
+	-DVHS_CULL_BUFFER_BINDING=2 \
+	-DVHS_HIZ_BUFFER_BINDING=3 \
+	-DVHS_RASTER_TILE_BUFFER_BINDING=4 \
+	-DVHS_RASTER_BUFFER_BINDING=5 \
+	-DVHS_CULL_DRAW_WORDS=5 \
+	-DVHS_RASTER_TILE_SIZE=16 \
 	-DVHS_RANDOM_SEED=0xdeadbeef \
-	-DVHS_MAX_HAIR_SMOOTH_FACTOR=8
+	-DVHS_MAX_HAIR_SMOOTH_FACTOR=8 \
+	-DVHS_MAX_PARTICLES_PER_STRAND=512
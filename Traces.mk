@@ -15,3 +15,8 @@ export VHS_TRACE_IMAGE_VIEW=1
 export VHS_TRACE_DESCRIPTOR_SET_LAYOUT=1
 export VHS_TRACE_DESCRIPTOR_POOL=1
 export VHS_TRACE_SIMULATOR=1
+export VHS_TRACE_THREAD_POOL=1
+export VHS_TRACE_HAIR_ASSET=1
+export VHS_TRACE_STAGING_RING=1
+export VHS_TRACE_GPU_PROFILER=1
+export VHS_TRACE_PIPELINE_CACHE=1
@@ -0,0 +1,122 @@
+#version 450
+
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
+
+// Binning runs twice, first counting the segments in each tile and then, once scan_tiles.glsl has turned the counts
+// into offsets, writing them into the tiles' lists.
+layout (constant_id = 3) const bool SCATTER = false;
+
+layout (std430, set = 0, binding = VHS_VERTEX_BUFFER_BINDING) readonly buffer vbo
+{
+    float VertexBuffer[];
+};
+
+// Triangles that survived culling, see buffers.glslh for the layout.
+#include "buffers.glslh"
+
+// Total segments binned into all the tiles, then the number in each tile and the end of each tile's list in the pool
+// shared by every tile, followed by the pool itself. Lists are laid out in tile order so when the total runs past the
+// pool size it's the last tiles that lose segments.
+layout (std430, set = 0, binding = VHS_RASTER_TILE_BUFFER_BINDING) buffer tiles
+{
+    uint TileTotal;
+    uint TileData[];
+};
+
+layout (push_constant) uniform ubo
+{
+    mat4 u_ModelViewProjection;
+    uint u_ScreenWidth;
+    uint u_ScreenHeight;
+    uint u_TilesX;
+    uint u_TilesY;
+    uint u_TilePoolSize;
+    uint u_PointsPerStrand;
+    uint u_HairStrandsPerTriangle;
+    uint u_VisibleTrianglesOffset;
+    uint u_DepthTest;
+};
+
+vec3 loadVertex(uint vertex)
+{
+    return vec3(VertexBuffer[3 * vertex + 0], VertexBuffer[3 * vertex + 1], VertexBuffer[3 * vertex + 2]);
+}
+
+// Screen position of the point between a pair of created vertices and half the distance between them, in pixels. The
+// w component is the clip space w, only valid when positive.
+vec4 projectPoint(uint point)
+{
+    vec4 v0 = u_ModelViewProjection * vec4(loadVertex(2 * point + 0), 1);
+    vec4 v1 = u_ModelViewProjection * vec4(loadVertex(2 * point + 1), 1);
+
+    if (v0.w <= 0 || v1.w <= 0)
+        return vec4(0, 0, 0, -1);
+
+    vec2 size = vec2(u_ScreenWidth, u_ScreenHeight);
+
+    vec2 s0 = (v0.xy / v0.w * 0.5f + 0.5f) * size;
+    vec2 s1 = (v1.xy / v1.w * 0.5f + 0.5f) * size;
+
+    return vec4((s0 + s1) * 0.5f, length(s1 - s0) * 0.5f, 1);
+}
+
+// Each invocation bins one segment between two points of a strand into every tile its bounds overlap. Segments are
+// numbered by the first of their points in the vertex buffer. The dispatch covers every triangle, invocations past the
+// visible ones do nothing.
+void main()
+{
+    uint segmentsPerStrand = u_PointsPerStrand - 1;
+    uint segmentsPerTriangle = segmentsPerStrand * u_HairStrandsPerTriangle;
+
+    uint slot = gl_GlobalInvocationID.x / segmentsPerTriangle;
+
+    if (slot >= NumVisibleTriangles)
+        return;
+
+    uint triangle = CullData[u_VisibleTrianglesOffset + slot];
+    uint local = gl_GlobalInvocationID.x % segmentsPerTriangle;
+
+    uint strand = triangle * u_HairStrandsPerTriangle + local / segmentsPerStrand;
+    uint point = strand * u_PointsPerStrand + local % segmentsPerStrand;
+
+    vec4 a = projectPoint(point);
+    vec4 b = projectPoint(point + 1);
+
+    // Segments crossing the near plane are dropped rather than clipped.
+    if (a.w < 0 || b.w < 0)
+        return;
+
+    // Half a pixel either side covers the filter footprint of the coverage.
+    float extent = max(a.z, b.z) + 0.5f;
+
+    vec2 lo = min(a.xy, b.xy) - extent;
+    vec2 hi = max(a.xy, b.xy) + extent;
+
+    if (any(greaterThanEqual(lo, vec2(u_ScreenWidth, u_ScreenHeight))) || any(lessThan(hi, vec2(0))))
+        return;
+
+    uvec2 tileMin = uvec2(max(lo, vec2(0))) / VHS_RASTER_TILE_SIZE;
+    uvec2 tileMax = min(uvec2(hi) / VHS_RASTER_TILE_SIZE, uvec2(u_TilesX, u_TilesY) - 1);
+
+    uint numTiles = u_TilesX * u_TilesY;
+
+    for (uint y = tileMin.y; y <= tileMax.y; ++y)
+    {
+        for (uint x = tileMin.x; x <= tileMax.x; ++x)
+        {
+            uint tile = y * u_TilesX + x;
+
+            if (!SCATTER)
+            {
+                atomicAdd(TileData[tile], 1);
+                continue;
+            }
+
+            uint index = atomicAdd(TileData[numTiles + tile], 1);
+
+            if (index < u_TilePoolSize)
+                TileData[2 * numTiles + index] = point;
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#version 450
+
+// Hair rasterised by rasterise_strands.glsl, premultiplied by its coverage.
+layout (std430, set = 0, binding = VHS_RASTER_BUFFER_BINDING) readonly buffer raster
+{
+    uint RasterBuffer[];
+};
+
+layout (push_constant) uniform PushConstants
+{
+    uint u_ScreenWidth;
+};
+
+layout (location = 0) out vec4 fsOut_Colour;
+
+void main()
+{
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+
+    fsOut_Colour = unpackUnorm4x8(RasterBuffer[pixel.y * u_ScreenWidth + pixel.x]);
+}
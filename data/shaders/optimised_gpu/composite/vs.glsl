@@ -0,0 +1,9 @@
+#version 450
+
+// Single triangle covering the whole screen.
+void main()
+{
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+
+    gl_Position = vec4(position * 2 - 1, 0, 1);
+}
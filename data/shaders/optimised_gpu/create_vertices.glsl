@@ -1,6 +1,7 @@
 #version 450
 
-layout (local_size_x = VHS_COMPUTE_LOCAL_SIZE) in;
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
 
 layout (std430, set = 0, binding = VHS_PARTICLE_BUFFER_BINDING) readonly buffer ssbo
 {
@@ -12,6 +13,9 @@ layout (std430, set = 0, binding = VHS_VERTEX_BUFFER_BINDING) buffer vbo
     float VertexBuffer[];
 };
 
+// Triangles that survived culling, see buffers.glslh for the layout.
+#include "buffers.glslh"
+
 layout (push_constant) uniform ubo
 {
     vec3 u_CameraFront;
@@ -20,113 +24,163 @@ layout (push_constant) uniform ubo
     uint u_HairParticlesPerStrand;
     uint u_HairStrandsPerTriangle;
     uint u_TrianglesPerGroup;
+    uint u_VisibleTrianglesOffset;
+    uint u_RootIndicesOffset;
+    uint u_RootIndicesWide;
+    uint u_BarycentricOffset;
+    uint u_PreviousPositionsOffset;
+    float u_Interpolation;
+    uint u_HairSmoothFactor;
 };
 
-shared vec3 PositionBuffer[VHS_COMPUTE_LOCAL_SIZE];
-shared vec3 BarycentricCoords[VHS_COMPUTE_LOCAL_SIZE];
-shared uint HairRootIndexBuffer[VHS_COMPUTE_LOCAL_SIZE];
+// Guide strands grow from the corners of each triangle and the interpolated strands are blended from them. A group
+// holds a whole number of triangles, with enough invocations for both the three guides and all interpolated strands.
+shared vec3 GuideBuffer[gl_WorkGroupSize.x];
+shared vec3 StrandBuffer[gl_WorkGroupSize.x];
+shared vec3 BarycentricCoords[gl_WorkGroupSize.x];
+shared uint HairRootIndexBuffer[gl_WorkGroupSize.x];
 
-void main()
+vec3 loadPosition(uint offset)
 {
-    uint numIndices = u_TrianglesPerGroup * 3;
+    vec3 position;
+
+    position.x = ParticleStateBuffer[offset + u_HairTotalParticles * 0];
+    position.y = ParticleStateBuffer[offset + u_HairTotalParticles * 1];
+    position.z = ParticleStateBuffer[offset + u_HairTotalParticles * 2];
+
+    return position;
+}
 
-    // Because we don't completely fill the local group with meaninful work we need to calculate the global ID
-    // manually to find the correct offset within the buffers.
+// Uniform Catmull-Rom segment from p1 to p2 and its derivative.
+vec3 catmullRom(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float t)
+{
+    return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t * t
+        + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t * t);
+}
+
+vec3 catmullRomTangent(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float t)
+{
+    return 0.5f * ((p2 - p0) + 2.0f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t
+        + 3.0f * (3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t);
+}
+
+// Groups work through the visible triangles only, but write their vertices in the same place as if nothing was culled
+// so the draws can use the original indices.
+void main()
+{
     uint lid = gl_LocalInvocationID.x;
-    uint gid = gl_WorkGroupID.x * numIndices + lid;
 
-    // Load the barycentric coordinates into shared memory.
+    uint numIndices = u_TrianglesPerGroup * 3;
+    uint numTriangles = NumVisibleTriangles;
+    uint firstTriangle = gl_WorkGroupID.x * u_TrianglesPerGroup;
+
+    // Load the barycentric coordinates and root vertex triangle indices into shared memory. The last group may run past
+    // the end of the visible triangles.
     if (lid < u_HairStrandsPerTriangle)
     {
-        uint barycentricOffset = u_HairTotalParticles * 3 * 2 + u_TrianglesPerGroup * gl_NumWorkGroups.x * 3;
-
-        BarycentricCoords[lid].x = ParticleStateBuffer[barycentricOffset + 3 * lid + 0];
-        BarycentricCoords[lid].y = ParticleStateBuffer[barycentricOffset + 3 * lid + 1];
-        BarycentricCoords[lid].z = ParticleStateBuffer[barycentricOffset + 3 * lid + 2];
+        BarycentricCoords[lid].x = ParticleStateBuffer[u_BarycentricOffset + 3 * lid + 0];
+        BarycentricCoords[lid].y = ParticleStateBuffer[u_BarycentricOffset + 3 * lid + 1];
+        BarycentricCoords[lid].z = ParticleStateBuffer[u_BarycentricOffset + 3 * lid + 2];
     }
 
-    // Load the root vertex triangle indices into shared memory.
     if (lid < numIndices)
     {
-        uint indicesOffset = u_HairTotalParticles * 3 * 2;
-
-        HairRootIndexBuffer[lid] = uint(ParticleStateBuffer[indicesOffset + gid]);
+        uint slot = firstTriangle + lid / 3;
+        HairRootIndexBuffer[lid] = (slot < numTriangles) ? loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide,
+            CullData[u_VisibleTrianglesOffset + slot] * 3 + lid % 3) : 0;
     }
 
     barrier();
 
-    // Load the initial particle positions from the state buffer.
-    uint numInitialParticles = u_HairParticlesPerStrand * u_TrianglesPerGroup * 3;
-
-    if (lid < numInitialParticles)
+    // Load the guide particles, blended between the last two ticks.
+    //
+    // 0: triangle 0 corner 0 particle 0
+    // 1: triangle 0 corner 0 particle 1
+    // ...
+    // x: triangle 0 corner 1 particle 0
+    // ...
+    // y: triangle 1 corner 0 particle 0
+    if (lid < numIndices * u_HairParticlesPerStrand)
     {
-        // 0: triangle 0 strand 0 particle 0
-        // 1: triangle 0 strand 0 particle 1
-        // 2: triangle 0 strand 0 particle 2
-        // ...
-        // x: triangle 0 strand 1 particle 0
-        // ...
-        // y: triangle 1 strand 0 particle 0
-        // ...
-
-        uint triangleIndex = lid / (u_HairParticlesPerStrand * 3);
-        uint strandIndex = (lid / u_HairParticlesPerStrand) % 3;
-        uint particleIndex = lid % u_HairParticlesPerStrand;
-
-        uint indexOffset = HairRootIndexBuffer[triangleIndex * 3 + strandIndex] * u_HairParticlesPerStrand;
-        uint particleOffset = indexOffset + particleIndex;
-
-        PositionBuffer[lid].x = ParticleStateBuffer[particleOffset + u_HairTotalParticles * 0];
-        PositionBuffer[lid].y = ParticleStateBuffer[particleOffset + u_HairTotalParticles * 1];
-        PositionBuffer[lid].z = ParticleStateBuffer[particleOffset + u_HairTotalParticles * 2];
+        uint corner = lid / u_HairParticlesPerStrand;
+        uint particle = lid % u_HairParticlesPerStrand;
+
+        uint offset = HairRootIndexBuffer[corner] * u_HairParticlesPerStrand + particle;
+
+        vec3 current = loadPosition(offset);
+        vec3 previous = loadPosition(offset + u_PreviousPositionsOffset);
+
+        GuideBuffer[lid] = mix(previous, current, u_Interpolation);
     }
-    else
+
+    barrier();
+
+    // Each invocation blends one particle of an interpolated strand from the three guides of its triangle.
+    uint particlesPerTriangle = u_HairStrandsPerTriangle * u_HairParticlesPerStrand;
+
+    uint triangle = lid / particlesPerTriangle;
+    uint strand = lid / u_HairParticlesPerStrand;
+    uint particle = lid % u_HairParticlesPerStrand;
+
+    bool valid = triangle < u_TrianglesPerGroup && firstTriangle + triangle < numTriangles;
+
+    if (valid)
     {
-        PositionBuffer[lid] = vec3(0);
-    }
+        uint guide = triangle * 3 * u_HairParticlesPerStrand + particle;
+        vec3 b = BarycentricCoords[strand % u_HairStrandsPerTriangle];
 
-    // Compute the new global ID for the vertices.
-    gid = gl_WorkGroupID.x * u_TrianglesPerGroup * u_HairParticlesPerStrand * u_HairStrandsPerTriangle + lid;
+        StrandBuffer[lid] = GuideBuffer[guide + u_HairParticlesPerStrand * 0] * b.x
+            + GuideBuffer[guide + u_HairParticlesPerStrand * 1] * b.y
+            + GuideBuffer[guide + u_HairParticlesPerStrand * 2] * b.z;
+    }
 
     barrier();
 
-    // Find the indices of the original particle for the interpolation step and load them from shared memory.
-    uint triangleIndex = lid / (u_HairParticlesPerStrand * 3);
-    uint particleIndex = lid % u_HairParticlesPerStrand;
+    if (!valid)
+        return;
 
-    vec3 b0 = PositionBuffer[triangleIndex * u_HairParticlesPerStrand * 3 + u_HairParticlesPerStrand * 0 + particleIndex];
-    vec3 b1 = PositionBuffer[triangleIndex * u_HairParticlesPerStrand * 3 + u_HairParticlesPerStrand * 1 + particleIndex];
-    vec3 b2 = PositionBuffer[triangleIndex * u_HairParticlesPerStrand * 3 + u_HairParticlesPerStrand * 2 + particleIndex];
+    // Tessellate the strand into smooth factor points per particle spread evenly along a Catmull-Rom spline through the
+    // particles, with the end points repeated. Each invocation writes the points following its own particle.
+    uint first = strand * u_HairParticlesPerStrand;
+    uint last = first + u_HairParticlesPerStrand - 1;
 
-    // Load the barycentric coordinate and compute the new interpolated particle position.
-    vec3 b = BarycentricCoords[lid / u_HairParticlesPerStrand];
-    vec3 p = b0 * b.x + b1 * b.y + b2 * b.z;
+    uint numPoints = u_HairParticlesPerStrand * u_HairSmoothFactor;
+    float scale = float(u_HairParticlesPerStrand - 1) / float(numPoints - 1);
 
-    // Compute the vector perpendicular to the camera and hair direction.
-    bool valid = lid < (u_TrianglesPerGroup * u_HairParticlesPerStrand * u_HairStrandsPerTriangle);
-    bool end = particleIndex == (u_HairParticlesPerStrand - 1);
+    uint meshTriangle = CullData[u_VisibleTrianglesOffset + firstTriangle + triangle];
+    uint globalStrand = meshTriangle * u_HairStrandsPerTriangle + strand % u_HairStrandsPerTriangle;
 
-    uint i0 = end ? (particleIndex - 1) : particleIndex;
-    uint i1 = end ? particleIndex : (particleIndex + 1);
+    for (uint i = 0; i < u_HairSmoothFactor; ++i)
+    {
+        uint point = particle * u_HairSmoothFactor + i;
 
-    vec3 v0 = PositionBuffer[triangleIndex * u_HairParticlesPerStrand * 3 + i0];
-    vec3 v1 = PositionBuffer[triangleIndex * u_HairParticlesPerStrand * 3 + i1];
+        float t = float(point) * scale;
+        uint segment = min(uint(t), u_HairParticlesPerStrand - 2);
 
-    vec3 perp = u_HairDrawRadius * normalize(cross(v1 - v0, u_CameraFront));
+        vec3 p0 = StrandBuffer[max(first + segment, first + 1) - 1];
+        vec3 p1 = StrandBuffer[first + segment];
+        vec3 p2 = StrandBuffer[first + segment + 1];
+        vec3 p3 = StrandBuffer[min(first + segment + 2, last)];
 
-    // Create the two vertices.
-    vec3 p0 = p - perp;
-    vec3 p1 = p + perp;
+        float u = t - float(segment);
 
-    if (valid)
-    {
+        vec3 p = catmullRom(p0, p1, p2, p3, u);
+        vec3 tangent = catmullRomTangent(p0, p1, p2, p3, u);
+
+        // Compute the vector perpendicular to the camera and hair direction and create the two vertices.
+        vec3 perp = u_HairDrawRadius * normalize(cross(tangent, u_CameraFront));
+
+        vec3 v0 = p - perp;
+        vec3 v1 = p + perp;
+
+        uint vertex = 2 * (globalStrand * numPoints + point);
 
-        VertexBuffer[6 * gid + 0] = p0.x;
-        VertexBuffer[6 * gid + 1] = p0.y;
-        VertexBuffer[6 * gid + 2] = p0.z;
+        VertexBuffer[3 * vertex + 0] = v0.x;
+        VertexBuffer[3 * vertex + 1] = v0.y;
+        VertexBuffer[3 * vertex + 2] = v0.z;
 
-        VertexBuffer[6 * gid + 3] = p1.x;
-        VertexBuffer[6 * gid + 4] = p1.y;
-        VertexBuffer[6 * gid + 5] = p1.z;
+        VertexBuffer[3 * vertex + 3] = v1.x;
+        VertexBuffer[3 * vertex + 4] = v1.y;
+        VertexBuffer[3 * vertex + 5] = v1.z;
     }
 }
@@ -0,0 +1,228 @@
+#version 450
+
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
+
+// Whether the draws are instanced strips rather than ranges of the index buffer.
+layout (constant_id = 2) const bool INSTANCED_STRANDS = false;
+
+layout (std430, set = 0, binding = VHS_PARTICLE_BUFFER_BINDING) readonly buffer ssbo
+{
+    float ParticleStateBuffer[];
+};
+
+// Written here, see buffers.glslh for the layout.
+#define VHS_CULL_BUFFER_ACCESS
+#include "buffers.glslh"
+
+// Furthest depth of the root mesh over each texel of every level, level zero at full resolution.
+layout (std430, set = 0, binding = VHS_HIZ_BUFFER_BINDING) readonly buffer hiz
+{
+    float HiZBuffer[];
+};
+
+layout (push_constant) uniform ubo
+{
+    mat4 u_ModelViewProjection;
+    vec3 u_CameraPosition;
+    float u_CullDistance;
+    float u_CullMargin;
+    uint u_HairTotalParticles;
+    uint u_HairParticlesPerStrand;
+    uint u_HairStrandsPerTriangle;
+    uint u_NumTriangles;
+    uint u_TrianglesPerGroup;
+    uint u_RootIndicesOffset;
+    uint u_RootIndicesWide;
+    uint u_PreviousPositionsOffset;
+    uint u_DrawVertexCount;
+    uint u_CullEnabled;
+};
+
+vec3 loadPosition(uint offset)
+{
+    vec3 position;
+
+    position.x = ParticleStateBuffer[offset + u_HairTotalParticles * 0];
+    position.y = ParticleStateBuffer[offset + u_HairTotalParticles * 1];
+    position.z = ParticleStateBuffer[offset + u_HairTotalParticles * 2];
+
+    return position;
+}
+
+// The box is outside if all of its corners are beyond the same clip plane. The near plane test uses -w so it holds for
+// either depth convention.
+bool outsideFrustum(vec3 lo, vec3 hi)
+{
+    vec3 lower = vec3(-1e30f);
+    vec3 upper = vec3(1e30f);
+
+    for (uint i = 0; i < 8; ++i)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? hi.x : lo.x, (i & 2) != 0 ? hi.y : lo.y, (i & 4) != 0 ? hi.z : lo.z);
+        vec4 clip = u_ModelViewProjection * vec4(corner, 1);
+
+        // Furthest any corner gets inside the lower and upper planes of each axis.
+        lower = max(lower, clip.xyz + clip.w);
+        upper = min(upper, clip.xyz - clip.w);
+    }
+
+    return any(lessThan(lower, vec3(0))) || any(greaterThan(upper, vec3(0)));
+}
+
+float loadHiZ(uint level, uvec2 texel)
+{
+    uint offset = 0;
+    uint width = OcclusionWidth;
+    uint height = OcclusionHeight;
+
+    for (uint i = 0; i < level; ++i)
+    {
+        offset += width * height;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    texel = min(texel, uvec2(width, height) - 1);
+
+    return HiZBuffer[offset + texel.y * width + texel.x];
+}
+
+// The box is hidden if its nearest point is behind the furthest root mesh depth over the area it covers, as seen in
+// the frame the depth was taken. Boxes that weren't entirely on screen then are always kept.
+bool occluded(vec3 lo, vec3 hi)
+{
+    vec2 ndcMin = vec2(1e30f);
+    vec2 ndcMax = vec2(-1e30f);
+    float nearest = 1e30f;
+
+    for (uint i = 0; i < 8; ++i)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? hi.x : lo.x, (i & 2) != 0 ? hi.y : lo.y, (i & 4) != 0 ? hi.z : lo.z);
+        vec4 clip = OcclusionViewProjection * vec4(corner, 1);
+
+        if (clip.w <= 0)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+
+    if (any(lessThan(ndcMin, vec2(-1))) || any(greaterThan(ndcMax, vec2(1))))
+        return false;
+
+    vec2 size = vec2(OcclusionWidth, OcclusionHeight);
+
+    uvec2 pixelMin = uvec2(min((ndcMin * 0.5f + 0.5f) * size, size - 1));
+    uvec2 pixelMax = uvec2(min((ndcMax * 0.5f + 0.5f) * size, size - 1));
+
+    // Pick the level where the box covers at most two texels in each direction.
+    uvec2 extent = pixelMax - pixelMin + 1;
+    uint level = min(uint(ceil(log2(float(max(extent.x, extent.y))))), OcclusionLevels - 1);
+
+    uvec2 texelMin = pixelMin >> level;
+    uvec2 texelMax = pixelMax >> level;
+
+    float furthest = max(max(loadHiZ(level, texelMin), loadHiZ(level, uvec2(texelMax.x, texelMin.y))),
+        max(loadHiZ(level, uvec2(texelMin.x, texelMax.y)), loadHiZ(level, texelMax)));
+
+    return nearest > furthest;
+}
+
+// Each invocation tests the bounds of one root triangle. Interpolated strands are blends of the three guides so stay
+// inside their box, give or take the draw radius and the spline overshooting the particles. The previous positions are
+// included as the draw may be part way between ticks.
+void main()
+{
+    uint triangle = gl_GlobalInvocationID.x;
+
+    if (triangle >= u_NumTriangles)
+        return;
+
+    uvec3 corners = uvec3(loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide, triangle * 3 + 0),
+        loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide, triangle * 3 + 1),
+        loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide, triangle * 3 + 2));
+
+    // Roots of the guides are the root mesh's vertices, written out for the depth pre-pass whether or not the triangle
+    // is visible.
+    if (ScalpEnabled != 0)
+    {
+        for (uint corner = 0; corner < 3; ++corner)
+        {
+            vec3 root = loadPosition(corners[corner] * u_HairParticlesPerStrand);
+            uint offset = cullCornersOffset(u_NumTriangles) + 9 * triangle + 3 * corner;
+
+            CullData[offset + 0] = floatBitsToUint(root.x);
+            CullData[offset + 1] = floatBitsToUint(root.y);
+            CullData[offset + 2] = floatBitsToUint(root.z);
+        }
+    }
+
+    bool visible = true;
+
+    if (u_CullEnabled != 0)
+    {
+        vec3 lo = vec3(1e30f);
+        vec3 hi = vec3(-1e30f);
+
+        for (uint corner = 0; corner < 3; ++corner)
+        {
+            uint first = corners[corner] * u_HairParticlesPerStrand;
+
+            for (uint particle = 0; particle < u_HairParticlesPerStrand; ++particle)
+            {
+                vec3 current = loadPosition(first + particle);
+                vec3 previous = loadPosition(first + particle + u_PreviousPositionsOffset);
+
+                lo = min(lo, min(current, previous));
+                hi = max(hi, max(current, previous));
+            }
+        }
+
+        lo -= vec3(u_CullMargin);
+        hi += vec3(u_CullMargin);
+
+        // Distance from the camera to the nearest point of the box, zero when the camera is inside it.
+        float cameraDistance = length(max(max(lo - u_CameraPosition, u_CameraPosition - hi), vec3(0)));
+
+        visible = !outsideFrustum(lo, hi) && (u_CullDistance <= 0 || cameraDistance <= u_CullDistance);
+
+        if (visible && OcclusionLevels != 0)
+            visible = !occluded(lo, hi);
+    }
+
+    if (!visible)
+        return;
+
+    // Triangles are packed in whatever order they finish, which is fine as the draws and vertices keep their original
+    // places in the index and vertex buffers. A new create vertices group is needed every triangles per group slots.
+    uint slot = atomicAdd(NumVisibleTriangles, 1);
+
+    if (slot % u_TrianglesPerGroup == 0)
+        atomicAdd(DispatchX, 1);
+
+    // Either the triangle's strands as instances of one strip, or their range of the index buffer. The vertex count is
+    // per strand or per triangle to match.
+    uint draw = cullDrawOffset(slot);
+
+    if (INSTANCED_STRANDS)
+    {
+        CullData[draw + 0] = u_DrawVertexCount;
+        CullData[draw + 1] = u_HairStrandsPerTriangle;
+        CullData[draw + 2] = 0;
+        CullData[draw + 3] = triangle * u_HairStrandsPerTriangle;
+    }
+    else
+    {
+        CullData[draw + 0] = u_DrawVertexCount;
+        CullData[draw + 1] = 1;
+        CullData[draw + 2] = triangle * u_DrawVertexCount;
+        CullData[draw + 3] = 0;
+        CullData[draw + 4] = 0;
+    }
+
+    CullData[cullVisibleTrianglesOffset(u_NumTriangles) + slot] = triangle;
+}
@@ -0,0 +1,42 @@
+#version 450
+
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
+
+layout (std430, set = 0, binding = VHS_HIZ_BUFFER_BINDING) buffer hiz
+{
+    float HiZBuffer[];
+};
+
+layout (push_constant) uniform ubo
+{
+    uint u_SrcOffset;
+    uint u_SrcWidth;
+    uint u_SrcHeight;
+    uint u_DstOffset;
+    uint u_DstWidth;
+    uint u_DstHeight;
+};
+
+float loadSource(uint x, uint y)
+{
+    return HiZBuffer[u_SrcOffset + y * u_SrcWidth + x];
+}
+
+// Build one level of the depth pyramid from the one above. Each invocation writes a texel as the furthest of the up to
+// four it covers, levels are rounded up in size so odd rows and columns are never dropped.
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= u_DstWidth * u_DstHeight)
+        return;
+
+    uvec2 dst = uvec2(i % u_DstWidth, i / u_DstWidth);
+
+    uvec2 src0 = dst * 2;
+    uvec2 src1 = min(src0 + 1, uvec2(u_SrcWidth, u_SrcHeight) - 1);
+
+    HiZBuffer[u_DstOffset + i] = max(max(loadSource(src0.x, src0.y), loadSource(src1.x, src0.y)),
+        max(loadSource(src0.x, src1.y), loadSource(src1.x, src1.y)));
+}
@@ -0,0 +1,45 @@
+#version 450
+
+layout (std430, set = 0, binding = VHS_VERTEX_BUFFER_BINDING) readonly buffer vbo
+{
+    float VertexBuffer[];
+};
+
+layout (push_constant) uniform PushConstants
+{
+    mat4 u_ModelViewProjection;
+    uint u_VerticesPerStrand;
+};
+
+layout (location = 0) out vec3 vsOut_Colour;
+
+float rand(vec2 seed)
+{
+    return fract(sin(dot(seed, vec2(12.989, 78.233))) * 43758.5453);
+}
+
+vec3 randcol(uint id)
+{
+    vec3 col;
+
+    col.r = rand(vec2(id, id + 1000));
+    col.g = rand(vec2(id, id + 2000));
+    col.b = rand(vec2(id, id + 3000));
+
+    return col;
+}
+
+// Each instance is one strand's strip out of the created vertices, which are stored strand after strand.
+void main()
+{
+    uint vertex = gl_InstanceIndex * u_VerticesPerStrand + gl_VertexIndex;
+
+    vec3 position;
+
+    position.x = VertexBuffer[3 * vertex + 0];
+    position.y = VertexBuffer[3 * vertex + 1];
+    position.z = VertexBuffer[3 * vertex + 2];
+
+    gl_Position = u_ModelViewProjection * vec4(position, 1);
+    vsOut_Colour = randcol(vertex / 8);
+}
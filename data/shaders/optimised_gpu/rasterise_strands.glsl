@@ -0,0 +1,161 @@
+#version 450
+
+// One group per tile with an invocation for each of its pixels.
+layout (local_size_x = VHS_RASTER_TILE_SIZE, local_size_y = VHS_RASTER_TILE_SIZE) in;
+
+layout (std430, set = 0, binding = VHS_VERTEX_BUFFER_BINDING) readonly buffer vbo
+{
+    float VertexBuffer[];
+};
+
+// Full resolution depth of the root mesh, only present with the depth pre-pass.
+layout (std430, set = 0, binding = VHS_HIZ_BUFFER_BINDING) readonly buffer hiz
+{
+    float HiZBuffer[];
+};
+
+// Segments binned into each tile, see bin_strands.glsl for the layout.
+layout (std430, set = 0, binding = VHS_RASTER_TILE_BUFFER_BINDING) readonly buffer tiles
+{
+    uint TileTotal;
+    uint TileData[];
+};
+
+// Premultiplied colour and coverage of the hair in each pixel, packed eight bits per channel.
+layout (std430, set = 0, binding = VHS_RASTER_BUFFER_BINDING) writeonly buffer raster
+{
+    uint RasterBuffer[];
+};
+
+layout (push_constant) uniform ubo
+{
+    mat4 u_ModelViewProjection;
+    uint u_ScreenWidth;
+    uint u_ScreenHeight;
+    uint u_TilesX;
+    uint u_TilesY;
+    uint u_TilePoolSize;
+    uint u_PointsPerStrand;
+    uint u_HairStrandsPerTriangle;
+    uint u_VisibleTrianglesOffset;
+    uint u_DepthTest;
+};
+
+const uint LOCAL_SIZE = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+
+// Projected end points of a batch of the tile's segments with their half widths and depths, and the colour of each.
+shared vec4 SegmentStart[LOCAL_SIZE];
+shared vec4 SegmentEnd[LOCAL_SIZE];
+shared vec3 SegmentColour[LOCAL_SIZE];
+
+float rand(vec2 seed)
+{
+    return fract(sin(dot(seed, vec2(12.989, 78.233))) * 43758.5453);
+}
+
+vec3 randcol(uint id)
+{
+    vec3 col;
+
+    col.r = rand(vec2(id, id + 1000));
+    col.g = rand(vec2(id, id + 2000));
+    col.b = rand(vec2(id, id + 3000));
+
+    return col;
+}
+
+vec3 loadVertex(uint vertex)
+{
+    return vec3(VertexBuffer[3 * vertex + 0], VertexBuffer[3 * vertex + 1], VertexBuffer[3 * vertex + 2]);
+}
+
+// Screen position of the point between a pair of created vertices, half the distance between them in pixels and the
+// depth of the point. Binning has already dropped anything behind the camera.
+vec4 projectPoint(uint point)
+{
+    vec4 v0 = u_ModelViewProjection * vec4(loadVertex(2 * point + 0), 1);
+    vec4 v1 = u_ModelViewProjection * vec4(loadVertex(2 * point + 1), 1);
+
+    vec2 size = vec2(u_ScreenWidth, u_ScreenHeight);
+
+    vec2 s0 = (v0.xy / v0.w * 0.5f + 0.5f) * size;
+    vec2 s1 = (v1.xy / v1.w * 0.5f + 0.5f) * size;
+
+    return vec4((s0 + s1) * 0.5f, length(s1 - s0) * 0.5f, (v0.z / v0.w + v1.z / v1.w) * 0.5f);
+}
+
+// Every pixel of the tile walks the segments binned into it and works out how much of the pixel each covers from the
+// distance to the segment, so strands thinner than a pixel only cover part of it rather than whole pixels or none.
+// Overlapping strands are blended with weighted average transparency so the order the segments were binned in doesn't
+// matter.
+void main()
+{
+    uint tile = gl_WorkGroupID.y * u_TilesX + gl_WorkGroupID.x;
+    uint lid = gl_LocalInvocationIndex;
+
+    uvec2 pixel = gl_GlobalInvocationID.xy;
+    bool inside = pixel.x < u_ScreenWidth && pixel.y < u_ScreenHeight;
+
+    vec2 centre = vec2(pixel) + 0.5f;
+    float sceneDepth = (inside && u_DepthTest != 0) ? HiZBuffer[pixel.y * u_ScreenWidth + pixel.x] : 1.0f;
+
+    // Segments that didn't fit in the pool were never written.
+    uint numTiles = u_TilesX * u_TilesY;
+    uint end = TileData[numTiles + tile];
+
+    uint start = min(end - TileData[tile], u_TilePoolSize);
+    uint numSegments = min(end, u_TilePoolSize) - start;
+
+    vec3 colourSum = vec3(0);
+    float coverageSum = 0;
+    float transmittance = 1;
+
+    for (uint first = 0; first < numSegments; first += LOCAL_SIZE)
+    {
+        // Project a batch of segments once for the whole tile.
+        if (first + lid < numSegments)
+        {
+            uint point = TileData[2 * numTiles + start + first + lid];
+
+            SegmentStart[lid] = projectPoint(point);
+            SegmentEnd[lid] = projectPoint(point + 1);
+            SegmentColour[lid] = randcol(2 * point / 8);
+        }
+
+        barrier();
+
+        uint count = min(numSegments - first, LOCAL_SIZE);
+
+        for (uint i = 0; i < count; ++i)
+        {
+            vec4 a = SegmentStart[i];
+            vec4 b = SegmentEnd[i];
+
+            vec2 ab = b.xy - a.xy;
+            float t = clamp(dot(centre - a.xy, ab) / max(dot(ab, ab), 1e-8f), 0.0f, 1.0f);
+
+            float halfWidth = mix(a.z, b.z, t);
+            float depth = mix(a.w, b.w, t);
+
+            // Box filtered coverage of a line of the given width, capped at the width for strands thinner than a pixel.
+            float coverage = clamp(halfWidth + 0.5f - distance(centre, a.xy + ab * t), 0.0f, min(2 * halfWidth, 1.0f));
+
+            if (coverage <= 0 || depth > sceneDepth)
+                continue;
+
+            colourSum += SegmentColour[i] * coverage;
+            coverageSum += coverage;
+            transmittance *= 1 - coverage;
+        }
+
+        barrier();
+    }
+
+    if (!inside)
+        return;
+
+    float alpha = 1 - transmittance;
+    vec3 colour = coverageSum > 0 ? colourSum / coverageSum * alpha : vec3(0);
+
+    RasterBuffer[pixel.y * u_ScreenWidth + pixel.x] = packUnorm4x8(vec4(colour, alpha));
+}
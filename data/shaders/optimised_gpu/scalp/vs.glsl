@@ -0,0 +1,24 @@
+#version 450
+
+// Root triangle corners written by the cull kernel, see buffers.glslh for the layout.
+#include "../buffers.glslh"
+
+layout (push_constant) uniform PushConstants
+{
+    mat4 u_ModelViewProjection;
+    uint u_ScalpOffset;
+};
+
+// Depth only draw of the root mesh, three vertices per triangle.
+void main()
+{
+    uint offset = u_ScalpOffset + 3 * gl_VertexIndex;
+
+    vec3 position;
+
+    position.x = uintBitsToFloat(CullData[offset + 0]);
+    position.y = uintBitsToFloat(CullData[offset + 1]);
+    position.z = uintBitsToFloat(CullData[offset + 2]);
+
+    gl_Position = u_ModelViewProjection * vec4(position, 1);
+}
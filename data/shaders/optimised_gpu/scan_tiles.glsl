@@ -0,0 +1,74 @@
+#version 450
+
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
+
+// Segments binned into each tile, see bin_strands.glsl for the layout.
+layout (std430, set = 0, binding = VHS_RASTER_TILE_BUFFER_BINDING) buffer tiles
+{
+    uint TileTotal;
+    uint TileData[];
+};
+
+layout (push_constant) uniform ubo
+{
+    mat4 u_ModelViewProjection;
+    uint u_ScreenWidth;
+    uint u_ScreenHeight;
+    uint u_TilesX;
+    uint u_TilesY;
+    uint u_TilePoolSize;
+    uint u_PointsPerStrand;
+    uint u_HairStrandsPerTriangle;
+    uint u_VisibleTrianglesOffset;
+    uint u_DepthTest;
+};
+
+const uint LOCAL_SIZE = gl_WorkGroupSize.x;
+
+shared uint Sums[LOCAL_SIZE];
+
+// A single group turns the tiles' segment counts into the start of each tile's list in the pool. Every invocation sums
+// a run of tiles, the sums are scanned across the group and each run is then written out from its starting offset. The
+// scatter pass advances the offsets as it writes so they end up at the end of each list.
+void main()
+{
+    uint lid = gl_LocalInvocationIndex;
+
+    uint numTiles = u_TilesX * u_TilesY;
+    uint tilesPerInvocation = (numTiles + LOCAL_SIZE - 1) / LOCAL_SIZE;
+
+    uint first = lid * tilesPerInvocation;
+    uint last = min(first + tilesPerInvocation, numTiles);
+
+    uint sum = 0;
+
+    for (uint tile = first; tile < last; ++tile)
+        sum += TileData[tile];
+
+    Sums[lid] = sum;
+
+    barrier();
+
+    for (uint offset = 1; offset < LOCAL_SIZE; offset *= 2)
+    {
+        uint value = lid >= offset ? Sums[lid - offset] : 0;
+
+        barrier();
+
+        Sums[lid] += value;
+
+        barrier();
+    }
+
+    uint start = Sums[lid] - sum;
+
+    for (uint tile = first; tile < last; ++tile)
+    {
+        TileData[numTiles + tile] = start;
+        start += TileData[tile];
+    }
+
+    if (lid == LOCAL_SIZE - 1)
+        TileTotal = Sums[lid];
+}
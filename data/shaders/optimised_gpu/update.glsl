@@ -1,6 +1,7 @@
 #version 450
 
-layout (local_size_x = VHS_COMPUTE_LOCAL_SIZE) in;
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
 
 layout (std430, set = 0, binding = VHS_PARTICLE_BUFFER_BINDING) buffer ssbo
 {
@@ -19,83 +20,98 @@ layout (push_constant) uniform ubo
     uint u_HairTotalParticles;
     uint u_HairParticlesPerStrand;
     uint u_FtlIterations;
+    uint u_HairParticlesPerGroup;
+    uint u_PreviousPositionsOffset;
 };
 
-shared vec3 PositionBuffer[VHS_COMPUTE_LOCAL_SIZE];
-shared vec3 VelocityBuffer[VHS_COMPUTE_LOCAL_SIZE];
+// Each group works on whole strands so the constraints never read across a group boundary, with short strands packed
+// several to a group. Vertex creation already needs a group to hold three strands, so a strand always fits in a group
+// and each invocation owns a single particle.
+const uint LOCAL_SIZE = gl_WorkGroupSize.x;
 
-void main()
+shared vec3 PositionBuffer[LOCAL_SIZE];
+
+// Apply the distance constraint to every particle with the given parity within its strand.
+void solveConstraints(uint slot, uint parity)
 {
-    uint gid = gl_GlobalInvocationID.x;
-    uint lid = gl_LocalInvocationID.x;
+    uint particle = slot % u_HairParticlesPerStrand;
+
+    if (slot < u_HairParticlesPerGroup && particle != 0 && particle % 2 == parity)
+    {
+        PositionBuffer[slot] = PositionBuffer[slot - 1]
+            + normalize(PositionBuffer[slot] - PositionBuffer[slot - 1]) * u_HairParticleSeparation;
+    }
+}
 
-    uint plid = lid - 1;
-    uint nlid = lid + 1;
+void main()
+{
+    uint slot = gl_LocalInvocationID.x;
+    uint gid = gl_WorkGroupID.x * u_HairParticlesPerGroup + slot;
 
-    bool valid = gid < u_HairTotalParticles;
-    bool root = (gid % u_HairParticlesPerStrand) == 0;
-    bool correct = (gid % u_HairParticlesPerStrand) != (u_HairParticlesPerStrand - 1);
+    bool valid = slot < u_HairParticlesPerGroup && gid < u_HairTotalParticles;
+    bool root = (slot % u_HairParticlesPerStrand) == 0;
+    bool correct = slot < u_HairParticlesPerGroup && (slot % u_HairParticlesPerStrand) != (u_HairParticlesPerStrand - 1);
 
-    // Load particle position and velocity into shared memory.
     uint offsetPosition = gid;
     uint offsetVelocity = gid + u_HairTotalParticles * 3;
 
-    PositionBuffer[lid].x = valid ? ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 0] : 0.0f;
-    PositionBuffer[lid].y = valid ? ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 1] : 0.0f;
-    PositionBuffer[lid].z = valid ? ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 2] : 0.0f;
+    // Load the particle and compute the position update.
+    vec3 originalPosition = vec3(0);
+    vec3 velocity = vec3(0);
+
+    if (valid)
+    {
+        originalPosition.x = ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 0];
+        originalPosition.y = ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 1];
+        originalPosition.z = ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 2];
 
-    VelocityBuffer[lid].x = valid ? ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 0] : 0.0f;
-    VelocityBuffer[lid].y = valid ? ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 1] : 0.0f;
-    VelocityBuffer[lid].z = valid ? ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 2] : 0.0f;
+        velocity.x = ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 0];
+        velocity.y = ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 1];
+        velocity.z = ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 2];
+    }
 
-    // Remember original particle position.
-    vec3 originalPosition = PositionBuffer[lid];
+    PositionBuffer[slot] = root ? (u_RootTransform * vec4(originalPosition, 1.0f)).xyz
+        : (originalPosition + velocity * u_DeltaTime + u_ExternalForces * u_DeltaTimeSq);
 
-    // Compute position update.
-    PositionBuffer[lid] = root ? (u_RootTransform * vec4(originalPosition, 1.0f)).xyz
-        : (originalPosition + VelocityBuffer[lid] * u_DeltaTime + u_ExternalForces * u_DeltaTimeSq);
+    barrier();
 
-    // Position before constraints of next particle.
-    vec3 preConstraintPosition = correct ? PositionBuffer[nlid] : vec3(0);
+    // Position before constraints of the next particle in the strand.
+    vec3 preConstraintPosition = correct ? PositionBuffer[slot + 1] : vec3(0);
 
     // Apply FTL alternately on even and odd particles.
     for (uint i = 0; i < u_FtlIterations; ++i)
     {
         barrier();
-
-        if (lid % 2 == 0)
-        {
-            PositionBuffer[lid] = root ? PositionBuffer[lid]
-                : (PositionBuffer[plid] + normalize(PositionBuffer[lid] - PositionBuffer[plid]) * u_HairParticleSeparation);
-        }
+        solveConstraints(slot, 0);
 
         barrier();
-
-        if (lid % 2 == 1)
-        {
-            PositionBuffer[lid] = root ? PositionBuffer[lid]
-                : (PositionBuffer[plid] + normalize(PositionBuffer[lid] - PositionBuffer[plid]) * u_HairParticleSeparation);
-        }
+        solveConstraints(slot, 1);
     }
 
+    barrier();
+
+    if (!valid)
+        return;
+
     // Find correction vector.
-    vec3 correction = correct ? (PositionBuffer[nlid] - preConstraintPosition) : vec3(0);
+    vec3 position = PositionBuffer[slot];
+    vec3 correction = correct ? (PositionBuffer[slot + 1] - preConstraintPosition) : vec3(0);
 
-    // Calculate base velocity.
-    VelocityBuffer[lid] = (PositionBuffer[lid] - originalPosition) * u_DeltaTimeInv;
+    // Calculate base velocity and apply correction if required.
+    velocity = (position - originalPosition) * u_DeltaTimeInv + correction * u_DampingFactor;
 
-    // Apply correction if required.
-    VelocityBuffer[lid] += correction * u_DampingFactor;
+    // Write results back to global memory, keeping the positions from before the tick for interpolation.
+    uint offsetPrevious = gid + u_PreviousPositionsOffset;
 
-    // Write results back to global memory.
-    if (valid)
-    {
-        ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 0] = PositionBuffer[lid].x;
-        ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 1] = PositionBuffer[lid].y;
-        ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 2] = PositionBuffer[lid].z;
+    ParticleStateBuffer[offsetPrevious + u_HairTotalParticles * 0] = originalPosition.x;
+    ParticleStateBuffer[offsetPrevious + u_HairTotalParticles * 1] = originalPosition.y;
+    ParticleStateBuffer[offsetPrevious + u_HairTotalParticles * 2] = originalPosition.z;
 
-        ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 0] = VelocityBuffer[lid].x;
-        ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 1] = VelocityBuffer[lid].y;
-        ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 2] = VelocityBuffer[lid].z;
-    }
+    ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 0] = position.x;
+    ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 1] = position.y;
+    ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 2] = position.z;
+
+    ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 0] = velocity.x;
+    ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 1] = velocity.y;
+    ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 2] = velocity.z;
 }
@@ -0,0 +1,116 @@
+#version 450
+
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_shuffle_relative : require
+
+// Workgroup size is specialised by the host to suit the device.
+layout (local_size_x_id = 0) in;
+
+layout (std430, set = 0, binding = VHS_PARTICLE_BUFFER_BINDING) buffer ssbo
+{
+    float ParticleStateBuffer[];
+};
+
+layout (push_constant) uniform ubo
+{
+    mat4 u_RootTransform;
+    vec3 u_ExternalForces;
+    float u_HairParticleSeparation;
+    float u_DeltaTime;
+    float u_DeltaTimeSq;
+    float u_DeltaTimeInv;
+    float u_DampingFactor;
+    uint u_HairTotalParticles;
+    uint u_HairParticlesPerStrand;
+    uint u_FtlIterations;
+    uint u_HairParticlesPerGroup;
+    uint u_PreviousPositionsOffset;
+};
+
+// Variant of the update for strands that fit in a subgroup. Each lane holds one particle and reads its neighbours with
+// shuffles, so there is no shared memory and no workgroup barriers. Subgroups loop over the group's strands as many as
+// fit at a time, which keeps the dispatch correct whatever subgroup size the device actually runs with. The host only
+// picks this kernel when a strand fits in the device's smallest subgroup size.
+void main()
+{
+    uint strandsPerGroup = u_HairParticlesPerGroup / u_HairParticlesPerStrand;
+    uint strandsPerPass = max(1u, gl_SubgroupSize / u_HairParticlesPerStrand);
+
+    uint lane = gl_SubgroupInvocationID;
+    uint particle = lane % u_HairParticlesPerStrand;
+
+    bool root = particle == 0;
+    bool correct = particle != (u_HairParticlesPerStrand - 1);
+
+    for (uint first = gl_SubgroupID * strandsPerPass; first < strandsPerGroup; first += gl_NumSubgroups * strandsPerPass)
+    {
+        // Every lane takes part in the shuffles, only those holding a real particle load and store.
+        uint strand = first + lane / u_HairParticlesPerStrand;
+        uint gid = (gl_WorkGroupID.x * strandsPerGroup + strand) * u_HairParticlesPerStrand + particle;
+
+        bool valid = lane < strandsPerPass * u_HairParticlesPerStrand && strand < strandsPerGroup && gid < u_HairTotalParticles;
+
+        uint offsetPosition = gid;
+        uint offsetVelocity = gid + u_HairTotalParticles * 3;
+
+        vec3 originalPosition = vec3(0);
+        vec3 velocity = vec3(0);
+
+        if (valid)
+        {
+            originalPosition.x = ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 0];
+            originalPosition.y = ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 1];
+            originalPosition.z = ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 2];
+
+            velocity.x = ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 0];
+            velocity.y = ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 1];
+            velocity.z = ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 2];
+        }
+
+        // Compute position update.
+        vec3 position = root ? (u_RootTransform * vec4(originalPosition, 1.0f)).xyz
+            : (originalPosition + velocity * u_DeltaTime + u_ExternalForces * u_DeltaTimeSq);
+
+        // Position before constraints of next particle.
+        vec3 preConstraintPosition = subgroupShuffleDown(position, 1);
+
+        // Apply FTL alternately on even and odd particles. Roots never move so never read across strands.
+        for (uint i = 0; i < u_FtlIterations; ++i)
+        {
+            vec3 previous = subgroupShuffleUp(position, 1);
+
+            if (!root && particle % 2 == 0)
+                position = previous + normalize(position - previous) * u_HairParticleSeparation;
+
+            previous = subgroupShuffleUp(position, 1);
+
+            if (!root && particle % 2 == 1)
+                position = previous + normalize(position - previous) * u_HairParticleSeparation;
+        }
+
+        // Find correction vector.
+        vec3 next = subgroupShuffleDown(position, 1);
+        vec3 correction = correct ? (next - preConstraintPosition) : vec3(0);
+
+        // Calculate base velocity and apply correction if required.
+        velocity = (position - originalPosition) * u_DeltaTimeInv + correction * u_DampingFactor;
+
+        // Write results back to global memory, keeping the positions from before the tick for interpolation.
+        if (valid)
+        {
+            uint offsetPrevious = gid + u_PreviousPositionsOffset;
+
+            ParticleStateBuffer[offsetPrevious + u_HairTotalParticles * 0] = originalPosition.x;
+            ParticleStateBuffer[offsetPrevious + u_HairTotalParticles * 1] = originalPosition.y;
+            ParticleStateBuffer[offsetPrevious + u_HairTotalParticles * 2] = originalPosition.z;
+
+            ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 0] = position.x;
+            ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 1] = position.y;
+            ParticleStateBuffer[offsetPosition + u_HairTotalParticles * 2] = position.z;
+
+            ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 0] = velocity.x;
+            ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 1] = velocity.y;
+            ParticleStateBuffer[offsetVelocity + u_HairTotalParticles * 2] = velocity.z;
+        }
+    }
+}
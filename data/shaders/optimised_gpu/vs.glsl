@@ -0,0 +1,131 @@
+#version 450
+
+layout (std430, set = 0, binding = VHS_PARTICLE_BUFFER_BINDING) readonly buffer ssbo
+{
+    float ParticleStateBuffer[];
+};
+
+#include "buffers.glslh"
+
+layout (push_constant) uniform PushConstants
+{
+    mat4 u_ModelViewProjection;
+    vec3 u_CameraFront;
+    float u_HairDrawRadius;
+    uint u_HairTotalParticles;
+    uint u_HairParticlesPerStrand;
+    uint u_HairStrandsPerTriangle;
+    uint u_HairSmoothFactor;
+    uint u_RootIndicesOffset;
+    uint u_RootIndicesWide;
+    uint u_BarycentricOffset;
+    uint u_PreviousPositionsOffset;
+    float u_Interpolation;
+};
+
+layout (location = 0) out vec3 vsOut_Colour;
+
+float rand(vec2 seed)
+{
+    return fract(sin(dot(seed, vec2(12.989, 78.233))) * 43758.5453);
+}
+
+vec3 randcol(uint id)
+{
+    vec3 col;
+
+    col.r = rand(vec2(id, id + 1000));
+    col.g = rand(vec2(id, id + 2000));
+    col.b = rand(vec2(id, id + 3000));
+
+    return col;
+}
+
+vec3 loadPosition(uint offset)
+{
+    vec3 position;
+
+    position.x = ParticleStateBuffer[offset + u_HairTotalParticles * 0];
+    position.y = ParticleStateBuffer[offset + u_HairTotalParticles * 1];
+    position.z = ParticleStateBuffer[offset + u_HairTotalParticles * 2];
+
+    return position;
+}
+
+// Particle of an interpolated strand, blended from the guides at the corners of its triangle and between the last two
+// ticks.
+vec3 strandParticle(uvec3 corners, vec3 b, uint particle)
+{
+    vec3 position = vec3(0);
+
+    for (uint i = 0; i < 3; ++i)
+    {
+        uint offset = corners[i] * u_HairParticlesPerStrand + particle;
+
+        vec3 current = loadPosition(offset);
+        vec3 previous = loadPosition(offset + u_PreviousPositionsOffset);
+
+        position += mix(previous, current, u_Interpolation) * b[i];
+    }
+
+    return position;
+}
+
+// Uniform Catmull-Rom segment from p1 to p2 and its derivative.
+vec3 catmullRom(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float t)
+{
+    return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t * t
+        + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t * t);
+}
+
+vec3 catmullRomTangent(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float t)
+{
+    return 0.5f * ((p2 - p0) + 2.0f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t
+        + 3.0f * (3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t);
+}
+
+// Vertex pulling version of create_vertices. The vertex index picks the point along the strand and which side of the
+// strip the vertex is on. Indexed draws also number the strands through the vertex index, instanced strands are one
+// instance each.
+void main()
+{
+    uint numPoints = u_HairParticlesPerStrand * u_HairSmoothFactor;
+
+    uint strand = gl_InstanceIndex + gl_VertexIndex / (2 * numPoints);
+    uint point = (gl_VertexIndex / 2) % numPoints;
+    bool side = (gl_VertexIndex & 1) != 0;
+
+    // Find the guides and barycentric coordinate for the strand.
+    uint triangle = strand / u_HairStrandsPerTriangle;
+    uint index = strand % u_HairStrandsPerTriangle;
+
+    uvec3 corners = uvec3(loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide, triangle * 3 + 0),
+        loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide, triangle * 3 + 1),
+        loadRootIndex(u_RootIndicesOffset, u_RootIndicesWide, triangle * 3 + 2));
+
+    vec3 b;
+
+    b.x = ParticleStateBuffer[u_BarycentricOffset + 3 * index + 0];
+    b.y = ParticleStateBuffer[u_BarycentricOffset + 3 * index + 1];
+    b.z = ParticleStateBuffer[u_BarycentricOffset + 3 * index + 2];
+
+    // Evaluate the spline through the strand's particles at this point, with the end points repeated.
+    float t = float(point) * float(u_HairParticlesPerStrand - 1) / float(numPoints - 1);
+    uint segment = min(uint(t), u_HairParticlesPerStrand - 2);
+
+    vec3 p0 = strandParticle(corners, b, max(segment, 1) - 1);
+    vec3 p1 = strandParticle(corners, b, segment);
+    vec3 p2 = strandParticle(corners, b, segment + 1);
+    vec3 p3 = strandParticle(corners, b, min(segment + 2, u_HairParticlesPerStrand - 1));
+
+    float u = t - float(segment);
+
+    vec3 p = catmullRom(p0, p1, p2, p3, u);
+    vec3 tangent = catmullRomTangent(p0, p1, p2, p3, u);
+
+    // Offset to either side perpendicular to the camera and hair direction.
+    vec3 perp = u_HairDrawRadius * normalize(cross(tangent, u_CameraFront));
+
+    gl_Position = u_ModelViewProjection * vec4(side ? (p + perp) : (p - perp), 1);
+    vsOut_Colour = randcol((strand * 2 * numPoints + gl_VertexIndex % (2 * numPoints)) / 8);
+}
@@ -16,8 +16,8 @@ namespace vhs
         context_ { &context },
         size_ { config.size }
     {
-        VHS_TRACE(BUFFER, "Creating '{}' with size {}, usage flags 0x{:x}, and memory flags 0x{:x}.", name, config.size,
-            config.usage_flags, config.memory_flags);
+        VHS_TRACE(BUFFER, "Creating '{}' with size {}, usage flags 0x{:x}, memory flags 0x{:x}, and persistent mapping {}.", name,
+            config.size, config.usage_flags, config.memory_flags, config.persistently_mapped);
 
         VkBufferCreateInfo buffer_info { };
 
@@ -26,12 +26,34 @@ namespace vhs
         buffer_info.usage = config.usage_flags;
         buffer_info.sharingMode = config.sharing_mode;
 
+        if (config.sharing_mode == VK_SHARING_MODE_CONCURRENT)
+        {
+            buffer_info.queueFamilyIndexCount = config.queue_families.size();
+            buffer_info.pQueueFamilyIndices = config.queue_families.data();
+        }
+
         VmaAllocationCreateInfo alloc_info { };
 
         alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
         alloc_info.flags = config.memory_flags;
 
-        VHS_CHECK_VK(vmaCreateBuffer(context.vma_allocator(), &buffer_info, &alloc_info, &buffer_, &alloc_, nullptr));
+        if (config.persistently_mapped)
+            alloc_info.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        VmaAllocationInfo info { };
+        VHS_CHECK_VK(vmaCreateBuffer(context.vma_allocator(), &buffer_info, &alloc_info, &buffer_, &alloc_, &info));
+
+        // VMA only maps host visible memory so check we actually got a pointer back.
+        if (config.persistently_mapped)
+        {
+            VHS_ASSERT(info.pMappedData, "Failed to persistently map '{}', is it host visible?", name);
+            mapped_ = info.pMappedData;
+        }
+
+        VkMemoryPropertyFlags memory_properties = 0;
+        vmaGetAllocationMemoryProperties(context.vma_allocator(), alloc_, &memory_properties);
+
+        coherent_ = memory_properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
     }
 
     Buffer::Buffer(Buffer&& other) :
@@ -39,10 +61,13 @@ namespace vhs
         context_ { std::move(other.context_) },
         buffer_ { std::move(other.buffer_) },
         alloc_ { std::move(other.alloc_) },
-        size_ { std::move(other.size_) }
+        size_ { std::move(other.size_) },
+        mapped_ { std::move(other.mapped_) },
+        coherent_ { std::move(other.coherent_) }
     {
         other.buffer_ = VK_NULL_HANDLE;
         other.alloc_ = VK_NULL_HANDLE;
+        other.mapped_ = nullptr;
     }
 
     Buffer::~Buffer()
@@ -62,30 +87,65 @@ namespace vhs
         buffer_ = std::move(other.buffer_);
         alloc_ = std::move(other.alloc_);
         size_ = std::move(other.size_);
+        mapped_ = std::move(other.mapped_);
+        coherent_ = std::move(other.coherent_);
 
         other.buffer_ = VK_NULL_HANDLE;
         other.alloc_ = VK_NULL_HANDLE;
+        other.mapped_ = nullptr;
 
         return *this;
     }
 
 
+    // Cache maintenance for non-coherent memory.
+    void Buffer::flush(VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (!coherent_)
+            VHS_CHECK_VK(vmaFlushAllocation(context_->vma_allocator(), alloc_, offset, size));
+    }
+
+    void Buffer::invalidate(VkDeviceSize offset, VkDeviceSize size) const
+    {
+        if (!coherent_)
+            VHS_CHECK_VK(vmaInvalidateAllocation(context_->vma_allocator(), alloc_, offset, size));
+    }
+
+
     // Read/write bytes.
     void Buffer::write_bytes(const void* data, size_t count, size_t offset)
     {
-        VHS_TRACE(BUFFER, "Writing {} bytes to '{}' at offset {}.", count, name_, offset);
+        VHS_TRACE_VERBOSE(BUFFER, "Writing {} bytes to '{}' at offset {}.", count, name_, offset);
+
+        if (mapped_)
+        {
+            std::memcpy(static_cast<std::byte*>(mapped_) + offset, data, count);
+            flush(offset, count);
+
+            return;
+        }
 
         void* wr_ptr = nullptr;
         VHS_CHECK_VK(vmaMapMemory(context_->vma_allocator(), alloc_, &wr_ptr));
 
         std::memcpy(static_cast<std::byte*>(wr_ptr) + offset, data, count);
 
+        flush(offset, count);
         vmaUnmapMemory(context_->vma_allocator(), alloc_);
     }
 
     void Buffer::read_bytes(void* data, size_t count, size_t offset) const
     {
-        VHS_TRACE(BUFFER, "Reading {} bytes from '{}' at offset {}.", count, name_, offset);
+        VHS_TRACE_VERBOSE(BUFFER, "Reading {} bytes from '{}' at offset {}.", count, name_, offset);
+
+        // Make sure any device writes are visible before reading.
+        invalidate(offset, count);
+
+        if (mapped_)
+        {
+            std::memcpy(data, static_cast<const std::byte*>(mapped_) + offset, count);
+            return;
+        }
 
         void* rd_ptr = nullptr;
         VHS_CHECK_VK(vmaMapMemory(context_->vma_allocator(), alloc_, &rd_ptr));
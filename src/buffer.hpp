@@ -1,8 +1,11 @@
 #ifndef VHS_BUFFER_HPP
 #define VHS_BUFFER_HPP
 
+#include <cstddef>
+
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
@@ -15,7 +18,39 @@ namespace vhs
         VkDeviceSize size;
         VkBufferUsageFlags usage_flags;
         VkSharingMode sharing_mode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // Families allowed to access a concurrent buffer, ignored for exclusive ones.
+        std::vector<uint32_t> queue_families;
+
         VmaAllocationCreateFlags memory_flags = 0;
+
+        // Keep host visible memory mapped for the lifetime of the buffer.
+        bool persistently_mapped = false;
+    };
+
+    // Non-owning view of the mapped memory of a buffer.
+    template <class T>
+    class MappedSpan
+    {
+    public:
+        MappedSpan(T* data, size_t size) :
+            data_ { data },
+            size_ { size }
+        { }
+
+
+        T& operator[](size_t i) const { return data_[i]; }
+
+        T* data() const { return data_; }
+        size_t size() const { return size_; }
+        size_t size_bytes() const { return size_ * sizeof(T); }
+
+        T* begin() const { return data_; }
+        T* end() const { return data_ + size_; }
+
+    private:
+        T* data_;
+        size_t size_;
     };
 
     class GraphicsContext;
@@ -41,9 +76,31 @@ namespace vhs
         const std::string& name() const { return name_; }
         VkDeviceSize size() const { return size_; }
 
+        bool is_mapped() const { return mapped_ != nullptr; }
+        bool is_coherent() const { return coherent_; }
+
+
+        // Direct access to persistently mapped memory. Writes must be followed by a flush and reads of device
+        // writes preceded by an invalidate, both of which are no-ops for coherent memory.
+        template <class T>
+        MappedSpan<T> mapped()
+        {
+            return { static_cast<T*>(mapped_), size_ / sizeof(T) };
+        }
+
+        template <class T>
+        MappedSpan<const T> mapped() const
+        {
+            return { static_cast<const T*>(mapped_), size_ / sizeof(T) };
+        }
+
+        // Offset and size are in bytes.
+        void flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+        void invalidate(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) const;
+
 
         // Read/write data. Count and offset are given in terms of T. Offset is for the device buffer,
-        // not the host buffer.
+        // not the host buffer. Mapped buffers copy directly and flush or invalidate the range as required.
         template <class T>
         void write(const T* data, size_t count, size_t offset = 0)
         {
@@ -66,6 +123,8 @@ namespace vhs
         VkBuffer buffer_ = VK_NULL_HANDLE;
         VmaAllocation alloc_ = VK_NULL_HANDLE;
         VkDeviceSize size_ = 0;
+        void* mapped_ = nullptr;
+        bool coherent_ = false;
     };
 }
 
@@ -2,6 +2,7 @@
 #include "buffer.hpp"
 #include "command_buffer.hpp"
 #include "framebuffer.hpp"
+#include "image.hpp"
 #include "pipeline.hpp"
 #include "render_pass.hpp"
 
@@ -96,6 +97,34 @@ namespace vhs
     }
 
 
+    void CommandBuffer::draw_indirect(const Buffer& buffer, VkDeviceSize offset, uint32_t num_draws, uint32_t stride)
+    {
+        vkCmdDrawIndirect(buffer_, buffer.vk_buffer(), offset, num_draws, stride);
+    }
+
+    void CommandBuffer::draw_indirect_count(const Buffer& buffer, VkDeviceSize offset, const Buffer& count_buffer,
+        VkDeviceSize count_offset, uint32_t max_draws, uint32_t stride)
+    {
+        vkCmdDrawIndirectCount(buffer_, buffer.vk_buffer(), offset, count_buffer.vk_buffer(), count_offset, max_draws, stride);
+    }
+
+    void CommandBuffer::draw_indexed_indirect(const Buffer& buffer, VkDeviceSize offset, uint32_t num_draws, uint32_t stride)
+    {
+        vkCmdDrawIndexedIndirect(buffer_, buffer.vk_buffer(), offset, num_draws, stride);
+    }
+
+    void CommandBuffer::draw_indexed_indirect_count(const Buffer& buffer, VkDeviceSize offset, const Buffer& count_buffer,
+        VkDeviceSize count_offset, uint32_t max_draws, uint32_t stride)
+    {
+        vkCmdDrawIndexedIndirectCount(buffer_, buffer.vk_buffer(), offset, count_buffer.vk_buffer(), count_offset, max_draws, stride);
+    }
+
+    void CommandBuffer::dispatch_indirect(const Buffer& buffer, VkDeviceSize offset)
+    {
+        vkCmdDispatchIndirect(buffer_, buffer.vk_buffer(), offset);
+    }
+
+
     void CommandBuffer::copy_buffer(Buffer& dst, Buffer& src, VkDeviceSize size, VkDeviceSize src_offset, VkDeviceSize dst_offset)
     {
         // If size is zero then default to source size.
@@ -112,6 +141,31 @@ namespace vhs
         vkCmdCopyBuffer(buffer_, src.vk_buffer(), dst.vk_buffer(), 1, &copy);
     }
 
+    void CommandBuffer::fill_buffer(Buffer& dst, uint32_t value, VkDeviceSize size, VkDeviceSize offset)
+    {
+        vkCmdFillBuffer(buffer_, dst.vk_buffer(), offset, size, value);
+    }
+
+    void CommandBuffer::update_buffer(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize offset)
+    {
+        // Only for small amounts of data, the contents are stored in the command buffer itself.
+        VHS_ASSERT(size <= 65536 && size % 4 == 0, "Inline buffer updates must be a multiple of four bytes up to 64KiB, not {}.", size);
+        vkCmdUpdateBuffer(buffer_, dst.vk_buffer(), offset, size, data);
+    }
+
+    void CommandBuffer::copy_image_to_buffer(Buffer& dst, const Image& src, VkImageLayout layout, VkImageAspectFlags aspect,
+        VkExtent3D extent, VkDeviceSize dst_offset)
+    {
+        VkBufferImageCopy copy { };
+
+        copy.bufferOffset = dst_offset;
+        copy.imageSubresource.aspectMask = aspect;
+        copy.imageSubresource.layerCount = 1;
+        copy.imageExtent = extent;
+
+        vkCmdCopyImageToBuffer(buffer_, src.vk_image(), layout, dst.vk_buffer(), 1, &copy);
+    }
+
 
     void CommandBuffer::barrier(const PipelineBarrier& barrier)
     {
@@ -120,19 +174,31 @@ namespace vhs
     }
 
 
+    void CommandBuffer::write_timestamp(VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query)
+    {
+        vkCmdWriteTimestamp(buffer_, stage, pool, query);
+    }
+
+
     // Barrier utility functions.
     PipelineBarrier::PipelineBarrier(VkPipelineStageFlags src_mask, VkPipelineStageFlags dst_mask) :
         src_mask_ { src_mask },
         dst_mask_ { dst_mask }
     { }
 
-    void PipelineBarrier::add_buffer(VkAccessFlags src, VkAccessFlags dst, const Buffer& buffer)
+    void PipelineBarrier::add_buffer(VkAccessFlags src, VkAccessFlags dst, const Buffer& buffer, uint32_t src_family, uint32_t dst_family)
     {
         VkBufferMemoryBarrier info { };
 
+        // Matching families are not a transfer so leave them ignored.
+        if (src_family == dst_family)
+            src_family = dst_family = VK_QUEUE_FAMILY_IGNORED;
+
         info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
         info.srcAccessMask = src;
         info.dstAccessMask = dst;
+        info.srcQueueFamilyIndex = src_family;
+        info.dstQueueFamilyIndex = dst_family;
         info.buffer = buffer.vk_buffer();
         info.size = buffer.size();
 
@@ -11,6 +11,7 @@ namespace vhs
     class Buffer;
     class CommandBuffer;
     class Framebuffer;
+    class Image;
     class Pipeline;
     class RenderPass;
 
@@ -32,7 +33,13 @@ namespace vhs
         PipelineBarrier& operator=(PipelineBarrier&&) = default;
 
 
-        void add_buffer(VkAccessFlags src, VkAccessFlags dst, const Buffer& buffer);
+        // Queue families are only needed for ownership transfers. The same barrier must be recorded on the releasing
+        // queue and again on the acquiring queue.
+        void add_buffer(VkAccessFlags src, VkAccessFlags dst, const Buffer& buffer, uint32_t src_family = VK_QUEUE_FAMILY_IGNORED,
+            uint32_t dst_family = VK_QUEUE_FAMILY_IGNORED);
+
+        // Widen the stages waiting on the barrier.
+        void add_dst_stage(VkPipelineStageFlags stage) { dst_mask_ |= stage; }
 
     private:
         std::vector<VkBufferMemoryBarrier> buffers_;
@@ -70,12 +77,29 @@ namespace vhs
         void draw_indexed(uint32_t num_indices, uint32_t num_instances = 1);
         void dispatch(uint32_t num_groups_x, uint32_t num_groups_y = 1, uint32_t num_groups_z = 1);
 
+        // Draw and dispatch with arguments written to a buffer by the device.
+        void draw_indirect(const Buffer& buffer, VkDeviceSize offset, uint32_t num_draws, uint32_t stride);
+        void draw_indirect_count(const Buffer& buffer, VkDeviceSize offset, const Buffer& count_buffer, VkDeviceSize count_offset,
+            uint32_t max_draws, uint32_t stride);
+        void draw_indexed_indirect(const Buffer& buffer, VkDeviceSize offset, uint32_t num_draws, uint32_t stride);
+        void draw_indexed_indirect_count(const Buffer& buffer, VkDeviceSize offset, const Buffer& count_buffer,
+            VkDeviceSize count_offset, uint32_t max_draws, uint32_t stride);
+        void dispatch_indirect(const Buffer& buffer, VkDeviceSize offset = 0);
+
         void push_constants(const Pipeline& pipeline, VkShaderStageFlags stage_flags, const void* data, uint32_t size, uint32_t offset = 0);
 
         void copy_buffer(Buffer& dst, Buffer& src, VkDeviceSize size = 0, VkDeviceSize src_offset = 0, VkDeviceSize dst_offset = 0);
+        void fill_buffer(Buffer& dst, uint32_t value, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+        void update_buffer(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+
+        // Copy a single aspect of the first mip level of a 2D image, tightly packed.
+        void copy_image_to_buffer(Buffer& dst, const Image& src, VkImageLayout layout, VkImageAspectFlags aspect, VkExtent3D extent,
+            VkDeviceSize dst_offset = 0);
 
         void barrier(const PipelineBarrier& barrier);
 
+        void write_timestamp(VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query);
+
         // Finish recording and return the buffer for submission.
         VkCommandBuffer end();
 
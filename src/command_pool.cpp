@@ -57,7 +57,7 @@ namespace vhs
     // Buffer management functions.
     void CommandPool::allocate(VkCommandBuffer* buffers, size_t num_buffers)
     {
-        VHS_TRACE(COMMAND_POOL, "Allocating {} command buffers in '{}'.", num_buffers, name_);
+        VHS_TRACE_VERBOSE(COMMAND_POOL, "Allocating {} command buffers in '{}'.", num_buffers, name_);
 
         VkCommandBufferAllocateInfo alloc_info { };
 
@@ -71,13 +71,13 @@ namespace vhs
 
     void CommandPool::free(const VkCommandBuffer* buffers, size_t num_buffers)
     {
-        VHS_TRACE(COMMAND_POOL, "Freeing {} command buffers from '{}'.", num_buffers, name_);
+        VHS_TRACE_VERBOSE(COMMAND_POOL, "Freeing {} command buffers from '{}'.", num_buffers, name_);
         vkFreeCommandBuffers(context_->vk_device(), pool_, num_buffers, buffers);
     }
 
     void CommandPool::reset()
     {
-        VHS_TRACE(COMMAND_POOL, "Resetting all buffers in '{}'.", name_);
+        VHS_TRACE_VERBOSE(COMMAND_POOL, "Resetting all buffers in '{}'.", name_);
         VHS_CHECK_VK(vkResetCommandPool(context_->vk_device(), pool_, 0));
     }
 }
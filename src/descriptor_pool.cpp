@@ -64,7 +64,8 @@ namespace vhs
 
     VkDescriptorSet DescriptorPool::allocate(const DescriptorSetLayout& layout, const DescriptorSetConfig& config)
     {
-        VHS_TRACE(DESCRIPTOR_POOL, "Allocating set using layout '{}' in '{}'.", layout.name(), name_);
+        VHS_TRACE_SCOPE(DESCRIPTOR_POOL, "AllocateDescriptorSet");
+        VHS_TRACE_VERBOSE(DESCRIPTOR_POOL, "Allocating set using layout '{}' in '{}'.", layout.name(), name_);
 
         // First allocate the new descriptor set.
         VkDescriptorSet set = VK_NULL_HANDLE;
@@ -38,6 +38,8 @@ namespace vhs
         create_info.pBindings = bindings.data();
 
         VHS_CHECK_VK(vkCreateDescriptorSetLayout(context.vk_device(), &create_info, nullptr, &layout_));
+
+        context.register_descriptor_set_layout(layout_, config);
     }
 
     DescriptorSetLayout::DescriptorSetLayout(DescriptorSetLayout&& other) :
@@ -53,6 +55,7 @@ namespace vhs
         if (layout_)
         {
             VHS_TRACE(DESCRIPTOR_SET_LAYOUT, "Destroying '{}'.", name_);
+            context_->unregister_descriptor_set_layout(layout_);
             vkDestroyDescriptorSetLayout(context_->vk_device(), layout_, nullptr);
         }
     }
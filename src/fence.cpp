@@ -55,13 +55,13 @@ namespace vhs
 
     void Fence::wait(uint64_t timeout)
     {
-        VHS_TRACE(FENCE, "Waiting on '{}'.", name_);
+        VHS_TRACE_VERBOSE(FENCE, "Waiting on '{}'.", name_);
         VHS_CHECK_VK(vkWaitForFences(context_->vk_device(), 1, &fence_, VK_TRUE, timeout));
     }
 
     void Fence::reset()
     {
-        VHS_TRACE(FENCE, "Resetting '{}'.", name_);
+        VHS_TRACE_VERBOSE(FENCE, "Resetting '{}'.", name_);
         VHS_CHECK_VK(vkResetFences(context_->vk_device(), 1, &fence_));
     }
 }
@@ -0,0 +1,190 @@
+#include <algorithm>
+
+#include "assert.hpp"
+#include "command_buffer.hpp"
+#include "gpu_profiler.hpp"
+#include "graphics_context.hpp"
+#include "trace.hpp"
+
+
+VHS_TRACE_DEFINE(GPU_PROFILER);
+
+
+namespace vhs
+{
+    GpuProfiler::GpuProfiler(GraphicsContext& context, const GpuProfilerConfig& config) :
+        context_ { &context },
+        max_regions_per_frame_ { config.max_regions_per_frame },
+        timestamp_mask_ { config.timestamp_valid_bits >= 64 ? ~0ull : (1ull << config.timestamp_valid_bits) - 1 },
+        timestamp_period_ms_ { config.timestamp_period * 1e-6 },
+        frames_(config.num_frames)
+    {
+        VHS_TRACE(GPU_PROFILER, "Creating profiler with {} frames of {} regions, timestamp period {} ns.", config.num_frames,
+            config.max_regions_per_frame, config.timestamp_period);
+
+        VkQueryPoolCreateInfo create_info { };
+
+        create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        create_info.queryCount = 2 * max_regions_per_frame_;
+
+        for (auto& frame : frames_)
+        {
+            VHS_CHECK_VK(vkCreateQueryPool(context.vk_device(), &create_info, nullptr, &frame.pool));
+            vkResetQueryPool(context.vk_device(), frame.pool, 0, create_info.queryCount);
+
+            frame.region_ids.reserve(max_regions_per_frame_);
+        }
+
+        // The first frame is recording from the start.
+        frames_[current_frame_].number = frame_number_++;
+
+        if (!config.csv_path.empty())
+        {
+            VHS_TRACE(GPU_PROFILER, "Writing GPU timings to '{}'.", config.csv_path);
+
+            csv_.open(config.csv_path, std::ios::trunc);
+            VHS_ASSERT(csv_, "Failed to open '{}' for writing.", config.csv_path);
+
+            csv_ << "frame,region,time_ms,average_ms\n";
+        }
+    }
+
+    GpuProfiler::~GpuProfiler()
+    {
+        VHS_TRACE(GPU_PROFILER, "Destroying profiler.");
+
+        for (auto& frame : frames_)
+            vkDestroyQueryPool(context_->vk_device(), frame.pool, nullptr);
+    }
+
+
+    void GpuProfiler::next_frame()
+    {
+        current_frame_ = (current_frame_ + 1) % frames_.size();
+
+        auto& frame = frames_[current_frame_];
+
+        if (!frame.region_ids.empty())
+            read_back(frame);
+
+        frame.number = frame_number_++;
+    }
+
+    void GpuProfiler::flush()
+    {
+        // Oldest first so samples are still delivered in frame order.
+        for (uint32_t i = 1; i <= frames_.size(); ++i)
+        {
+            auto& frame = frames_[(current_frame_ + i) % frames_.size()];
+
+            if (!frame.region_ids.empty())
+                read_back(frame);
+        }
+    }
+
+
+    uint32_t GpuProfiler::begin_region(CommandBuffer& cmd, std::string_view name, VkPipelineStageFlagBits stage)
+    {
+        auto& frame = frames_[current_frame_];
+
+        if (frame.region_ids.size() == max_regions_per_frame_)
+        {
+            VHS_TRACE(GPU_PROFILER, "Out of queries for region '{}' in frame {}.", name, frame.number);
+            return NO_REGION;
+        }
+
+        const uint32_t region = frame.region_ids.size();
+
+        frame.region_ids.push_back(find_region(name));
+        cmd.write_timestamp(stage, frame.pool, 2 * region);
+
+        return region;
+    }
+
+    void GpuProfiler::end_region(CommandBuffer& cmd, uint32_t region, VkPipelineStageFlagBits stage)
+    {
+        if (region == NO_REGION)
+            return;
+
+        cmd.write_timestamp(stage, frames_[current_frame_].pool, 2 * region + 1);
+    }
+
+
+    void GpuProfiler::read_back(Frame& frame)
+    {
+        const uint32_t num_queries = 2 * frame.region_ids.size();
+
+        // The frame has been around the whole ring so the wait should never block in practice, it just guards against
+        // compute work that was queued further ahead than the frames.
+        std::vector<uint64_t> timestamps(num_queries);
+
+        VHS_CHECK_VK(vkGetQueryPoolResults(context_->vk_device(), frame.pool, 0, num_queries, sizeof(uint64_t) * num_queries,
+            timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+        vkResetQueryPool(context_->vk_device(), frame.pool, 0, num_queries);
+
+        // Sum the time for each named region.
+        std::vector<double> totals(regions_.size(), 0.0);
+        std::vector<bool> seen(regions_.size(), false);
+
+        for (uint32_t i = 0; i < frame.region_ids.size(); ++i)
+        {
+            const auto ticks = (timestamps[2 * i + 1] - timestamps[2 * i]) & timestamp_mask_;
+            const auto id = frame.region_ids[i];
+
+            totals[id] += ticks * timestamp_period_ms_;
+            seen[id] = true;
+        }
+
+        frame.region_ids.clear();
+
+        // Update the averages and write out the results.
+        for (uint32_t id = 0; id < regions_.size(); ++id)
+        {
+            if (!seen[id])
+                continue;
+
+            auto& region = regions_[id];
+            auto& history = histories_[id];
+
+            if (history.count == AVERAGE_FRAMES)
+                history.sum -= history.samples[history.next];
+            else
+                history.count++;
+
+            history.samples[history.next] = totals[id];
+            history.sum += totals[id];
+            history.next = (history.next + 1) % AVERAGE_FRAMES;
+
+            region.last_ms = totals[id];
+            region.average_ms = history.sum / history.count;
+
+            VHS_TRACE_COUNTER(GPU_PROFILER, history.trace_name, region.last_ms);
+
+            if (sample_callback_)
+                sample_callback_(frame.number, region);
+
+            if (csv_.is_open())
+                csv_ << frame.number << ',' << region.name << ',' << region.last_ms << ',' << region.average_ms << '\n';
+        }
+    }
+
+    uint32_t GpuProfiler::find_region(std::string_view name)
+    {
+        const auto it = std::find_if(std::begin(regions_), std::end(regions_), [=](const GpuProfileRegion& region)
+        {
+            return region.name == name;
+        });
+
+        if (it != std::end(regions_))
+            return it - std::begin(regions_);
+
+        VHS_TRACE(GPU_PROFILER, "Adding region '{}'.", name);
+
+        regions_.push_back({ std::string { name } });
+        histories_.emplace_back().trace_name = trace_intern(name);
+
+        return regions_.size() - 1;
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef VHS_GPU_PROFILER_HPP
+#define VHS_GPU_PROFILER_HPP
+
+#include <cstdint>
+
+#include <array>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+
+namespace vhs
+{
+    class CommandBuffer;
+    class GraphicsContext;
+
+    struct GpuProfilerConfig
+    {
+        // Number of frames of queries in the ring. Results are read back when a frame's pool is reused so this must be
+        // more than the number of frames in flight.
+        uint32_t num_frames;
+        uint32_t max_regions_per_frame = 64;
+
+        // Timestamp properties of the device.
+        uint32_t timestamp_valid_bits;
+        float timestamp_period;
+
+        // File to write per-frame results to, replaced on each run. Empty to disable.
+        std::string csv_path;
+    };
+
+    // Timings for a named region. Regions recorded more than once in a frame are summed.
+    struct GpuProfileRegion
+    {
+        std::string name;
+        double last_ms = 0;
+        double average_ms = 0;
+    };
+
+    // Timestamp query profiler. Each frame in the ring has its own query pool which is read back and reset from the host
+    // once the ring wraps around, so reading results never stalls on work that was just submitted.
+    class GpuProfiler
+    {
+    public:
+        // Number of frames in the rolling averages.
+        static constexpr uint32_t AVERAGE_FRAMES = 64;
+
+        // Returned when a frame has run out of queries.
+        static constexpr uint32_t NO_REGION = ~0u;
+
+        // Called with each region's total for a frame as it's read back.
+        using SampleCallback = std::function<void(uint64_t frame, const GpuProfileRegion& region)>;
+
+        GpuProfiler(const GpuProfiler&) = delete;
+        GpuProfiler(GpuProfiler&&) = delete;
+
+        GpuProfiler(GraphicsContext& context, const GpuProfilerConfig& config);
+        ~GpuProfiler();
+
+
+        GpuProfiler& operator=(const GpuProfiler&) = delete;
+        GpuProfiler& operator=(GpuProfiler&&) = delete;
+
+
+        // Move to the next frame in the ring, reading back the results it held first.
+        void next_frame();
+
+        // Read back every frame still in the ring. The device must be idle.
+        void flush();
+
+        // Record the timestamps either side of a region.
+        uint32_t begin_region(CommandBuffer& cmd, std::string_view name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        void end_region(CommandBuffer& cmd, uint32_t region, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+        const std::vector<GpuProfileRegion>& regions() const { return regions_; }
+
+        // Number of the frame currently being recorded.
+        uint64_t frame_number() const { return frames_[current_frame_].number; }
+
+        void set_sample_callback(SampleCallback callback) { sample_callback_ = std::move(callback); }
+
+    private:
+        struct Frame
+        {
+            VkQueryPool pool = VK_NULL_HANDLE;
+            uint64_t number = 0;
+
+            // Index into regions_ for each pair of queries.
+            std::vector<uint32_t> region_ids;
+        };
+
+        struct History
+        {
+            std::array<double, AVERAGE_FRAMES> samples { };
+            uint32_t next = 0;
+            uint32_t count = 0;
+            double sum = 0;
+
+            // Stable copy of the region name for the Chrome trace counter.
+            const char* trace_name = nullptr;
+        };
+
+        void read_back(Frame& frame);
+        uint32_t find_region(std::string_view name);
+
+        GraphicsContext* context_;
+
+        uint32_t max_regions_per_frame_;
+        uint64_t timestamp_mask_;
+        double timestamp_period_ms_;
+
+        std::vector<Frame> frames_;
+        uint32_t current_frame_ = 0;
+        uint64_t frame_number_ = 0;
+
+        std::vector<GpuProfileRegion> regions_;
+        std::vector<History> histories_;
+
+        std::ofstream csv_;
+        SampleCallback sample_callback_;
+    };
+
+    // Profile a region for the lifetime of the scope. Does nothing if there's no profiler.
+    class GpuProfileScope
+    {
+    public:
+        GpuProfileScope() = delete;
+        GpuProfileScope(const GpuProfileScope&) = delete;
+        GpuProfileScope(GpuProfileScope&&) = delete;
+
+        GpuProfileScope(CommandBuffer& cmd, GpuProfiler* profiler, std::string_view name) :
+            cmd_ { cmd },
+            profiler_ { profiler },
+            region_ { profiler ? profiler->begin_region(cmd, name) : GpuProfiler::NO_REGION }
+        { }
+
+        ~GpuProfileScope()
+        {
+            if (profiler_)
+                profiler_->end_region(cmd_, region_);
+        }
+
+
+        GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+        GpuProfileScope& operator=(GpuProfileScope&&) = delete;
+
+    private:
+        CommandBuffer& cmd_;
+        GpuProfiler* profiler_;
+        uint32_t region_;
+    };
+}
+
+#endif
@@ -10,9 +10,12 @@
 
 #include "command_buffer.hpp"
 #include "command_pool.hpp"
+#include "descriptor_set_layout.hpp"
 #include "fence.hpp"
 #include "framebuffer.hpp"
+#include "gpu_profiler.hpp"
 #include "graphics_context.hpp"
+#include "image.hpp"
 #include "image_view.hpp"
 #include "pipeline.hpp"
 #include "render_pass.hpp"
@@ -81,19 +84,37 @@ namespace vhs
 
 
     // Context constructor and destructor.
-    GraphicsContext::GraphicsContext()
+    GraphicsContext::GraphicsContext(const GraphicsContextConfig& config) :
+        async_compute_requested_ { config.async_compute },
+        sync_mode_ { config.sync_mode },
+        gpu_profiling_ { config.gpu_profiling },
+        headless_ { config.headless },
+        staging_ring_size_ { config.staging_ring_size }
     {
-        VHS_TRACE(GRAPHICS_CONTEXT, "Creating graphics context.");
+        VHS_TRACE(GRAPHICS_CONTEXT, "Creating {} graphics context.", headless_ ? "headless" : "windowed");
 
-        glfwSetErrorCallback(glfw_error_callback);
-        glfwInit();
+        if (!headless_)
+        {
+            glfwSetErrorCallback(glfw_error_callback);
+            glfwInit();
+        }
 
         create_instance();
-        create_window();
+
+        if (!headless_)
+            create_window();
+
         select_physical_device();
+        select_compute_local_size(config.compute_local_size);
         create_device();
         create_allocator();
-        create_swapchain();
+        create_pipeline_cache(config.pipeline_cache_directory);
+
+        if (headless_)
+            create_offscreen_images();
+        else
+            create_swapchain();
+
         create_immediate_command_pool();
         create_frames();
     }
@@ -106,13 +127,16 @@ namespace vhs
 
         destroy_frames();
         destroy_immediate_command_pool();
+        destroy_pipeline_variants();
+        destroy_pipeline_cache();
         destroy_swapchain();
         destroy_allocator();
         destroy_device();
         destroy_window();
         destroy_instance();
 
-        glfwTerminate();
+        if (!headless_)
+            glfwTerminate();
     }
 
 
@@ -121,10 +145,14 @@ namespace vhs
     {
         std::vector<const char*> extensions(INSTANCE_EXTENSIONS, INSTANCE_EXTENSIONS + std::size(INSTANCE_EXTENSIONS));
 
-        uint32_t num_glfw_extensions = 0;
-        const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&num_glfw_extensions);
+        // Surface extensions are only needed when presenting to a window.
+        if (!headless_)
+        {
+            uint32_t num_glfw_extensions = 0;
+            const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&num_glfw_extensions);
 
-        extensions.insert(std::end(extensions), glfw_extensions, glfw_extensions + num_glfw_extensions);
+            extensions.insert(std::end(extensions), glfw_extensions, glfw_extensions + num_glfw_extensions);
+        }
 
         check_validation_layers();
         check_instance_extensions(extensions);
@@ -138,7 +166,7 @@ namespace vhs
         app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         app_info.pEngineName = "vk-hair";
         app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion = VK_API_VERSION_1_1;
+        app_info.apiVersion = VK_API_VERSION_1_2;
 
         VkDebugUtilsMessengerCreateInfoEXT debug_create_info { };
 
@@ -252,7 +280,7 @@ namespace vhs
             // Check all the features we need are supported.
             if (!check_device_extensions(device))
                 continue;
-            if (!check_swapchain_support(device))
+            if (!headless_ && !check_swapchain_support(device))
                 continue;
             if (!physical_device_features_.largePoints)
                 continue;
@@ -264,7 +292,7 @@ namespace vhs
             std::vector<VkQueueFamilyProperties> queue_families(num_queue_families);
             vkGetPhysicalDeviceQueueFamilyProperties(device, &num_queue_families, queue_families.data());
 
-            std::optional<uint32_t> graphics_queue_family, present_queue_family;
+            std::optional<uint32_t> graphics_queue_family, present_queue_family, compute_queue_family;
 
             for (uint32_t i = 0; i < num_queue_families; ++i)
             {
@@ -272,10 +300,22 @@ namespace vhs
 
                 // The Vulkan spec. guarantees that there's at least one queue with both graphics and compute support
                 // so grab that to keep command recording simpler.
-                if (!graphics_queue_family && (queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+                const VkQueueFlags graphics_compute = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+
+                if (!graphics_queue_family && (queue_family.queueFlags & graphics_compute) == graphics_compute)
                     graphics_queue_family = i;
 
-                if (!present_queue_family)
+                // A family with compute but no graphics support usually maps to separate hardware queues, so work
+                // submitted there can overlap with rendering.
+                if (!compute_queue_family && (queue_family.queueFlags & graphics_compute) == VK_QUEUE_COMPUTE_BIT)
+                    compute_queue_family = i;
+
+                // Nothing is presented when headless so the present queue is just the graphics queue.
+                if (headless_)
+                {
+                    present_queue_family = graphics_queue_family;
+                }
+                else if (!present_queue_family)
                 {
                     VkBool32 present_support = VK_FALSE;
                     VHS_CHECK_VK(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support));
@@ -290,8 +330,13 @@ namespace vhs
 
             graphics_queue_family_ = *graphics_queue_family;
             present_queue_family_ = *present_queue_family;
+            compute_queue_family_ = (async_compute_requested_ && compute_queue_family) ? *compute_queue_family : *graphics_queue_family;
             physical_device_ = device;
 
+            // Timestamps are only usable if both queues that record them support them.
+            timestamp_valid_bits_ = std::min(queue_families.at(graphics_queue_family_).timestampValidBits,
+                queue_families.at(compute_queue_family_).timestampValidBits);
+
             device_found = true;
             break;
         }
@@ -300,17 +345,82 @@ namespace vhs
         VHS_TRACE(GRAPHICS_CONTEXT, "Selected device: {}.", physical_device_properties_.deviceName);
         VHS_TRACE(GRAPHICS_CONTEXT, "Graphics queue family found at index {}.", graphics_queue_family_);
         VHS_TRACE(GRAPHICS_CONTEXT, "Present queue family found at index {}.", present_queue_family_);
-        VHS_TRACE(GRAPHICS_CONTEXT, "Prensent mode is {}.", (present_mode_ == VK_PRESENT_MODE_MAILBOX_KHR) ?
-            "VK_PRESENT_MODE_MAILBOX_KHR" : "VK_PRESENT_MODE_FIFO_KHR");
+        VHS_TRACE(GRAPHICS_CONTEXT, "Compute queue family found at index {}.", compute_queue_family_);
+
+        const auto features12 = query_vulkan12_features(physical_device_);
+
+        if (sync_mode_ == SyncMode::TIMELINE && !features12.timelineSemaphore)
+        {
+            VHS_TRACE(GRAPHICS_CONTEXT, "Timeline semaphores not supported, falling back to fences.");
+            sync_mode_ = SyncMode::FENCES;
+        }
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Using {} for synchronisation.", (sync_mode_ == SyncMode::TIMELINE) ? "timeline semaphores" : "fences");
+
+        // The profiler resets its query pools from the host once the results have been read.
+        if (gpu_profiling_ && (!features12.hostQueryReset || !timestamp_valid_bits_))
+        {
+            VHS_TRACE(GRAPHICS_CONTEXT, "GPU timestamps or host query reset not supported, disabling GPU profiling.");
+            gpu_profiling_ = false;
+        }
+
+        draw_indirect_count_ = features12.drawIndirectCount;
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Multi draw indirect {}, draw indirect count {}, draw indirect first instance {}.",
+            physical_device_features_.multiDrawIndirect ? "supported" : "not supported",
+            draw_indirect_count_ ? "supported" : "not supported",
+            physical_device_features_.drawIndirectFirstInstance ? "supported" : "not supported");
+
+        // Subgroup properties are core from 1.1, older devices report no subgroup support.
+        subgroup_properties_.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
+        if (physical_device_properties_.apiVersion >= VK_API_VERSION_1_1)
+        {
+            VkPhysicalDeviceProperties2 properties { };
+
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties.pNext = &subgroup_properties_;
+
+            // The reported subgroup size is only a default, devices may dispatch compute with any size in the range
+            // given by the size control properties. Without them the smallest size is unknown and left at zero.
+            VkPhysicalDeviceSubgroupSizeControlPropertiesEXT size_control { };
+
+            size_control.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES_EXT;
+
+            const bool has_size_control = physical_device_properties_.apiVersion >= VK_API_VERSION_1_3
+                || supports_device_extension(physical_device_, VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME);
+
+            if (has_size_control)
+                subgroup_properties_.pNext = &size_control;
+
+            vkGetPhysicalDeviceProperties2(physical_device_, &properties);
+
+            subgroup_properties_.pNext = nullptr;
+
+            if (has_size_control)
+                min_subgroup_size_ = size_control.minSubgroupSize;
+        }
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Subgroup size is {} (minimum {}) with stages 0x{:x} and operations 0x{:x}.",
+            subgroup_properties_.subgroupSize, min_subgroup_size_, subgroup_properties_.supportedStages,
+            subgroup_properties_.supportedOperations);
+
+        if (!headless_)
+        {
+            VHS_TRACE(GRAPHICS_CONTEXT, "Prensent mode is {}.", (present_mode_ == VK_PRESENT_MODE_MAILBOX_KHR) ?
+                "VK_PRESENT_MODE_MAILBOX_KHR" : "VK_PRESENT_MODE_FIFO_KHR");
+        }
     }
 
 
     void GraphicsContext::create_device()
     {
-        VHS_TRACE(GRAPHICS_CONTEXT, "Creating VkDevice with extensions: {}.", fmt::join(DEVICE_EXTENSIONS, ", "));
+        const auto extensions = device_extensions();
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Creating VkDevice with extensions: {}.", fmt::join(extensions, ", "));
 
         const float queue_priority = 1.0f;
-        const std::unordered_set<uint32_t> queue_families { graphics_queue_family_, present_queue_family_ };
+        const std::unordered_set<uint32_t> queue_families { graphics_queue_family_, present_queue_family_, compute_queue_family_ };
 
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 
@@ -329,6 +439,8 @@ namespace vhs
         VkPhysicalDeviceFeatures features { };
 
         features.largePoints = true;
+        features.multiDrawIndirect = physical_device_features_.multiDrawIndirect;
+        features.drawIndirectFirstInstance = physical_device_features_.drawIndirectFirstInstance;
 
         VkDeviceCreateInfo create_info { };
 
@@ -338,8 +450,19 @@ namespace vhs
         create_info.pEnabledFeatures = &features;
         create_info.enabledLayerCount = std::size(VALIDATION_LAYERS);
         create_info.ppEnabledLayerNames = VALIDATION_LAYERS;
-        create_info.enabledExtensionCount = std::size(DEVICE_EXTENSIONS);
-        create_info.ppEnabledExtensionNames = DEVICE_EXTENSIONS;
+        create_info.enabledExtensionCount = extensions.size();
+        create_info.ppEnabledExtensionNames = extensions.data();
+
+        // Vulkan 1.2 features are only chained when needed so older devices still work in the default modes.
+        VkPhysicalDeviceVulkan12Features features12 { };
+
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features12.timelineSemaphore = sync_mode_ == SyncMode::TIMELINE;
+        features12.hostQueryReset = gpu_profiling_;
+        features12.drawIndirectCount = draw_indirect_count_;
+
+        if (features12.timelineSemaphore || features12.hostQueryReset || features12.drawIndirectCount)
+            create_info.pNext = &features12;
 
         // TODO Add extensions, need to query GLFW.
 
@@ -347,6 +470,7 @@ namespace vhs
 
         vkGetDeviceQueue(device_, graphics_queue_family_, 0, &graphics_queue_);
         vkGetDeviceQueue(device_, present_queue_family_, 0, &present_queue_);
+        vkGetDeviceQueue(device_, compute_queue_family_, 0, &compute_queue_);
     }
 
     void GraphicsContext::destroy_device()
@@ -360,6 +484,17 @@ namespace vhs
 
 
     bool GraphicsContext::check_device_extensions(VkPhysicalDevice device) const
+    {
+        for (const char* name : device_extensions())
+        {
+            if (!supports_device_extension(device, name))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool GraphicsContext::supports_device_extension(VkPhysicalDevice device, const char* name) const
     {
         uint32_t num_extensions = 0;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &num_extensions, nullptr);
@@ -367,18 +502,53 @@ namespace vhs
         std::vector<VkExtensionProperties> extensions(num_extensions);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &num_extensions, extensions.data());
 
+        const auto it = std::find_if(std::begin(extensions), std::end(extensions), [=](const VkExtensionProperties& properties)
+        {
+            return std::strcmp(name, properties.extensionName) == 0;
+        });
+
+        return it != std::end(extensions);
+    }
+
+    VkPhysicalDeviceVulkan12Features GraphicsContext::query_vulkan12_features(VkPhysicalDevice device) const
+    {
+        VkPhysicalDeviceVulkan12Features features12 { };
+
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+        // Everything is reported as unsupported on older devices.
+        VkPhysicalDeviceProperties properties { };
+        vkGetPhysicalDeviceProperties(device, &properties);
+
+        if (properties.apiVersion < VK_API_VERSION_1_2)
+            return features12;
+
+        VkPhysicalDeviceFeatures2 features { };
+
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features12;
+
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        features12.pNext = nullptr;
+
+        return features12;
+    }
+
+    std::vector<const char*> GraphicsContext::device_extensions() const
+    {
+        std::vector<const char*> extensions;
+
+        // The swapchain extension is only required when presenting.
         for (const char* name : DEVICE_EXTENSIONS)
         {
-            const auto it = std::find_if(std::begin(extensions), std::end(extensions), [=](const VkExtensionProperties& properties)
-            {
-                return std::strcmp(name, properties.extensionName) == 0;
-            });
+            if (headless_ && std::strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0)
+                continue;
 
-            if (it == std::end(extensions))
-                return false;
+            extensions.push_back(name);
         }
 
-        return true;
+        return extensions;
     }
 
 
@@ -455,6 +625,15 @@ namespace vhs
     }
 
 
+    void GraphicsContext::close_window()
+    {
+        if (headless_)
+            headless_close_requested_ = true;
+        else
+            glfwSetWindowShouldClose(window_, GLFW_TRUE);
+    }
+
+
     // Swapchain.
     bool GraphicsContext::check_swapchain_support(VkPhysicalDevice device)
     {
@@ -539,6 +718,39 @@ namespace vhs
         swapchain_images_.resize(num_swapchain_images_);
         VHS_CHECK_VK(vkGetSwapchainImagesKHR(device_, swapchain_, &num_swapchain_images_, swapchain_images_.data()));
 
+        create_swapchain_image_views();
+    }
+
+    void GraphicsContext::create_offscreen_images()
+    {
+        // Use one image per frame in flight so each frame only ever waits on its own fence.
+        num_swapchain_images_ = NUM_ACTIVE_FRAMES;
+
+        window_width_ = WINDOW_WIDTH;
+        window_height_ = WINDOW_HEIGHT;
+
+        surface_extent_.width = window_width_;
+        surface_extent_.height = window_height_;
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Creating {} offscreen images of size {}x{}.", num_swapchain_images_, window_width_, window_height_);
+
+        for (uint32_t i = 0; i < num_swapchain_images_; ++i)
+        {
+            ImageConfig config;
+
+            config.format = surface_format_.format;
+            config.extent = { surface_extent_.width, surface_extent_.height, 1 };
+            config.usage_flags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+            offscreen_images_.push_back(std::make_unique<Image>("OffscreenImage" + std::to_string(i), *this, config));
+            swapchain_images_.push_back(offscreen_images_.back()->vk_image());
+        }
+
+        create_swapchain_image_views();
+    }
+
+    void GraphicsContext::create_swapchain_image_views()
+    {
         VHS_TRACE(GRAPHICS_CONTEXT, "Creating swapchain VkImageViews.");
 
         swapchain_image_views_.resize(num_swapchain_images_);
@@ -577,6 +789,8 @@ namespace vhs
             VHS_TRACE(GRAPHICS_CONTEXT, "Destroying VkSwapchainKHR.");
             vkDestroySwapchainKHR(device_, swapchain_, nullptr);
         }
+
+        offscreen_images_.clear();
     }
 
 
@@ -613,6 +827,10 @@ namespace vhs
 
         frames_.reserve(NUM_ACTIVE_FRAMES);
         swapchain_image_fences_.resize(num_swapchain_images_, nullptr);
+        swapchain_image_values_.resize(num_swapchain_images_, 0);
+
+        if (sync_mode_ == SyncMode::TIMELINE)
+            frame_timeline_ = std::make_unique<Semaphore>("FrameTimeline", *this, frame_timeline_value_);
 
         for (uint32_t i = 0; i < NUM_ACTIVE_FRAMES; ++i)
         {
@@ -626,6 +844,7 @@ namespace vhs
             frame.command_pool = std::make_unique<CommandPool>(name + "CommandPool", *this, graphics_queue_family_);
             frame.command_buffers.resize(NUM_COMMAND_BUFFERS_PER_FRAME);
             frame.command_pool->allocate(frame.command_buffers.data(), frame.command_buffers.size());
+            frame.command_pool->allocate(&frame.upload_command_buffer, 1);
 
             frame.render_fence = std::make_unique<Fence>(name + "RenderFence", *this, VK_FENCE_CREATE_SIGNALED_BIT);
             frame.image_available_semaphore = std::make_unique<Semaphore>(name + "ImageAvailable", *this);
@@ -633,6 +852,23 @@ namespace vhs
 
             frames_.push_back(std::move(frame));
         }
+
+        staging_ring_ = { "StagingRing", *this, { staging_ring_size_, NUM_ACTIVE_FRAMES } };
+
+        // The profiler keeps an extra frame of queries so results are only read once the frame is well out of flight.
+        if (gpu_profiling_)
+        {
+            GpuProfilerConfig config;
+
+            config.num_frames = NUM_ACTIVE_FRAMES + 1;
+            config.timestamp_valid_bits = timestamp_valid_bits_;
+            config.timestamp_period = physical_device_properties_.limits.timestampPeriod;
+
+            if (const char* path = std::getenv("VHS_GPU_PROFILE_CSV"))
+                config.csv_path = path;
+
+            gpu_profiler_ = std::make_unique<GpuProfiler>(*this, config);
+        }
     }
 
     void GraphicsContext::destroy_frames()
@@ -640,41 +876,79 @@ namespace vhs
         VHS_TRACE(GRAPHICS_CONTEXT, "Destroying per-frame data.");
 
         for (auto& frame : frames_)
+        {
             frame.command_pool->free(frame.command_buffers.data(), frame.command_buffers.size());
+            frame.command_pool->free(&frame.upload_command_buffer, 1);
+        }
 
         frames_.clear();
+        frame_timeline_.reset();
+        gpu_profiler_.reset();
+        pending_uploads_.clear();
+        staging_ring_ = { };
     }
 
 
     FrameData& GraphicsContext::begin_frame()
     {
+        VHS_TRACE_SCOPE(GRAPHICS_CONTEXT, "BeginFrame");
+
         auto& data = frames_[current_frame_];
 
         // Wait for the frame to be ready.
-        data.render_fence->wait();
+        if (sync_mode_ == SyncMode::TIMELINE)
+            frame_timeline_->wait(data.timeline_value);
+        else
+            data.render_fence->wait();
 
-        // Get the next swapchain image and update the image index in frame data.
-        VHS_CHECK_VK(vkAcquireNextImageKHR(device_, swapchain_, UINT64_MAX, data.image_available_semaphore->vk_semaphore(),
-            VK_NULL_HANDLE, &data.swapchain_image_index));
+        // Get the next swapchain image and update the image index in frame data. Offscreen images are tied to the frames
+        // so there's nothing to acquire.
+        if (headless_)
+        {
+            data.swapchain_image_index = current_frame_;
+        }
+        else
+        {
+            VHS_CHECK_VK(vkAcquireNextImageKHR(device_, swapchain_, UINT64_MAX, data.image_available_semaphore->vk_semaphore(),
+                VK_NULL_HANDLE, &data.swapchain_image_index));
+        }
 
         // If this image is already in use then wait for it to become available.
-        if (swapchain_image_fences_[data.swapchain_image_index])
-            swapchain_image_fences_[data.swapchain_image_index]->wait();
-        swapchain_image_fences_[data.swapchain_image_index] = data.render_fence.get();
+        if (sync_mode_ == SyncMode::TIMELINE)
+        {
+            frame_timeline_->wait(swapchain_image_values_[data.swapchain_image_index]);
+            swapchain_image_values_[data.swapchain_image_index] = frame_timeline_value_ + 1;
+        }
+        else
+        {
+            if (swapchain_image_fences_[data.swapchain_image_index])
+                swapchain_image_fences_[data.swapchain_image_index]->wait();
+            swapchain_image_fences_[data.swapchain_image_index] = data.render_fence.get();
+
+            data.render_fence->reset();
+        }
 
-        // Reset the fence and command buffers.
-        data.render_fence->reset();
+        // Reset the command buffers.
         data.command_pool->reset();
 
-        // Clear the extra wait semaphores for the new frame.
+        // Staging memory used by the previous submission of this frame is no longer needed.
+        staging_ring_.reclaim_frame(current_frame_);
+        data.retired_staging_buffers.clear();
+
+        // Clear the extra semaphores for the new frame.
         data.submit_wait_semaphores.clear();
         data.submit_wait_stages.clear();
+        data.submit_signal_semaphores.clear();
+        data.submit_wait_values.clear();
+        data.submit_signal_values.clear();
 
         return data;
     }
 
     void GraphicsContext::end_frame()
     {
+        VHS_TRACE_SCOPE(GRAPHICS_CONTEXT, "EndFrame");
+
         auto& data = frames_[current_frame_];
 
         // Submit the graphics commands.
@@ -682,22 +956,73 @@ namespace vhs
 
         submit.wait_semaphores = data.submit_wait_semaphores;
         submit.wait_stages = data.submit_wait_stages;
+        submit.signal_semaphores = data.submit_signal_semaphores;
 
-        submit.wait_semaphores.push_back(data.image_available_semaphore->vk_semaphore());
-        submit.wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-        submit.signal_semaphores.push_back(data.render_finished_semaphore->vk_semaphore());
-        submit.signal_fence = data.render_fence->vk_fence();
-        submit.command_buffers = data.command_buffers;
+        // In timeline mode the frame signals the next value on the frame timeline instead of its fence.
+        if (sync_mode_ == SyncMode::TIMELINE)
+        {
+            VHS_ASSERT(data.submit_wait_values.size() == data.submit_wait_semaphores.size()
+                && data.submit_signal_values.size() == data.submit_signal_semaphores.size(),
+                "Frame {} is missing timeline values.", data.frame_index);
 
-        queue_submit(graphics_queue_, submit);
+            data.timeline_value = ++frame_timeline_value_;
 
-        // Present the image.
-        QueuePresentConfig present;
+            submit.wait_values = data.submit_wait_values;
+            submit.signal_values = data.submit_signal_values;
 
-        present.swapchain_image_index = data.swapchain_image_index;
-        present.wait_semaphores.push_back(data.render_finished_semaphore->vk_semaphore());
+            submit.signal_semaphores.push_back(frame_timeline_->vk_semaphore());
+            submit.signal_values.push_back(data.timeline_value);
+        }
+        else
+        {
+            submit.signal_fence = data.render_fence->vk_fence();
+        }
+
+        // Uploads go first so the frame sees the new data.
+        if (!pending_uploads_.empty())
+        {
+            record_uploads(data);
+            submit.command_buffers.push_back(data.upload_command_buffer);
+        }
+
+        submit.command_buffers.insert(submit.command_buffers.end(), data.command_buffers.begin(), data.command_buffers.end());
+
+        staging_ring_.mark_frame(current_frame_);
+        VHS_TRACE_COUNTER(GRAPHICS_CONTEXT, "StagingRingUsedBytes", staging_ring_.used());
+
+        // When headless the frame is only tracked by its fence as there's no image to acquire or present.
+        if (headless_)
+        {
+            queue_submit(graphics_queue_, submit);
+        }
+        else
+        {
+            // Presentation only works with binary semaphores so these get dummy values in timeline mode.
+            submit.wait_semaphores.push_back(data.image_available_semaphore->vk_semaphore());
+            submit.wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            submit.signal_semaphores.push_back(data.render_finished_semaphore->vk_semaphore());
 
-        queue_present(present_queue_, present);
+            if (sync_mode_ == SyncMode::TIMELINE)
+            {
+                submit.wait_values.push_back(0);
+                submit.signal_values.push_back(0);
+            }
+
+            queue_submit(graphics_queue_, submit);
+
+            // Present the image.
+            QueuePresentConfig present;
+
+            present.swapchain_image_index = data.swapchain_image_index;
+            present.wait_semaphores.push_back(data.render_finished_semaphore->vk_semaphore());
+
+            queue_present(present_queue_, present);
+        }
+
+        // The profiler moves on here rather than in begin_frame so work recorded between frames, like the simulation
+        // update, is counted with the frame that follows it.
+        if (gpu_profiler_)
+            gpu_profiler_->next_frame();
 
         // Move to the next frame.
         current_frame_ = (current_frame_ + 1) % frames_.size();
@@ -707,7 +1032,12 @@ namespace vhs
     // Queue submission.
     void GraphicsContext::queue_submit(VkQueue queue, const QueueSubmitConfig& config) const
     {
-        VHS_TRACE(GRAPHICS_CONTEXT, "Submitting {} command buffers to queue {}.", config.command_buffers.size(), fmt::ptr(queue));
+        VHS_TRACE_VERBOSE(GRAPHICS_CONTEXT, "Submitting {} command buffers to queue {}.", config.command_buffers.size(), fmt::ptr(queue));
+
+        VHS_ASSERT(config.wait_values.empty() || config.wait_values.size() == config.wait_semaphores.size(),
+            "Got {} wait values for {} semaphores.", config.wait_values.size(), config.wait_semaphores.size());
+        VHS_ASSERT(config.signal_values.empty() || config.signal_values.size() == config.signal_semaphores.size(),
+            "Got {} signal values for {} semaphores.", config.signal_values.size(), config.signal_semaphores.size());
 
         VkSubmitInfo submit_info { };
 
@@ -720,12 +1050,24 @@ namespace vhs
         submit_info.commandBufferCount = config.command_buffers.size();
         submit_info.pCommandBuffers = config.command_buffers.data();
 
+        // Timeline values are only passed when there are some, which keeps fence mode valid on devices without support.
+        VkTimelineSemaphoreSubmitInfo timeline_info { };
+
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = config.wait_values.size();
+        timeline_info.pWaitSemaphoreValues = config.wait_values.data();
+        timeline_info.signalSemaphoreValueCount = config.signal_values.size();
+        timeline_info.pSignalSemaphoreValues = config.signal_values.data();
+
+        if (!config.wait_values.empty() || !config.signal_values.empty())
+            submit_info.pNext = &timeline_info;
+
         VHS_CHECK_VK(vkQueueSubmit(queue, 1, &submit_info, config.signal_fence));
     }
 
     void GraphicsContext::queue_present(VkQueue queue, const QueuePresentConfig& config) const
     {
-        VHS_TRACE(GRAPHICS_CONTEXT, "Presenting image {} from swapchain.", config.swapchain_image_index);
+        VHS_TRACE_VERBOSE(GRAPHICS_CONTEXT, "Presenting image {} from swapchain.", config.swapchain_image_index);
 
         VkPresentInfoKHR present_info { };
 
@@ -785,15 +1127,109 @@ namespace vhs
     }
 
 
+    // Batched uploads.
+    void GraphicsContext::upload(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dst_offset,
+        VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+    {
+        VHS_TRACE_VERBOSE(GRAPHICS_CONTEXT, "Queueing upload of {} bytes to buffer '{}' at offset {}.", size, dst.name(), dst_offset);
+        VHS_ASSERT(dst_offset + size <= dst.size(), "Upload of {} bytes overruns buffer '{}'.", size, dst.name());
+
+        PendingUpload pending { &dst, std::nullopt, 0, dst_offset, size, dst_stage, dst_access };
+
+        if (auto alloc = staging_ring_.allocate(size))
+        {
+            std::memcpy(alloc->data, data, size);
+            staging_ring_.flush(*alloc, size);
+
+            pending.src_offset = alloc->offset;
+        }
+        else
+        {
+            VHS_TRACE(GRAPHICS_CONTEXT, "Staging ring full with {} of {} bytes used, creating dedicated staging buffer.",
+                staging_ring_.used(), staging_ring_.capacity());
+
+            pending.staging = create_staging_buffer("UploadStaging", size);
+            pending.staging->write_bytes(data, size, 0);
+        }
+
+        pending_uploads_.push_back(std::move(pending));
+    }
+
+    void GraphicsContext::upload_immediate(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dst_offset)
+    {
+        // If nothing else is in flight the ring can be emptied straight after the copy completes.
+        const bool ring_idle = !staging_ring_.used();
+
+        if (auto alloc = staging_ring_.allocate(size))
+        {
+            std::memcpy(alloc->data, data, size);
+            staging_ring_.flush(*alloc, size);
+
+            copy_buffer(dst, staging_ring_.buffer(), size, alloc->offset, dst_offset);
+
+            if (ring_idle)
+                staging_ring_.reset();
+        }
+        else
+        {
+            auto staging = create_staging_buffer("StagingFor" + dst.name(), size);
+            staging.write_bytes(data, size, 0);
+
+            copy_buffer(dst, staging, size, 0, dst_offset);
+        }
+    }
+
+    void GraphicsContext::record_uploads(FrameData& frame)
+    {
+        VHS_TRACE_VERBOSE(GRAPHICS_CONTEXT, "Recording {} uploads for frame {}.", pending_uploads_.size(), frame.frame_index);
+
+        // Earlier frames may still be using the destinations so wait for them before overwriting, then make the new
+        // data visible to the stages that asked for it.
+        PipelineBarrier before { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT };
+        PipelineBarrier after { VK_PIPELINE_STAGE_TRANSFER_BIT, 0 };
+
+        for (const auto& pending : pending_uploads_)
+        {
+            before.add_buffer(VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, *pending.dst);
+            after.add_buffer(VK_ACCESS_TRANSFER_WRITE_BIT, pending.dst_access, *pending.dst);
+            after.add_dst_stage(pending.dst_stage);
+        }
+
+        CommandBuffer cmd { frame.upload_command_buffer };
+
+        cmd.barrier(before);
+
+        for (auto& pending : pending_uploads_)
+        {
+            auto& src = pending.staging ? *pending.staging : staging_ring_.buffer();
+            cmd.copy_buffer(*pending.dst, src, pending.size, pending.src_offset, pending.dst_offset);
+
+            if (pending.staging)
+                frame.retired_staging_buffers.push_back(std::move(*pending.staging));
+        }
+
+        cmd.barrier(after);
+        cmd.end();
+
+        pending_uploads_.clear();
+    }
+
+
     // Common immediate commands.
     void GraphicsContext::copy_buffer(Buffer& dst, Buffer& src)
     {
-        VHS_TRACE(GRAPHICS_CONTEXT, "Copying buffer '{}' into buffer '{}'.", src.name(), dst.name());
-        VHS_ASSERT(dst.size() == src.size(), "Attempted to copy buffers of different sizes.");
+        VHS_ASSERT(dst.size() == src.size(), "Attempted to copy buffers of different sizes '{}' and '{}'.", dst.name(), src.name());
+
+        copy_buffer(dst, src, src.size(), 0, 0);
+    }
+
+    void GraphicsContext::copy_buffer(Buffer& dst, Buffer& src, VkDeviceSize size, VkDeviceSize src_offset, VkDeviceSize dst_offset)
+    {
+        VHS_TRACE(GRAPHICS_CONTEXT, "Copying {} bytes from buffer '{}' into buffer '{}'.", size, src.name(), dst.name());
 
         CommandBuffer cmd { immediate_command_buffer_ };
 
-        cmd.copy_buffer(dst, src);
+        cmd.copy_buffer(dst, src, size, src_offset, dst_offset);
         cmd.end();
 
         QueueSubmitConfig submit;
@@ -858,6 +1294,32 @@ namespace vhs
     }
 
 
+    void GraphicsContext::release_buffer(const Buffer& buffer, uint32_t dst_family, VkPipelineStageFlags src_stage, VkAccessFlags src_access)
+    {
+        VHS_TRACE(GRAPHICS_CONTEXT, "Releasing buffer '{}' from queue family {} to {}.", buffer.name(), graphics_queue_family_, dst_family);
+
+        PipelineBarrier barrier { src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
+
+        barrier.add_buffer(src_access, 0, buffer, graphics_queue_family_, dst_family);
+
+        CommandBuffer cmd { immediate_command_buffer_ };
+
+        cmd.barrier(barrier);
+        cmd.end();
+
+        QueueSubmitConfig submit;
+
+        submit.command_buffers.push_back(immediate_command_buffer_);
+        submit.signal_fence = immediate_command_fence_->vk_fence();
+
+        queue_submit(graphics_queue_, submit);
+
+        immediate_command_fence_->wait();
+        immediate_command_fence_->reset();
+        immediate_command_pool_->reset();
+    }
+
+
     // Buffer utilities.
     Buffer GraphicsContext::create_staging_buffer(std::string_view name, uint32_t size)
     {
@@ -868,6 +1330,7 @@ namespace vhs
         config.size = size;
         config.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
         config.memory_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        config.persistently_mapped = true;
 
         return { name, *this, config };
     }
@@ -885,6 +1348,25 @@ namespace vhs
         return { name, *this, config };
     }
 
+    Buffer GraphicsContext::create_shared_device_local_buffer(std::string_view name, VkBufferUsageFlags usage, uint32_t size)
+    {
+        VHS_TRACE(GRAPHICS_CONTEXT, "Creating shared device local buffer '{}' with usage 0x{:x} and size {}.", name, usage, size);
+
+        BufferConfig config;
+
+        config.size = size;
+        config.usage_flags = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        config.memory_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        if (async_compute())
+        {
+            config.sharing_mode = VK_SHARING_MODE_CONCURRENT;
+            config.queue_families = { graphics_queue_family_, compute_queue_family_ };
+        }
+
+        return { name, *this, config };
+    }
+
     Buffer GraphicsContext::create_host_visible_buffer(std::string_view name, VkBufferUsageFlags usage, uint32_t size)
     {
         VHS_TRACE(GRAPHICS_CONTEXT, "Creating host visible buffer '{}' with usage 0x{:x} and size {}.", name, usage, size);
@@ -894,6 +1376,7 @@ namespace vhs
         config.size = size;
         config.usage_flags = usage;
         config.memory_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+        config.persistently_mapped = true;
 
         return { name, *this, config };
     }
@@ -902,7 +1385,136 @@ namespace vhs
     // Load shader program from file.
     ShaderModule GraphicsContext::create_shader_module(std::string_view name, VkShaderStageFlags stage, const char* path)
     {
+        VHS_TRACE_SCOPE(GRAPHICS_CONTEXT, "CreateShaderModule");
+
         const auto bytes = load_bytes(path);
         return { name, *this, bytes.data(), (uint32_t)bytes.size(), stage };
     }
+
+
+    // Build compute pipelines on demand and keep them for the lifetime of the context. The lock is only held to look up
+    // and insert, so different variants are compiled concurrently. Two threads asking for the same new variant both build
+    // it and the second one is thrown away, which is cheap with the pipeline cache and doesn't happen in practice.
+    Pipeline& GraphicsContext::compute_pipeline_variant(std::string_view name, const char* path, const ComputePipelineConfig& config)
+    {
+        PipelineVariantKey key;
+
+        key.path = path;
+
+        for (const auto& range : config.push_constants)
+            key.push_constants.insert(std::end(key.push_constants), { range.stageFlags, range.offset, range.size });
+
+        for (const auto& constant : config.specialisation_constants)
+            key.specialisation_constants.insert(std::end(key.specialisation_constants), { constant.id, constant.value });
+
+        std::unique_lock lock { pipeline_variants_mutex_ };
+
+        // Each set contributes its binding count followed by its bindings so the boundaries between sets are kept.
+        for (const auto layout : config.descriptor_set_layouts)
+        {
+            const auto it = descriptor_set_layout_bindings_.find(layout);
+            VHS_ASSERT(it != std::end(descriptor_set_layout_bindings_), "Pipeline variant '{}' uses an unregistered descriptor set layout.",
+                name);
+
+            key.descriptor_set_layouts.push_back(it->second.size() / 4);
+            key.descriptor_set_layouts.insert(std::end(key.descriptor_set_layouts), std::begin(it->second), std::end(it->second));
+        }
+
+        if (const auto it = pipeline_variants_.find(key); it != std::end(pipeline_variants_))
+        {
+            VHS_TRACE_VERBOSE(GRAPHICS_CONTEXT, "Reusing pipeline variant for {}.", name);
+            return it->second;
+        }
+
+        auto module = shader_modules_.find(key.path);
+
+        if (module == std::end(shader_modules_))
+        {
+            lock.unlock();
+            auto new_module = create_shader_module(fmt::format(FMT_STRING("{}Shader"), name), VK_SHADER_STAGE_COMPUTE_BIT, path);
+            lock.lock();
+
+            module = shader_modules_.emplace(key.path, std::move(new_module)).first;
+        }
+
+        auto variant_config = config;
+        variant_config.shader_module = &module->second;
+
+        lock.unlock();
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Building pipeline variant of '{}' with {} specialisation constants.", path,
+            config.specialisation_constants.size());
+
+        Pipeline pipeline { name, *this, variant_config };
+
+        lock.lock();
+
+        return pipeline_variants_.emplace(std::move(key), std::move(pipeline)).first->second;
+    }
+
+    void GraphicsContext::register_descriptor_set_layout(VkDescriptorSetLayout layout, const DescriptorSetLayoutConfig& config)
+    {
+        std::vector<uint32_t> bindings;
+
+        for (const auto& binding : config.bindings)
+        {
+            bindings.insert(std::end(bindings),
+                { binding.binding, static_cast<uint32_t>(binding.type), binding.stage_flags, binding.count });
+        }
+
+        std::lock_guard lock { pipeline_variants_mutex_ };
+        descriptor_set_layout_bindings_[layout] = std::move(bindings);
+    }
+
+    void GraphicsContext::unregister_descriptor_set_layout(VkDescriptorSetLayout layout)
+    {
+        std::lock_guard lock { pipeline_variants_mutex_ };
+        descriptor_set_layout_bindings_.erase(layout);
+    }
+
+    void GraphicsContext::destroy_pipeline_variants()
+    {
+        pipeline_variants_.clear();
+        shader_modules_.clear();
+    }
+
+
+    // Pipeline cache.
+    void GraphicsContext::create_pipeline_cache(const std::filesystem::path& directory)
+    {
+        if (directory.empty())
+        {
+            VHS_TRACE(GRAPHICS_CONTEXT, "Pipeline cache disabled.");
+            return;
+        }
+
+        pipeline_cache_ = { "PipelineCache", *this, directory };
+    }
+
+    void GraphicsContext::destroy_pipeline_cache()
+    {
+        // Saved and destroyed as the moved-to cache goes out of scope, while the device is still alive.
+        auto cache = std::move(pipeline_cache_);
+    }
+
+
+    // Four subgroups per group keeps a few waves resident to hide latency while leaving the strand kernels enough shared
+    // memory, within whatever the device allows.
+    void GraphicsContext::select_compute_local_size(uint32_t requested)
+    {
+        if (requested)
+            compute_local_size_ = requested;
+        else if (subgroup_properties_.subgroupSize)
+            compute_local_size_ = std::clamp(subgroup_properties_.subgroupSize * 4, 64u, 512u);
+
+        compute_local_size_ = std::min(compute_local_size_, max_compute_local_size());
+
+        VHS_TRACE(GRAPHICS_CONTEXT, "Compute local size is {}{}.", compute_local_size_, requested ? " (requested)" : "");
+    }
+
+    uint32_t GraphicsContext::max_compute_local_size() const
+    {
+        const auto& limits = physical_device_properties_.limits;
+        return std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations);
+    }
 }
@@ -1,8 +1,13 @@
 #ifndef VHS_GRAPHICS_CONTEXT_HPP
 #define VHS_GRAPHICS_CONTEXT_HPP
 
+#include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <tuple>
 #include <vector>
 
 #include <GLFW/glfw3.h>
@@ -11,7 +16,10 @@
 #include "assert.hpp"
 #include "buffer.hpp"
 #include "io.hpp"
+#include "pipeline.hpp"
+#include "pipeline_cache.hpp"
 #include "shader_module.hpp"
+#include "staging_ring.hpp"
 
 
 // Convenience macro to save typing the function name twice.
@@ -23,11 +31,14 @@ namespace vhs
     class CommandPool;
     class Fence;
     class Framebuffer;
+    class GpuProfiler;
+    class Image;
     class ImageView;
-    class Pipeline;
     class RenderPass;
     class Semaphore;
 
+    struct DescriptorSetLayoutConfig;
+
     // Per-frame structures for recording commands etc.
     struct FrameData
     {
@@ -37,12 +48,27 @@ namespace vhs
         std::unique_ptr<CommandPool> command_pool;
         std::vector<VkCommandBuffer> command_buffers;
 
+        // Copies queued with GraphicsContext::upload are recorded here and submitted ahead of the frame's commands.
+        VkCommandBuffer upload_command_buffer;
+
+        // Dedicated staging buffers used when the ring was full, released once the frame's fence has been waited on.
+        std::vector<Buffer> retired_staging_buffers;
+
+        // Only one of these tracks completion of the frame depending on the sync mode. The timeline value is the one
+        // signalled by the last submission of this frame.
         std::unique_ptr<Fence> render_fence;
+        uint64_t timeline_value = 0;
+
         std::unique_ptr<Semaphore> image_available_semaphore;
         std::unique_ptr<Semaphore> render_finished_semaphore;
 
         std::vector<VkSemaphore> submit_wait_semaphores;
         std::vector<VkPipelineStageFlags> submit_wait_stages;
+        std::vector<VkSemaphore> submit_signal_semaphores;
+
+        // Values for the semaphores above in timeline mode, zero for binary semaphores. Left empty in fence mode.
+        std::vector<uint64_t> submit_wait_values;
+        std::vector<uint64_t> submit_signal_values;
     };
 
     // Structures for queue submission and presentation.
@@ -54,6 +80,11 @@ namespace vhs
         std::vector<VkCommandBuffer> command_buffers;
         std::vector<VkPipelineStageFlags> wait_stages;
         VkFence signal_fence = VK_NULL_HANDLE;
+
+        // Timeline semaphore values matching the semaphores above, ignored for binary semaphores. Either empty or the
+        // same length as the corresponding semaphores.
+        std::vector<uint64_t> wait_values;
+        std::vector<uint64_t> signal_values;
     };
 
     struct QueuePresentConfig
@@ -62,6 +93,41 @@ namespace vhs
         uint32_t swapchain_image_index;
     };
 
+    // How frames and simulation ticks are ordered. Fences block the host on each frame and tick while timeline semaphores
+    // let submissions wait on each other on the device, only blocking the host when it gets too far ahead.
+    enum class SyncMode
+    {
+        FENCES,
+        TIMELINE
+    };
+
+    // Context creation options.
+    struct GraphicsContextConfig
+    {
+        // Render into offscreen images instead of a window. No GLFW window, surface or swapchain is created and
+        // frames are paced with fences alone.
+        bool headless = false;
+
+        // Size in bytes of the staging ring used for uploads.
+        VkDeviceSize staging_ring_size = 16 * 1024 * 1024;
+
+        // Use a dedicated compute queue family if the device has one. Otherwise compute work shares the graphics queue.
+        bool async_compute = true;
+
+        // Falls back to fences if the device doesn't support timeline semaphores.
+        SyncMode sync_mode = SyncMode::FENCES;
+
+        // Time GPU work with timestamp queries. Disabled if the device can't reset queries from the host.
+        bool gpu_profiling = true;
+
+        // Workgroup size for the compute kernels, zero to pick one from the device's subgroup size and limits.
+        uint32_t compute_local_size = 0;
+
+        // Directory the pipeline cache is loaded from and saved to between runs, relative to the data like the other
+        // paths. Empty disables the cache.
+        std::filesystem::path pipeline_cache_directory = "pipeline_cache";
+    };
+
     // Maintains the Vulkan context for rendering and compute.
     class GraphicsContext
     {
@@ -69,7 +135,7 @@ namespace vhs
         GraphicsContext(const GraphicsContext&) = delete;
         GraphicsContext(GraphicsContext&&) = delete;
 
-        GraphicsContext();
+        GraphicsContext(const GraphicsContextConfig& config = { });
         ~GraphicsContext();
 
 
@@ -100,31 +166,45 @@ namespace vhs
 
         // Common immediate commands.
         void copy_buffer(Buffer& dst, Buffer& src);
+        void copy_buffer(Buffer& dst, Buffer& src, VkDeviceSize size, VkDeviceSize src_offset, VkDeviceSize dst_offset);
         void compute(Pipeline& pipeline, const Buffer& output, uint32_t num_groups, const VkDescriptorSet* sets, uint32_t num_sets);
         void upload_imgui_fonts();
 
-        // Window functions.
-        bool is_window_open() const { return !glfwWindowShouldClose(window_); }
-        void poll_window_events() const { glfwPollEvents(); }
-        void close_window() { glfwSetWindowShouldClose(window_, GLFW_TRUE); }
+        // Release ownership of a buffer last written on the graphics queue to another queue family. The new owner must
+        // record the matching acquire before using it.
+        void release_buffer(const Buffer& buffer, uint32_t dst_family, VkPipelineStageFlags src_stage, VkAccessFlags src_access);
+
+        // Window functions. In headless mode there are no events and the "window" stays open until closed.
+        bool is_window_open() const { return headless_ ? !headless_close_requested_ : !glfwWindowShouldClose(window_); }
+        void poll_window_events() const { if (!headless_) glfwPollEvents(); }
+        void close_window();
 
         // Wait for the device to become idle.
         void wait_idle() const { VHS_CHECK_VK(vkDeviceWaitIdle(device_)); }
 
+        // Queue an upload to a device local buffer. The data is copied into the staging ring immediately and the copy is
+        // recorded at the start of the next submitted frame, followed by a barrier making it visible to the given stage
+        // and access. The destination must stay alive until that frame has been submitted.
+        void upload(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dst_offset, VkPipelineStageFlags dst_stage,
+            VkAccessFlags dst_access);
+
+        // Upload and wait for the copy to complete, for use outside of the frame loop.
+        void upload_immediate(Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dst_offset = 0);
+
         // Buffer utility functions.
         Buffer create_staging_buffer(std::string_view name, uint32_t size);
         Buffer create_device_local_buffer(std::string_view name, VkBufferUsageFlags usage, uint32_t size);
         Buffer create_host_visible_buffer(std::string_view name, VkBufferUsageFlags usage, uint32_t size);
 
+        // Device local buffer used by both the graphics and compute queues without ownership transfers. Only concurrent
+        // when the queues are from different families.
+        Buffer create_shared_device_local_buffer(std::string_view name, VkBufferUsageFlags usage, uint32_t size);
+
         template <class T>
         Buffer create_device_local_buffer(std::string_view name, VkBufferUsageFlags usage, const T* data, uint32_t size)
         {
-            auto staging = create_staging_buffer("StagingFor" + std::string(name), sizeof *data * size);
             auto buffer = create_device_local_buffer(name, usage, sizeof *data * size);
-
-            staging.write(data, size);
-            copy_buffer(buffer, staging);
-
+            upload_immediate(buffer, data, sizeof *data * size);
             return buffer;
         }
 
@@ -151,8 +231,18 @@ namespace vhs
         // Load shader module from file.
         ShaderModule create_shader_module(std::string_view name, VkShaderStageFlags stage, const char* path);
 
+        // Get a compute pipeline for the shader at the given path, building it the first time a combination of layout
+        // and specialisation constants is seen. The shader module in the config is ignored. Pipelines live as long as
+        // the context so the reference can be held on to. Safe to call from several threads at once.
+        Pipeline& compute_pipeline_variant(std::string_view name, const char* path, const ComputePipelineConfig& config);
+
+        // Descriptor set layouts record their bindings here so variants are matched on what a layout contains rather than
+        // its handle, which the driver may hand out again once the layout is destroyed.
+        void register_descriptor_set_layout(VkDescriptorSetLayout layout, const DescriptorSetLayoutConfig& config);
+        void unregister_descriptor_set_layout(VkDescriptorSetLayout layout);
+
         // Change the cursor mode.
-        void set_cursor_mode(int mode) { glfwSetInputMode(window_, GLFW_CURSOR, mode); }
+        void set_cursor_mode(int mode) { if (!headless_) glfwSetInputMode(window_, GLFW_CURSOR, mode); }
 
 
         // Access Vulkan handles.
@@ -160,21 +250,59 @@ namespace vhs
         VkPhysicalDevice vk_physical_device() const { return physical_device_; }
         VkDevice vk_device() const { return device_; }
         VmaAllocator vma_allocator() const { return allocator_; }
+        VkPipelineCache vk_pipeline_cache() const { return pipeline_cache_.vk_pipeline_cache(); }
 
 
         // Other accessors.
         uint32_t graphics_queue_family() const { return graphics_queue_family_; }
         VkQueue graphics_queue() const { return graphics_queue_; }
+        uint32_t compute_queue_family() const { return compute_queue_family_; }
+        VkQueue compute_queue() const { return compute_queue_; }
+        bool async_compute() const { return compute_queue_family_ != graphics_queue_family_; }
+
+        SyncMode sync_mode() const { return sync_mode_; }
+
+        // Indirect draws with more than one command, with the count read from a buffer, and with a first instance other
+        // than zero.
+        bool multi_draw_indirect() const { return physical_device_features_.multiDrawIndirect; }
+        bool draw_indirect_count() const { return draw_indirect_count_; }
+        bool draw_indirect_first_instance() const { return physical_device_features_.drawIndirectFirstInstance; }
+
+        const VkPhysicalDeviceProperties& physical_device_properties() const { return physical_device_properties_; }
+        const VkPhysicalDeviceSubgroupProperties& subgroup_properties() const { return subgroup_properties_; }
+
+        // Smallest subgroup size compute dispatches may run with, zero if the device can't report it.
+        uint32_t min_subgroup_size() const { return min_subgroup_size_; }
+
+        // Preferred workgroup size for compute kernels, always within the device limits.
+        uint32_t compute_local_size() const { return compute_local_size_; }
+        uint32_t max_compute_local_size() const;
+
+        // Timeline signalled as each frame completes, only valid in timeline mode. The value is that of the most recently
+        // submitted frame.
+        const Semaphore& frame_timeline() const { return *frame_timeline_; }
+        uint64_t frame_timeline_value() const { return frame_timeline_value_; }
+
+        // Null if GPU profiling is disabled or unsupported.
+        GpuProfiler* gpu_profiler() const { return gpu_profiler_.get(); }
 
         VkSurfaceFormatKHR swapchain_image_format() const { return surface_format_; }
         VkRect2D viewport() const { return { { 0, 0 }, surface_extent_ }; }
         uint32_t num_swapchain_images() const { return num_swapchain_images_; }
-        uint32_t min_num_swapchain_images() const { return surface_capabilities_.minImageCount; }
+        uint32_t min_num_swapchain_images() const { return headless_ ? num_swapchain_images_ : surface_capabilities_.minImageCount; }
+        uint32_t num_frames() const { return frames_.size(); }
 
         const KeyboardState& keyboard_state() const { return keyboard_state_; }
         const MouseState& mouse_state() const { return mouse_state_; }
 
         GLFWwindow* glfw_window() const { return window_; }
+        bool headless() const { return headless_; }
+
+        // Layout the swapchain images should be left in at the end of a frame's render pass.
+        VkImageLayout swapchain_image_final_layout() const
+        {
+            return headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        }
 
     private:
         // VkInstance management.
@@ -191,6 +319,9 @@ namespace vhs
         void destroy_device();
 
         bool check_device_extensions(VkPhysicalDevice device) const;
+        bool supports_device_extension(VkPhysicalDevice device, const char* name) const;
+        VkPhysicalDeviceVulkan12Features query_vulkan12_features(VkPhysicalDevice device) const;
+        std::vector<const char*> device_extensions() const;
 
         // Window and surface management.
         void create_window();
@@ -206,6 +337,11 @@ namespace vhs
         void create_swapchain();
         void destroy_swapchain();
 
+        void create_swapchain_image_views();
+
+        // Offscreen replacement for the swapchain in headless mode.
+        void create_offscreen_images();
+
         // Per-frame data.
         void create_frames();
         void destroy_frames();
@@ -218,6 +354,17 @@ namespace vhs
         void create_immediate_command_pool();
         void destroy_immediate_command_pool();
 
+        // Batched uploads.
+        void record_uploads(FrameData& frame);
+
+        // Compute pipeline variants.
+        void select_compute_local_size(uint32_t requested);
+        void destroy_pipeline_variants();
+
+        // Pipeline cache persisted between runs.
+        void create_pipeline_cache(const std::filesystem::path& directory);
+        void destroy_pipeline_cache();
+
 
         // Vulkan handles.
         VkInstance instance_ = VK_NULL_HANDLE;
@@ -229,15 +376,33 @@ namespace vhs
 
         VkQueue graphics_queue_ = VK_NULL_HANDLE;
         VkQueue present_queue_ = VK_NULL_HANDLE;
+        VkQueue compute_queue_ = VK_NULL_HANDLE;
 
         // Physical device information.
         VkPhysicalDeviceProperties physical_device_properties_ = { };
         VkPhysicalDeviceFeatures physical_device_features_ = { };
+        VkPhysicalDeviceSubgroupProperties subgroup_properties_ = { };
+        uint32_t min_subgroup_size_ = 0;
 
         uint32_t graphics_queue_family_ = -1;
         uint32_t present_queue_family_ = -1;
+        uint32_t compute_queue_family_ = -1;
+
+        bool async_compute_requested_ = true;
+
+        SyncMode sync_mode_ = SyncMode::FENCES;
+
+        bool gpu_profiling_ = true;
+        uint32_t timestamp_valid_bits_ = 0;
+
+        bool draw_indirect_count_ = false;
+
+        uint32_t compute_local_size_ = VHS_COMPUTE_LOCAL_SIZE;
 
         // Graphics window.
+        bool headless_ = false;
+        bool headless_close_requested_ = false;
+
         GLFWwindow* window_ = nullptr;
 
         uint32_t window_width_ = -1;
@@ -254,14 +419,21 @@ namespace vhs
 
         std::vector<VkImage> swapchain_images_;
         std::vector<VkImageView> swapchain_image_views_;
+        std::vector<std::unique_ptr<Image>> offscreen_images_;
 
         uint32_t num_swapchain_images_ = -1;
 
         // Per-frame structures.
         std::vector<FrameData> frames_;
         std::vector<Fence*> swapchain_image_fences_;
+        std::vector<uint64_t> swapchain_image_values_;
         uint32_t current_frame_ = 0;
 
+        std::unique_ptr<Semaphore> frame_timeline_;
+        uint64_t frame_timeline_value_ = 0;
+
+        std::unique_ptr<GpuProfiler> gpu_profiler_;
+
         // Memory allocations.
         VmaAllocator allocator_ = VK_NULL_HANDLE;
 
@@ -269,6 +441,47 @@ namespace vhs
         std::unique_ptr<CommandPool> immediate_command_pool_;
         std::unique_ptr<Fence> immediate_command_fence_;
         VkCommandBuffer immediate_command_buffer_ = VK_NULL_HANDLE;
+
+        // Uploads waiting to be recorded into the next frame. Staging is set when the ring was full and a dedicated
+        // buffer had to be created instead.
+        struct PendingUpload
+        {
+            Buffer* dst;
+            std::optional<Buffer> staging;
+
+            VkDeviceSize src_offset;
+            VkDeviceSize dst_offset;
+            VkDeviceSize size;
+
+            VkPipelineStageFlags dst_stage;
+            VkAccessFlags dst_access;
+        };
+
+        StagingRing staging_ring_;
+        std::vector<PendingUpload> pending_uploads_;
+        VkDeviceSize staging_ring_size_;
+
+        // Pipelines are keyed on everything that goes into building them apart from the name.
+        struct PipelineVariantKey
+        {
+            std::string path;
+            std::vector<uint32_t> descriptor_set_layouts;
+            std::vector<uint32_t> push_constants;
+            std::vector<uint32_t> specialisation_constants;
+
+            bool operator<(const PipelineVariantKey& other) const
+            {
+                return std::tie(path, descriptor_set_layouts, push_constants, specialisation_constants)
+                    < std::tie(other.path, other.descriptor_set_layouts, other.push_constants, other.specialisation_constants);
+            }
+        };
+
+        std::mutex pipeline_variants_mutex_;
+        std::map<std::string, ShaderModule> shader_modules_;
+        std::map<PipelineVariantKey, Pipeline> pipeline_variants_;
+        std::map<VkDescriptorSetLayout, std::vector<uint32_t>> descriptor_set_layout_bindings_;
+
+        PipelineCache pipeline_cache_;
     };
 }
 
@@ -0,0 +1,202 @@
+#include <cstring>
+
+#include <fstream>
+#include <random>
+
+#include "assert.hpp"
+#include "hair_asset.hpp"
+#include "trace.hpp"
+
+
+VHS_TRACE_DEFINE(HAIR_ASSET);
+
+
+namespace vhs
+{
+    static const char HAIR_ASSET_MAGIC[4] = { 'V', 'H', 'S', 'A' };
+
+    // Sections are aligned so they can be accessed in place from the mapping.
+    static const uint64_t HAIR_ASSET_ALIGNMENT = 16;
+
+    static uint64_t align_offset(uint64_t offset)
+    {
+        return (offset + HAIR_ASSET_ALIGNMENT - 1) & ~(HAIR_ASSET_ALIGNMENT - 1);
+    }
+
+
+    // Building.
+    HairAsset::HairAsset(const std::filesystem::path& obj_path, const HairAssetConfig& config)
+    {
+        VHS_TRACE(HAIR_ASSET, "Building hair asset from '{}'.", obj_path.c_str());
+
+        std::vector<RootVertex> vertices;
+        std::vector<uint32_t> indices;
+
+        load_obj(obj_path, vertices, indices);
+
+        const auto index_type = select_root_index_type(vertices.size());
+        const auto num_strands = (uint32_t)vertices.size();
+        const auto total_particles = num_strands * config.particles_per_strand;
+
+        // Lay out the header and sections.
+        HairAssetHeader header { };
+
+        std::memcpy(header.magic, HAIR_ASSET_MAGIC, sizeof HAIR_ASSET_MAGIC);
+
+        header.version = VERSION;
+        header.particles_per_strand = config.particles_per_strand;
+        header.strands_per_triangle = config.strands_per_triangle;
+        header.particle_separation = config.particle_separation;
+        header.index_type = static_cast<uint32_t>(index_type);
+        header.num_root_vertices = vertices.size();
+        header.num_root_indices = indices.size();
+
+        header.positions_size = total_particles * 3;
+        header.velocities_size = total_particles * 3;
+        header.tri_indices_size = packed_root_indices_size(index_type, indices.size());
+        header.barycentric_size = config.strands_per_triangle * 3;
+
+        header.root_vertices_offset = align_offset(sizeof header);
+        header.root_indices_offset = align_offset(header.root_vertices_offset + sizeof(RootVertex) * vertices.size());
+        header.state_offset = align_offset(header.root_indices_offset + sizeof(uint32_t) * indices.size());
+        header.file_size = header.state_offset + sizeof(float) * state_size_of(header);
+
+        bytes_.resize(header.file_size);
+
+        std::memcpy(bytes_.data(), &header, sizeof header);
+        std::memcpy(bytes_.data() + header.root_vertices_offset, vertices.data(), sizeof(RootVertex) * vertices.size());
+        std::memcpy(bytes_.data() + header.root_indices_offset, indices.data(), sizeof(uint32_t) * indices.size());
+
+        // Grow hairs from the roots along their normals. Velocities start at zero.
+        auto* state = reinterpret_cast<float*>(bytes_.data() + header.state_offset);
+
+        for (uint32_t i = 0; i < num_strands; ++i)
+        {
+            const auto& root = vertices[i];
+
+            for (uint32_t j = 0; j < config.particles_per_strand; ++j)
+            {
+                const auto position = root.position + root.normal * (config.particle_separation * j);
+                const auto index = i * config.particles_per_strand + j;
+
+                state[index + total_particles * 0] = position.x;
+                state[index + total_particles * 1] = position.y;
+                state[index + total_particles * 2] = position.z;
+            }
+        }
+
+        // Root triangle indices are stored as raw bits after the velocities.
+        auto* tri_indices = reinterpret_cast<uint32_t*>(state + header.positions_size + header.velocities_size);
+        pack_root_indices(index_type, indices, tri_indices);
+
+        // Barycentric coordinates for strand interpolation go at the end.
+        auto* barycentrics = tri_indices + header.tri_indices_size;
+
+        std::mt19937 rng { VHS_RANDOM_SEED };
+        std::uniform_real_distribution<float> dist { 0, 1 };
+
+        for (uint32_t i = 0; i < config.strands_per_triangle; ++i)
+        {
+            glm::vec3 b { dist(rng), dist(rng), dist(rng) };
+            b /= (b.x + b.y + b.z);
+
+            std::memcpy(barycentrics + 3 * i, &b, sizeof b);
+        }
+
+        VHS_TRACE(HAIR_ASSET, "Built hair asset with {} strands and {} bytes of state.", num_strands, sizeof(float) * state_size());
+    }
+
+
+    // Loading and saving.
+    std::optional<HairAsset> HairAsset::load(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+
+        if (!std::filesystem::is_regular_file(path, ec))
+        {
+            VHS_TRACE(HAIR_ASSET, "No baked hair asset at '{}'.", path.c_str());
+            return std::nullopt;
+        }
+
+        MappedFile file { path };
+
+        const auto reject = [&](const char* reason)
+        {
+            VHS_TRACE(HAIR_ASSET, "Ignoring baked hair asset '{}': {}.", path.c_str(), reason);
+            return std::nullopt;
+        };
+
+        if (file.size() < sizeof(HairAssetHeader))
+            return reject("file too small");
+
+        const auto& header = *reinterpret_cast<const HairAssetHeader*>(file.data());
+
+        if (std::memcmp(header.magic, HAIR_ASSET_MAGIC, sizeof HAIR_ASSET_MAGIC) != 0)
+            return reject("bad magic");
+        if (header.version != VERSION)
+            return reject("version mismatch");
+        if (header.file_size != file.size())
+            return reject("truncated");
+        if (header.index_type > static_cast<uint32_t>(RootIndexType::UINT32))
+            return reject("unknown index type");
+
+        // Check the sections are aligned, in order and consistent with the counts.
+        const auto total_particles = (uint64_t)header.num_root_vertices * header.particles_per_strand;
+
+        const bool aligned = header.root_vertices_offset % HAIR_ASSET_ALIGNMENT == 0
+            && header.root_indices_offset % HAIR_ASSET_ALIGNMENT == 0 && header.state_offset % HAIR_ASSET_ALIGNMENT == 0;
+
+        const bool ordered = header.root_vertices_offset >= sizeof header
+            && header.root_vertices_offset + sizeof(RootVertex) * header.num_root_vertices <= header.root_indices_offset
+            && header.root_indices_offset + sizeof(uint32_t) * header.num_root_indices <= header.state_offset
+            && header.state_offset + sizeof(float) * state_size_of(header) == header.file_size;
+
+        const bool consistent = header.positions_size == total_particles * 3 && header.velocities_size == total_particles * 3
+            && header.tri_indices_size == packed_root_indices_size(static_cast<RootIndexType>(header.index_type), header.num_root_indices)
+            && header.barycentric_size == header.strands_per_triangle * 3;
+
+        if (!aligned || !ordered || !consistent)
+            return reject("malformed sections");
+
+        VHS_TRACE(HAIR_ASSET, "Mapped baked hair asset '{}' with {} strands.", path.c_str(), header.num_root_vertices);
+
+        HairAsset asset;
+        asset.file_ = std::move(file);
+
+        return asset;
+    }
+
+    void HairAsset::save(const std::filesystem::path& path) const
+    {
+        VHS_TRACE(HAIR_ASSET, "Writing {} bytes to '{}'.", size_bytes(), path.c_str());
+
+        std::ofstream ofs { path, std::ios::binary | std::ios::trunc };
+        VHS_ASSERT(ofs, "Failed to open '{}' for writing.", path.c_str());
+
+        ofs.write(reinterpret_cast<const char*>(data()), size_bytes());
+        VHS_ASSERT(ofs, "Failed to write hair asset '{}'.", path.c_str());
+    }
+
+
+    // Accessors.
+    HairAssetConfig HairAsset::config() const
+    {
+        HairAssetConfig config;
+
+        config.particles_per_strand = header().particles_per_strand;
+        config.strands_per_triangle = header().strands_per_triangle;
+        config.particle_separation = header().particle_separation;
+
+        return config;
+    }
+
+    uint32_t HairAsset::state_size() const
+    {
+        return state_size_of(header());
+    }
+
+    uint64_t HairAsset::state_size_of(const HairAssetHeader& header)
+    {
+        return (uint64_t)header.positions_size + header.velocities_size + header.tri_indices_size + header.barycentric_size;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef VHS_HAIR_ASSET_HPP
+#define VHS_HAIR_ASSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "io.hpp"
+
+
+namespace vhs
+{
+    // Parameters used to grow the initial strands when building an asset. The optimised GPU simulator creates a root
+    // triangle's vertices in one workgroup, so particles per strand times the larger of the strands per triangle and
+    // three must fit the device's workgroup size.
+    struct HairAssetConfig
+    {
+        uint32_t particles_per_strand = 8;
+        uint32_t strands_per_triangle = 9;
+        float particle_separation = 0.08f;
+    };
+
+    // On-disk header. All offsets are in bytes from the start of the file and sizes of the state regions are in
+    // floats. The state is stored exactly as the GPU expects it: positions, velocities, packed root triangle indices
+    // and finally the barycentric coordinates.
+    struct HairAssetHeader
+    {
+        char magic[4];
+        uint32_t version;
+
+        uint32_t particles_per_strand;
+        uint32_t strands_per_triangle;
+        float particle_separation;
+        uint32_t index_type;
+
+        uint32_t num_root_vertices;
+        uint32_t num_root_indices;
+
+        uint32_t positions_size;
+        uint32_t velocities_size;
+        uint32_t tri_indices_size;
+        uint32_t barycentric_size;
+
+        uint64_t root_vertices_offset;
+        uint64_t root_indices_offset;
+        uint64_t state_offset;
+        uint64_t file_size;
+    };
+
+    // Pre-baked root mesh and initial particle state. Assets are either built in memory from an OBJ or mapped
+    // directly from a baked file, in both cases the data has the same layout as the file.
+    class HairAsset
+    {
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        HairAsset(const HairAsset&) = delete;
+
+        HairAsset() = default;
+        HairAsset(HairAsset&&) = default;
+        ~HairAsset() = default;
+
+        // Build from a root mesh.
+        HairAsset(const std::filesystem::path& obj_path, const HairAssetConfig& config);
+
+
+        HairAsset& operator=(const HairAsset&) = delete;
+        HairAsset& operator=(HairAsset&&) = default;
+
+
+        // Map a baked asset. Returns nothing if the file is missing, from a different version or malformed.
+        static std::optional<HairAsset> load(const std::filesystem::path& path);
+
+        // Write the asset to disk.
+        void save(const std::filesystem::path& path) const;
+
+
+        const HairAssetHeader& header() const { return *reinterpret_cast<const HairAssetHeader*>(data()); }
+
+        HairAssetConfig config() const;
+        RootIndexType index_type() const { return static_cast<RootIndexType>(header().index_type); }
+
+        const RootVertex* root_vertices() const { return section<RootVertex>(header().root_vertices_offset); }
+        uint32_t num_root_vertices() const { return header().num_root_vertices; }
+
+        const uint32_t* root_indices() const { return section<uint32_t>(header().root_indices_offset); }
+        uint32_t num_root_indices() const { return header().num_root_indices; }
+
+        const float* state() const { return section<float>(header().state_offset); }
+        uint32_t state_size() const;
+
+        size_t size_bytes() const { return file_ ? file_->size() : bytes_.size(); }
+
+    private:
+        static uint64_t state_size_of(const HairAssetHeader& header);
+
+        const std::byte* data() const { return file_ ? reinterpret_cast<const std::byte*>(file_->data()) : bytes_.data(); }
+
+        template <class T>
+        const T* section(uint64_t offset) const { return reinterpret_cast<const T*>(data() + offset); }
+
+        // Exactly one of these holds the data.
+        std::optional<MappedFile> file_;
+        std::vector<std::byte> bytes_;
+    };
+}
+
+#endif
@@ -1,9 +1,21 @@
+#include <cstring>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <fstream>
-#include <sstream>
 #include <unordered_map>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glm/geometric.hpp>
+
 #include "assert.hpp"
 #include "io.hpp"
+#include "thread_pool.hpp"
 #include "trace.hpp"
 
 
@@ -14,6 +26,7 @@ namespace vhs
 {
     std::vector<std::byte> load_bytes(const std::filesystem::path& path)
     {
+        VHS_TRACE_SCOPE(IO, "LoadBytes");
         VHS_TRACE(IO, "Loading bytes from file '{}'.", path.c_str());
 
         std::ifstream ifs { path, std::ios::ate | std::ios::binary };
@@ -38,70 +51,402 @@ namespace vhs
         return { str, str + bytes.size() };
     }
 
-    void load_obj(const std::filesystem::path& path, std::vector<RootVertex>& vertices, std::vector<uint16_t>& indices)
+    // Memory mapped files.
+    MappedFile::MappedFile(const std::filesystem::path& path)
     {
-        const auto str = load_string(path);
+        VHS_TRACE(IO, "Mapping file '{}'.", path.c_str());
 
-        VHS_TRACE(IO, "Parsing OBJ file '{}'.", path.c_str());
+        const auto fd = open(path.c_str(), O_RDONLY);
+        VHS_ASSERT(fd >= 0, "Failed to open file '{}'.", path.c_str());
 
-        std::vector<glm::vec3> positions, normals;
-        std::unordered_map<std::string, uint16_t> index_map;
+        struct stat st;
+        VHS_ASSERT(fstat(fd, &st) == 0, "Failed to stat file '{}'.", path.c_str());
+
+        size_ = st.st_size;
+
+        // Mapping zero bytes is an error so leave empty files unmapped.
+        if (size_)
+        {
+            data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            VHS_ASSERT(data_ != MAP_FAILED, "Failed to map file '{}'.", path.c_str());
+
+            // The file is always read front to back.
+            madvise(data_, size_, MADV_SEQUENTIAL);
+        }
 
-        std::istringstream ss { str };
+        close(fd);
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) :
+        data_ { other.data_ },
+        size_ { other.size_ }
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        unmap();
+    }
 
-        for (std::string line; std::getline(ss, line); )
+    MappedFile& MappedFile::operator=(MappedFile&& other)
+    {
+        if (this != &other)
         {
-            std::istringstream line_ss { line };
+            unmap();
+
+            data_ = other.data_;
+            size_ = other.size_;
+
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        return *this;
+    }
+
+    void MappedFile::unmap()
+    {
+        if (data_)
+            munmap(data_, size_);
+
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+
+    // OBJ parsing. The file is split into chunks at line boundaries which are parsed independently. Negative indices
+    // are relative to the number of elements seen so far, which isn't known until all earlier chunks are parsed, so
+    // these are stored relative to the start of the chunk and fixed up afterwards.
+
+    // Files smaller than this are always parsed on the calling thread.
+    static const size_t OBJ_CHUNK_SIZE = 1 << 20;
 
-            std::string start;
-            line_ss >> start;
+    // Sentinel for a face corner without a normal.
+    static const uint32_t OBJ_NO_NORMAL = UINT32_MAX;
 
-            if (start == "v")
+    struct ObjIndex
+    {
+        int32_t value = 0;
+        bool relative = false;
+        bool present = false;
+    };
+
+    struct ObjCorner
+    {
+        ObjIndex position;
+        ObjIndex normal;
+    };
+
+    struct ObjChunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+
+        // Triangulated faces, three corners per triangle.
+        std::vector<ObjCorner> corners;
+
+        uint32_t num_texcoords = 0;
+    };
+
+    static const char* obj_skip_spaces(const char* p, const char* end)
+    {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+
+        return p;
+    }
+
+    static const char* obj_parse_float(const char* p, const char* end, float& value)
+    {
+        p = obj_skip_spaces(p, end);
+
+        // from_chars doesn't accept an explicit plus sign.
+        if (p != end && *p == '+')
+            ++p;
+
+        const auto [ptr, ec] = std::from_chars(p, end, value);
+        VHS_ASSERT(ec == std::errc { }, "Failed to parse OBJ float '{}'.", std::string_view { p, (size_t)(end - p) });
+
+        return ptr;
+    }
+
+    static const char* obj_parse_vec3(const char* p, const char* end, glm::vec3& value)
+    {
+        p = obj_parse_float(p, end, value.x);
+        p = obj_parse_float(p, end, value.y);
+        p = obj_parse_float(p, end, value.z);
+
+        return p;
+    }
+
+    // Parse a one-based or negative index into a zero-based index, relative to the start of the chunk if negative.
+    static const char* obj_parse_index(const char* p, const char* end, uint32_t count, ObjIndex& index)
+    {
+        int32_t value = 0;
+
+        const auto [ptr, ec] = std::from_chars(p, end, value);
+        VHS_ASSERT(ec == std::errc { } && value, "Invalid OBJ index '{}'.", std::string_view { p, (size_t)(end - p) });
+
+        index.present = true;
+        index.relative = value < 0;
+        index.value = (value < 0) ? (int32_t)count + value : value - 1;
+
+        return ptr;
+    }
+
+    // Parse a corner in the form v, v/vt, v//vn or v/vt/vn. Texture coordinates aren't used so are only validated.
+    static const char* obj_parse_corner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+    {
+        p = obj_parse_index(p, end, chunk.positions.size(), corner.position);
+
+        if (p == end || *p != '/')
+            return p;
+
+        if (++p != end && *p != '/')
+        {
+            ObjIndex texcoord;
+            p = obj_parse_index(p, end, chunk.num_texcoords, texcoord);
+        }
+
+        if (p != end && *p == '/')
+            p = obj_parse_index(p + 1, end, chunk.normals.size(), corner.normal);
+
+        return p;
+    }
+
+    static void obj_parse_chunk(ObjChunk& chunk)
+    {
+        std::vector<ObjCorner> face;
+
+        for (const char* line = chunk.begin; line != chunk.end; )
+        {
+            auto* line_end = static_cast<const char*>(std::memchr(line, '\n', chunk.end - line));
+            auto* next = line_end ? line_end + 1 : chunk.end;
+
+            if (!line_end)
+                line_end = chunk.end;
+
+            auto* p = obj_skip_spaces(line, line_end);
+            const auto remaining = line_end - p;
+
+            const auto keyword = [&](const char* str, size_t len)
+            {
+                return remaining > (ptrdiff_t)len && std::memcmp(p, str, len) == 0 && (p[len] == ' ' || p[len] == '\t');
+            };
+
+            if (keyword("v", 1))
             {
                 glm::vec3 pos;
-                line_ss >> pos.x >> pos.y >> pos.z;
-                positions.push_back(pos);
+                obj_parse_vec3(p + 1, line_end, pos);
+                chunk.positions.push_back(pos);
             }
-            else if (start == "vn")
+            else if (keyword("vn", 2))
             {
                 glm::vec3 norm;
-                line_ss >> norm.x >> norm.y >> norm.z;
-                normals.push_back(norm);
+                obj_parse_vec3(p + 2, line_end, norm);
+                chunk.normals.push_back(norm);
+            }
+            else if (keyword("vt", 2))
+            {
+                ++chunk.num_texcoords;
+            }
+            else if (keyword("f", 1))
+            {
+                face.clear();
+
+                for (p = obj_skip_spaces(p + 1, line_end); p != line_end; p = obj_skip_spaces(p, line_end))
+                {
+                    ObjCorner corner;
+                    p = obj_parse_corner(p, line_end, chunk, corner);
+                    face.push_back(corner);
+                }
+
+                VHS_ASSERT(face.size() >= 3, "OBJ face with only {} vertices.", face.size());
+
+                // Triangulate n-gons as a fan around the first corner.
+                for (size_t i = 2; i < face.size(); ++i)
+                {
+                    chunk.corners.push_back(face[0]);
+                    chunk.corners.push_back(face[i - 1]);
+                    chunk.corners.push_back(face[i]);
+                }
             }
-            else if (start == "f")
+
+            line = next;
+        }
+    }
+
+    static uint32_t obj_resolve_index(const ObjIndex& index, uint32_t base, size_t count)
+    {
+        const auto value = index.value + (index.relative ? (int64_t)base : 0);
+        VHS_ASSERT(value >= 0 && (size_t)value < count, "OBJ index {} out of range [0, {}).", value, count);
+
+        return value;
+    }
+
+    void load_obj(const std::filesystem::path& path, std::vector<RootVertex>& vertices, std::vector<uint32_t>& indices,
+        ThreadPool* pool)
+    {
+        VHS_TRACE_SCOPE(IO, "LoadObj");
+
+        const auto start_time = std::chrono::steady_clock::now();
+
+        const MappedFile file { path };
+
+        VHS_TRACE(IO, "Parsing OBJ file '{}'.", path.c_str());
+
+        // Split the file into chunks at line boundaries.
+        std::vector<ObjChunk> chunks;
+
+        {
+            const auto num_chunks = pool ? std::max<size_t>(1, file.size() / OBJ_CHUNK_SIZE) : 1;
+            const auto chunk_size = file.size() / num_chunks;
+
+            const char* p = file.data();
+            const char* end = p + file.size();
+
+            for (size_t i = 0; i < num_chunks && p != end; ++i)
             {
-                std::string pair;
+                const char* chunk_end = end;
 
-                for (int i = 0; i < 3; ++i)
+                if (i + 1 < num_chunks && (size_t)(end - p) > chunk_size)
                 {
-                    line_ss >> pair;
+                    auto* newline = static_cast<const char*>(std::memchr(p + chunk_size, '\n', end - p - chunk_size));
+                    chunk_end = newline ? newline + 1 : end;
+                }
+
+                auto& chunk = chunks.emplace_back();
+
+                chunk.begin = p;
+                chunk.end = chunk_end;
+
+                p = chunk_end;
+            }
+        }
 
-                    uint16_t index;
-                    auto it = index_map.find(pair);
+        if (chunks.size() > 1)
+        {
+            pool->parallel_for(0, chunks.size(), 1, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto i = begin; i < end; ++i)
+                    obj_parse_chunk(chunks[i]);
+            });
+        }
+        else if (!chunks.empty())
+        {
+            obj_parse_chunk(chunks[0]);
+        }
 
-                    if (it == std::end(index_map))
-                    {
-                        size_t offset;
-                        const auto pos = std::stoi(pair, &offset) - 1;
-                        const auto norm = std::stoi(pair.c_str() + offset + 2) - 1;
+        // Gather the positions and normals from all the chunks.
+        std::vector<glm::vec3> positions, normals;
 
-                        RootVertex vert;
-                        vert.position = positions.at(pos);
-                        vert.normal = normals.at(norm);
+        for (const auto& chunk : chunks)
+        {
+            positions.insert(std::end(positions), std::begin(chunk.positions), std::end(chunk.positions));
+            normals.insert(std::end(normals), std::begin(chunk.normals), std::end(chunk.normals));
+        }
 
-                        vertices.push_back(vert);
-                        index = vertices.size() - 1;
+        // Resolve indices and deduplicate position and normal pairs into vertices, keeping the order of first use.
+        std::unordered_map<uint64_t, uint32_t> index_map;
+        std::vector<bool> missing_normal;
 
-                        index_map[pair] = index;
-                    }
-                    else
-                    {
-                        index = it->second;
-                    }
+        index_map.reserve(positions.size());
 
-                    indices.push_back(index);
+        const auto first_index = indices.size();
+        uint32_t position_base = 0, normal_base = 0;
+
+        for (const auto& chunk : chunks)
+        {
+            for (const auto& corner : chunk.corners)
+            {
+                const auto pos = obj_resolve_index(corner.position, position_base, positions.size());
+                const auto norm = corner.normal.present ? obj_resolve_index(corner.normal, normal_base, normals.size()) : OBJ_NO_NORMAL;
+
+                const auto key = ((uint64_t)pos << 32) | norm;
+                auto it = index_map.find(key);
+
+                if (it == std::end(index_map))
+                {
+                    RootVertex vert;
+                    vert.position = positions[pos];
+                    vert.normal = (norm == OBJ_NO_NORMAL) ? glm::vec3 { 0 } : normals[norm];
+
+                    vertices.push_back(vert);
+                    missing_normal.resize(vertices.size(), false);
+                    missing_normal.back() = norm == OBJ_NO_NORMAL;
+
+                    it = index_map.emplace(key, vertices.size() - 1).first;
                 }
+
+                indices.push_back(it->second);
             }
+
+            position_base += chunk.positions.size();
+            normal_base += chunk.normals.size();
         }
+
+        // Vertices without normals take the area weighted average of the triangles using them.
+        if (std::find(std::begin(missing_normal), std::end(missing_normal), true) != std::end(missing_normal))
+        {
+            for (auto i = first_index; i < indices.size(); i += 3)
+            {
+                const auto& a = vertices[indices[i + 0]];
+                const auto& b = vertices[indices[i + 1]];
+                const auto& c = vertices[indices[i + 2]];
+
+                const auto normal = glm::cross(b.position - a.position, c.position - a.position);
+
+                for (const auto index : { indices[i + 0], indices[i + 1], indices[i + 2] })
+                {
+                    if (missing_normal[index])
+                        vertices[index].normal += normal;
+                }
+            }
+
+            for (size_t i = 0; i < vertices.size(); ++i)
+            {
+                if (missing_normal[i] && glm::dot(vertices[i].normal, vertices[i].normal) > 0)
+                    vertices[i].normal = glm::normalize(vertices[i].normal);
+            }
+        }
+
+        const auto elapsed = std::chrono::duration<double, std::milli> { std::chrono::steady_clock::now() - start_time };
+
+        VHS_TRACE(IO, "Parsed {} vertices and {} indices from {} chunks in {:.3f} ms.", vertices.size(),
+            indices.size() - first_index, chunks.size(), elapsed.count());
+    }
+
+
+    // Root index packing.
+    size_t packed_root_indices_size(RootIndexType type, size_t num_indices)
+    {
+        return (type == RootIndexType::UINT32) ? num_indices : (num_indices + 1) / 2;
+    }
+
+    size_t pack_root_indices(RootIndexType type, const std::vector<uint32_t>& indices, uint32_t* words)
+    {
+        const auto num_words = packed_root_indices_size(type, indices.size());
+
+        if (type == RootIndexType::UINT32)
+        {
+            std::copy(std::begin(indices), std::end(indices), words);
+            return num_words;
+        }
+
+        // Even indices go in the low half of each word, matching the little endian layout of a uint16_t array.
+        std::fill(words, words + num_words, 0);
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            VHS_ASSERT(indices[i] <= UINT16_MAX, "Root index {} doesn't fit in 16 bits.", indices[i]);
+            words[i / 2] |= indices[i] << (16 * (i & 1));
+        }
+
+        return num_words;
     }
 }
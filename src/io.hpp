@@ -2,6 +2,8 @@
 #define VHS_IO_HPP
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <vector>
 
@@ -12,6 +14,7 @@
 namespace vhs
 {
     class GraphicsContext;
+    class ThreadPool;
 
     // Keyboard and mouse state.
     class KeyboardState
@@ -75,7 +78,54 @@ namespace vhs
         glm::vec3 normal;
     };
 
-    void load_obj(const std::filesystem::path& path, std::vector<RootVertex>& vertices, std::vector<uint16_t>& indices);
+    // Read-only memory mapping of an entire file.
+    class MappedFile
+    {
+    public:
+        MappedFile(const MappedFile&) = delete;
+
+        MappedFile() = default;
+        MappedFile(MappedFile&& other);
+        MappedFile(const std::filesystem::path& path);
+        ~MappedFile();
+
+
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile& operator=(MappedFile&& other);
+
+
+        const char* data() const { return static_cast<const char*>(data_); }
+        size_t size() const { return size_; }
+
+    private:
+        void unmap();
+
+        void* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Load a triangulated mesh from an OBJ file. Faces may be n-gons in any of the v, v/vt, v//vn or v/vt/vn forms
+    // and indices may be negative. Vertices without a normal are given the average of the adjacent face normals.
+    // When a pool is provided large files are parsed in chunks across its workers.
+    void load_obj(const std::filesystem::path& path, std::vector<RootVertex>& vertices, std::vector<uint32_t>& indices,
+        ThreadPool* pool = nullptr);
+
+    // Width of root mesh indices when packed into GPU buffers. Meshes with few enough vertices store two 16-bit
+    // indices per 32-bit word.
+    enum class RootIndexType
+    {
+        UINT16,
+        UINT32
+    };
+
+    inline RootIndexType select_root_index_type(size_t num_vertices)
+    {
+        return (num_vertices <= UINT16_MAX + 1) ? RootIndexType::UINT16 : RootIndexType::UINT32;
+    }
+
+    // Pack indices into 32-bit words using the given index type, returning the number of words written.
+    size_t pack_root_indices(RootIndexType type, const std::vector<uint32_t>& indices, uint32_t* words);
+    size_t packed_root_indices_size(RootIndexType type, size_t num_indices);
 }
 
 #endif
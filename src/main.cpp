@@ -1,6 +1,10 @@
 #include <cmath>
 
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/mat4x4.hpp>
@@ -15,6 +19,7 @@
 #include "image.hpp"
 #include "image_view.hpp"
 #include "pipeline.hpp"
+#include "simulator_cpu.hpp"
 #include "simulator_optimised_gpu.hpp"
 #include "trace.hpp"
 
@@ -105,17 +110,83 @@ static void test_compute(vhs::GraphicsContext& context)
     VHS_TRACE(MAIN, "Compute test complete, resuming normal operation.");
 }
 
-int main()
+// Options parsed from the command line.
+struct Options
 {
+    bool cpu = false;
+    bool headless = false;
+    bool timeline = false;
+
+    // Passed through to the optimised GPU simulator.
+    vhs::SimulatorConfig sim;
+
+    // Number of frames to render before exiting, zero runs until the window is closed.
+    uint32_t num_frames = 0;
+};
+
+// Headless runs have no window to close so always stop after a fixed number of frames.
+static const uint32_t DEFAULT_HEADLESS_FRAMES = 600;
+
+static Options parse_options(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--cpu") == 0)
+            options.cpu = true;
+        else if (std::strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (std::strcmp(argv[i], "--timeline") == 0)
+            options.timeline = true;
+        else if (std::strcmp(argv[i], "--compute-raster") == 0)
+            options.sim.compute_raster = true;
+        else if (std::strcmp(argv[i], "--instanced") == 0)
+            options.sim.instanced_strands = true;
+        else if (std::strcmp(argv[i], "--occlusion") == 0)
+            options.sim.occlusion_culling = true;
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            options.num_frames = std::strtoul(argv[++i], nullptr, 10);
+        else
+            VHS_TRACE(MAIN, "Ignoring unknown argument '{}'.", argv[i]);
+    }
+
+    if (options.headless && !options.num_frames)
+        options.num_frames = DEFAULT_HEADLESS_FRAMES;
+
+    return options;
+}
+
+static std::unique_ptr<vhs::Simulator> create_simulator(const Options& options, vhs::GraphicsContext& context, vhs::Camera& camera)
+{
+    // The simulator can be selected on the command line, defaulting to the optimised GPU implementation.
+    if (options.cpu)
+        return std::make_unique<vhs::SimulatorCpu>(context, camera);
+
+    return std::make_unique<vhs::SimulatorOptimisedGpu>(context, camera, options.sim);
+}
+
+int main(int argc, char** argv)
+{
+    vhs::set_trace_thread_name("main");
+
     VHS_TRACE(MAIN, "Starting initialisation.");
 
-    vhs::GraphicsContext context;
+    const auto options = parse_options(argc, argv);
+
+    vhs::GraphicsContextConfig context_config;
+
+    context_config.headless = options.headless;
+    context_config.sync_mode = options.timeline ? vhs::SyncMode::TIMELINE : vhs::SyncMode::FENCES;
+
+    vhs::GraphicsContext context { context_config };
 
     test_compute(context);
 
     vhs::Camera camera { context.viewport().extent.width, context.viewport().extent.height, glm::vec3 { -0.75f, -0.25f, 0.0f } };
 
-    vhs::SimulatorOptimisedGpu sim { context, camera };
+    auto sim_ptr = create_simulator(options, context, camera);
+    auto& sim = *sim_ptr;
 
     VHS_TRACE(MAIN, "Initialisation complete, entering main loop.");
 
@@ -124,16 +195,21 @@ int main()
 
     auto prev_mouse = context.mouse_state();
 
-    double previous_time = glfwGetTime();
+    // GLFW isn't initialised in headless mode so use the standard clock for timing.
+    using Clock = std::chrono::steady_clock;
+
+    auto previous_time = Clock::now();
     double latency_time = 0;
 
     bool prev_ui_active = sim.ui_active();
 
+    uint32_t frame_count = 0;
+
     while (context.is_window_open())
     {
         // Calculate time since last iteration and add to latency accumulator.
-        const auto current_time = glfwGetTime();
-        const auto elapsed_time = current_time - previous_time;
+        const auto current_time = Clock::now();
+        const auto elapsed_time = std::chrono::duration<double> { current_time - previous_time }.count();
 
         previous_time = current_time;
         latency_time += elapsed_time;
@@ -167,18 +243,37 @@ int main()
         sim.process_input(keyboard);
 
         // Catch up in fixed-step updates.
-        while (latency_time > seconds_per_tick)
         {
-            sim.update(seconds_per_tick);
-            latency_time -= seconds_per_tick;
+            VHS_TRACE_SCOPE(MAIN, "CatchUp");
+
+            uint32_t ticks = 0;
+
+            while (latency_time > seconds_per_tick)
+            {
+                sim.update(seconds_per_tick);
+                latency_time -= seconds_per_tick;
+                ticks++;
+            }
+
+            VHS_TRACE_COUNTER(MAIN, "TicksPerFrame", ticks);
         }
 
         // Grab the frame for rendering and ask the simulator to draw it.
-        auto& frame = context.begin_frame();
+        {
+            VHS_TRACE_SCOPE(MAIN, "Frame");
+
+            auto& frame = context.begin_frame();
 
-        sim.draw(frame, latency_time * ticks_per_second);
+            sim.draw(frame, latency_time * ticks_per_second);
 
-        context.end_frame();
+            context.end_frame();
+        }
+
+        if (options.num_frames && ++frame_count == options.num_frames)
+        {
+            VHS_TRACE(MAIN, "Rendered {} frames, exiting.", frame_count);
+            context.close_window();
+        }
     }
 
     context.wait_idle();
@@ -16,6 +16,7 @@ namespace vhs
         context_ { &context },
         pass_ { &pass }
     {
+        VHS_TRACE_SCOPE(PIPELINE, "CreateGraphicsPipeline");
         VHS_TRACE(PIPELINE, "Creating graphics pipeline '{}' using render pass '{}'.", name, pass.name());
 
         // Convert from our configuration structures into Vulkan versions where appropriate.
@@ -42,6 +43,13 @@ namespace vhs
             VkPipelineColorBlendAttachmentState state { };
 
             state.colorWriteMask = c.colour_write_mask;
+            state.blendEnable = c.blend;
+            state.srcColorBlendFactor = c.src_blend_factor;
+            state.dstColorBlendFactor = c.dst_blend_factor;
+            state.colorBlendOp = VK_BLEND_OP_ADD;
+            state.srcAlphaBlendFactor = c.src_blend_factor;
+            state.dstAlphaBlendFactor = c.dst_blend_factor;
+            state.alphaBlendOp = VK_BLEND_OP_ADD;
 
             colour_blends.push_back(state);
         }
@@ -131,13 +139,14 @@ namespace vhs
         create_info.subpass = 0;
         create_info.layout = layout_;
 
-        VHS_CHECK_VK(vkCreateGraphicsPipelines(context.vk_device(), VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline_));
+        VHS_CHECK_VK(vkCreateGraphicsPipelines(context.vk_device(), context.vk_pipeline_cache(), 1, &create_info, nullptr, &pipeline_));
     }
 
     Pipeline::Pipeline(std::string_view name, GraphicsContext& context, const ComputePipelineConfig& config) :
         name_ { name },
         context_ { &context }
     {
+        VHS_TRACE_SCOPE(PIPELINE, "CreateComputePipeline");
         VHS_TRACE(PIPELINE, "Creating compute pipeline '{}' using shader '{}'.", name, config.shader_module->name());
         VHS_ASSERT(config.shader_module->stage() & VK_SHADER_STAGE_COMPUTE_BIT, "Attempted to create compute pipeline with non-compute shader.");
 
@@ -151,12 +160,39 @@ namespace vhs
 
         VHS_CHECK_VK(vkCreatePipelineLayout(context.vk_device(), &layout_info, nullptr, &layout_));
 
+        // Pack the specialisation constants one after the other.
+        std::vector<VkSpecializationMapEntry> map_entries;
+        std::vector<uint32_t> values;
+
+        map_entries.reserve(config.specialisation_constants.size());
+        values.reserve(config.specialisation_constants.size());
+
+        for (const auto& c : config.specialisation_constants)
+        {
+            VkSpecializationMapEntry entry { };
+
+            entry.constantID = c.id;
+            entry.offset = sizeof(uint32_t) * values.size();
+            entry.size = sizeof(uint32_t);
+
+            map_entries.push_back(entry);
+            values.push_back(c.value);
+        }
+
+        VkSpecializationInfo specialisation_info { };
+
+        specialisation_info.mapEntryCount = map_entries.size();
+        specialisation_info.pMapEntries = map_entries.data();
+        specialisation_info.dataSize = sizeof(uint32_t) * values.size();
+        specialisation_info.pData = values.data();
+
         VkPipelineShaderStageCreateInfo stage_info { };
 
         stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         stage_info.stage = static_cast<VkShaderStageFlagBits>(config.shader_module->stage());
         stage_info.module = config.shader_module->vk_shader_module();
         stage_info.pName = "main";
+        stage_info.pSpecializationInfo = map_entries.empty() ? nullptr : &specialisation_info;
 
         VkComputePipelineCreateInfo create_info { };
 
@@ -164,7 +200,7 @@ namespace vhs
         create_info.stage = stage_info;
         create_info.layout = layout_;
 
-        VHS_CHECK_VK(vkCreateComputePipelines(context.vk_device(), VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline_));
+        VHS_CHECK_VK(vkCreateComputePipelines(context.vk_device(), context.vk_pipeline_cache(), 1, &create_info, nullptr, &pipeline_));
     }
 
     Pipeline::Pipeline(Pipeline&& other) :
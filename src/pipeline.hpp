@@ -1,6 +1,8 @@
 #ifndef VHS_PIPELINE_HPP
 #define VHS_PIPELINE_HPP
 
+#include <cstdint>
+
 #include <string>
 #include <string_view>
 #include <vector>
@@ -18,6 +20,11 @@ namespace vhs
     {
         VkColorComponentFlags colour_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
             | VK_COLOR_COMPONENT_A_BIT;
+
+        // Blending sums the scaled source and destination, using the same factors for colour and alpha.
+        VkBool32 blend = VK_FALSE;
+        VkBlendFactor src_blend_factor = VK_BLEND_FACTOR_ONE;
+        VkBlendFactor dst_blend_factor = VK_BLEND_FACTOR_ZERO;
     };
 
     struct GraphicsPipelineConfig
@@ -39,10 +46,18 @@ namespace vhs
         VkRect2D viewport;
     };
 
+    // Value for a specialisation constant. Everything is passed as 32 bits so bools and floats need converting first.
+    struct SpecialisationConstant
+    {
+        uint32_t id;
+        uint32_t value;
+    };
+
     struct ComputePipelineConfig
     {
         std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
         std::vector<VkPushConstantRange> push_constants;
+        std::vector<SpecialisationConstant> specialisation_constants;
         ShaderModule* shader_module;
     };
 
@@ -0,0 +1,249 @@
+#include <cstring>
+
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "assert.hpp"
+#include "graphics_context.hpp"
+#include "pipeline_cache.hpp"
+#include "trace.hpp"
+
+
+VHS_TRACE_DEFINE(PIPELINE_CACHE);
+
+
+namespace vhs
+{
+    namespace
+    {
+        // Written ahead of the driver's data. The driver also puts the device in its own header but is allowed to
+        // misbehave on data it didn't write, so everything is checked before the data gets anywhere near it.
+        struct PipelineCacheFileHeader
+        {
+            static constexpr uint32_t MAGIC = 0x50534856; // VHSP
+            static constexpr uint32_t VERSION = 1;
+
+            uint32_t magic;
+            uint32_t version;
+            uint32_t vendor_id;
+            uint32_t device_id;
+            uint32_t driver_version;
+            uint8_t uuid[VK_UUID_SIZE];
+            uint32_t reserved;
+            uint64_t data_size;
+            uint64_t checksum;
+        };
+
+        // Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE.
+        struct DriverCacheHeader
+        {
+            uint32_t size;
+            uint32_t version;
+            uint32_t vendor_id;
+            uint32_t device_id;
+            uint8_t uuid[VK_UUID_SIZE];
+        };
+
+        // FNV-1a, enough to catch truncated or partially written files.
+        uint64_t checksum(const std::byte* data, size_t size)
+        {
+            uint64_t hash = 0xcbf29ce484222325ull;
+
+            for (size_t i = 0; i < size; ++i)
+                hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3ull;
+
+            return hash;
+        }
+
+        PipelineCacheFileHeader file_header(const VkPhysicalDeviceProperties& properties)
+        {
+            PipelineCacheFileHeader header { };
+
+            header.magic = PipelineCacheFileHeader::MAGIC;
+            header.version = PipelineCacheFileHeader::VERSION;
+            header.vendor_id = properties.vendorID;
+            header.device_id = properties.deviceID;
+            header.driver_version = properties.driverVersion;
+            std::memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+            return header;
+        }
+
+        // Load the driver data from the file, returning nothing if it's missing or stale.
+        std::vector<std::byte> load_cache_data(const std::filesystem::path& path, const VkPhysicalDeviceProperties& properties)
+        {
+            std::ifstream ifs { path, std::ios::binary };
+
+            if (!ifs)
+            {
+                VHS_TRACE(PIPELINE_CACHE, "No pipeline cache at '{}'.", path.c_str());
+                return { };
+            }
+
+            const auto reject = [&](const char* reason)
+            {
+                VHS_TRACE(PIPELINE_CACHE, "Discarding pipeline cache '{}': {}.", path.c_str(), reason);
+                return std::vector<std::byte> { };
+            };
+
+            PipelineCacheFileHeader header;
+
+            if (!ifs.read(reinterpret_cast<char*>(&header), sizeof header))
+                return reject("truncated header");
+
+            const auto expected = file_header(properties);
+
+            if (header.magic != expected.magic || header.version != expected.version)
+                return reject("unknown format");
+
+            if (header.vendor_id != expected.vendor_id || header.device_id != expected.device_id
+                || header.driver_version != expected.driver_version || std::memcmp(header.uuid, expected.uuid, VK_UUID_SIZE))
+            {
+                return reject("different device or driver");
+            }
+
+            // Check the size against what's left of the file before allocating, a corrupt header could ask for anything.
+            const std::streamoff data_start = ifs.tellg();
+            ifs.seekg(0, std::ios::end);
+            const std::streamoff data_end = ifs.tellg();
+            ifs.seekg(data_start);
+
+            if (header.data_size < sizeof(DriverCacheHeader) || data_start < 0 || data_end < data_start
+                || header.data_size > static_cast<uint64_t>(data_end - data_start))
+            {
+                return reject("truncated data");
+            }
+
+            std::vector<std::byte> data(header.data_size);
+
+            if (!ifs.read(reinterpret_cast<char*>(data.data()), data.size()))
+                return reject("truncated data");
+
+            if (checksum(data.data(), data.size()) != header.checksum)
+                return reject("checksum mismatch");
+
+            DriverCacheHeader driver;
+            std::memcpy(&driver, data.data(), sizeof driver);
+
+            if (driver.size < sizeof driver || driver.version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                || driver.vendor_id != properties.vendorID || driver.device_id != properties.deviceID
+                || std::memcmp(driver.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE))
+            {
+                return reject("driver header mismatch");
+            }
+
+            return data;
+        }
+    }
+
+
+    PipelineCache::PipelineCache(std::string_view name, GraphicsContext& context, const std::filesystem::path& directory) :
+        name_ { name },
+        context_ { &context }
+    {
+        const auto& properties = context.physical_device_properties();
+
+        // One file per cache UUID and driver version.
+        std::string uuid;
+
+        for (const auto byte : properties.pipelineCacheUUID)
+            uuid += fmt::format(FMT_STRING("{:02x}"), byte);
+
+        path_ = directory / fmt::format(FMT_STRING("pipelines-{}-{:08x}.bin"), uuid, properties.driverVersion);
+
+        const auto data = load_cache_data(path_, properties);
+
+        VHS_TRACE(PIPELINE_CACHE, "Creating '{}' with {} bytes from '{}'.", name, data.size(), path_.c_str());
+
+        VkPipelineCacheCreateInfo create_info { };
+
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = data.size();
+        create_info.pInitialData = data.empty() ? nullptr : data.data();
+
+        VHS_CHECK_VK(vkCreatePipelineCache(context.vk_device(), &create_info, nullptr, &cache_));
+    }
+
+    PipelineCache::PipelineCache(PipelineCache&& other) :
+        name_ { std::move(other.name_) },
+        context_ { std::move(other.context_) },
+        cache_ { std::move(other.cache_) },
+        path_ { std::move(other.path_) }
+    {
+        other.cache_ = VK_NULL_HANDLE;
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        if (cache_)
+        {
+            save();
+
+            VHS_TRACE(PIPELINE_CACHE, "Destroying '{}'.", name_);
+            vkDestroyPipelineCache(context_->vk_device(), cache_, nullptr);
+        }
+    }
+
+
+    PipelineCache& PipelineCache::operator=(PipelineCache&& other)
+    {
+        name_ = std::move(other.name_);
+        context_ = std::move(other.context_);
+        cache_ = std::move(other.cache_);
+        path_ = std::move(other.path_);
+
+        other.cache_ = VK_NULL_HANDLE;
+
+        return *this;
+    }
+
+
+    // Failing to save only costs the next run some time so problems are traced rather than asserted.
+    void PipelineCache::save() const
+    {
+        size_t size = 0;
+        VHS_CHECK_VK(vkGetPipelineCacheData(context_->vk_device(), cache_, &size, nullptr));
+
+        std::vector<std::byte> data(size);
+        VHS_CHECK_VK(vkGetPipelineCacheData(context_->vk_device(), cache_, &size, data.data()));
+        data.resize(size);
+
+        auto header = file_header(context_->physical_device_properties());
+
+        header.data_size = data.size();
+        header.checksum = checksum(data.data(), data.size());
+
+        std::error_code error;
+        std::filesystem::create_directories(path_.parent_path(), error);
+
+        // Write beside the real file and rename so concurrent runs never see a partial cache.
+        auto temp_path = path_;
+        temp_path += fmt::format(FMT_STRING(".{}.tmp"), getpid());
+
+        {
+            std::ofstream ofs { temp_path, std::ios::binary | std::ios::trunc };
+
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof header);
+            ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+            if (!ofs)
+            {
+                VHS_TRACE(PIPELINE_CACHE, "Failed to write pipeline cache '{}'.", temp_path.c_str());
+                std::filesystem::remove(temp_path, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temp_path, path_, error);
+
+        if (error)
+            VHS_TRACE(PIPELINE_CACHE, "Failed to replace pipeline cache '{}': {}.", path_.c_str(), error.message());
+        else
+            VHS_TRACE(PIPELINE_CACHE, "Saved {} bytes to '{}'.", data.size(), path_.c_str());
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef VHS_PIPELINE_CACHE_HPP
+#define VHS_PIPELINE_CACHE_HPP
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <vulkan/vulkan.h>
+
+
+namespace vhs
+{
+    class GraphicsContext;
+
+    // VkPipelineCache persisted to a file in the given directory. The file is named after the device's cache UUID and
+    // driver version so several devices or drivers can share the directory, and anything that doesn't match the device
+    // exactly is thrown away rather than handed to the driver.
+    class PipelineCache
+    {
+    public:
+        PipelineCache() = default;
+        PipelineCache(const PipelineCache&) = delete;
+
+        PipelineCache(std::string_view name, GraphicsContext& context, const std::filesystem::path& directory);
+        PipelineCache(PipelineCache&& other);
+        ~PipelineCache();
+
+
+        PipelineCache& operator=(const PipelineCache&) = delete;
+
+        PipelineCache& operator=(PipelineCache&& other);
+
+
+        // Write the cache back to disk. Called on destruction but can be done earlier once startup is complete.
+        void save() const;
+
+
+        VkPipelineCache vk_pipeline_cache() const { return cache_; }
+        const std::filesystem::path& path() const { return path_; }
+
+    private:
+        std::string name_;
+        GraphicsContext* context_ = nullptr;
+        VkPipelineCache cache_ = VK_NULL_HANDLE;
+        std::filesystem::path path_;
+    };
+}
+
+#endif
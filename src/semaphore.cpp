@@ -22,10 +22,32 @@ namespace vhs
         VHS_CHECK_VK(vkCreateSemaphore(context.vk_device(), &create_info, nullptr, &semaphore_));
     }
 
+    Semaphore::Semaphore(std::string_view name, GraphicsContext& context, uint64_t initial_value) :
+        name_ { name },
+        context_ { &context },
+        timeline_ { true }
+    {
+        VHS_TRACE(SEMAPHORE, "Creating timeline '{}' with initial value {}.", name, initial_value);
+
+        VkSemaphoreTypeCreateInfo type_info { };
+
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = initial_value;
+
+        VkSemaphoreCreateInfo create_info { };
+
+        create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        create_info.pNext = &type_info;
+
+        VHS_CHECK_VK(vkCreateSemaphore(context.vk_device(), &create_info, nullptr, &semaphore_));
+    }
+
     Semaphore::Semaphore(Semaphore&& other) :
         name_ { std::move(other.name_) },
         context_ { std::move(other.context_) },
-        semaphore_ { std::move(other.semaphore_) }
+        semaphore_ { std::move(other.semaphore_) },
+        timeline_ { other.timeline_ }
     {
         other.semaphore_ = VK_NULL_HANDLE;
     }
@@ -45,9 +67,36 @@ namespace vhs
         name_ = std::move(other.name_);
         context_ = std::move(other.context_);
         semaphore_ = std::move(other.semaphore_);
+        timeline_ = other.timeline_;
 
         other.semaphore_ = VK_NULL_HANDLE;
 
         return *this;
     }
+
+
+    void Semaphore::wait(uint64_t value, uint64_t timeout) const
+    {
+        VHS_ASSERT(timeline_, "Host wait on binary semaphore '{}'.", name_);
+        VHS_TRACE_VERBOSE(SEMAPHORE, "Waiting on '{}' for value {}.", name_, value);
+
+        VkSemaphoreWaitInfo wait_info { };
+
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &semaphore_;
+        wait_info.pValues = &value;
+
+        VHS_CHECK_VK(vkWaitSemaphores(context_->vk_device(), &wait_info, timeout));
+    }
+
+    uint64_t Semaphore::value() const
+    {
+        VHS_ASSERT(timeline_, "Queried value of binary semaphore '{}'.", name_);
+
+        uint64_t value = 0;
+        VHS_CHECK_VK(vkGetSemaphoreCounterValue(context_->vk_device(), semaphore_, &value));
+
+        return value;
+    }
 }
@@ -11,7 +11,8 @@ namespace vhs
 {
     class GraphicsContext;
 
-    // VkSemaphore wrapper.
+    // VkSemaphore wrapper. Semaphores are binary unless created with an initial value, in which case they are timeline
+    // semaphores that can be waited on and queried from the host.
     class Semaphore
     {
     public:
@@ -19,6 +20,7 @@ namespace vhs
         Semaphore(const Semaphore&) = delete;
 
         Semaphore(std::string_view name, GraphicsContext& context);
+        Semaphore(std::string_view name, GraphicsContext& context, uint64_t initial_value);
         Semaphore(Semaphore&& other);
         ~Semaphore();
 
@@ -29,11 +31,17 @@ namespace vhs
 
 
         VkSemaphore vk_semaphore() const { return semaphore_; }
+        bool is_timeline() const { return timeline_; }
+
+        // Timeline semaphore operations.
+        void wait(uint64_t value, uint64_t timeout = UINT64_MAX) const;
+        uint64_t value() const;
 
     private:
         std::string name_;
         GraphicsContext* context_ = nullptr;
         VkSemaphore semaphore_ = VK_NULL_HANDLE;
+        bool timeline_ = false;
     };
 }
 
@@ -77,7 +77,10 @@ namespace vhs
         init_info.MinImageCount = context_->min_num_swapchain_images();
         init_info.CheckVkResultFn = imgui_check_vk;
 
-        ImGui_ImplGlfw_InitForVulkan(context_->glfw_window(), true);
+        // There's no window to take input from when headless.
+        if (!context_->headless())
+            ImGui_ImplGlfw_InitForVulkan(context_->glfw_window(), true);
+
         ImGui_ImplVulkan_Init(&init_info, pass.vk_render_pass());
 
         context_->upload_imgui_fonts();
@@ -89,6 +92,28 @@ namespace vhs
         VHS_TRACE(SIMULATOR, "Terminating ImGui.");
 
         ImGui_ImplVulkan_Shutdown();
+
+        if (!context_->headless())
+            ImGui_ImplGlfw_Shutdown();
+
         ImGui::DestroyContext();
     }
+
+    void Simulator::imgui_new_frame()
+    {
+        ImGui_ImplVulkan_NewFrame();
+
+        // Without the GLFW backend the display size needs to be provided manually.
+        if (context_->headless())
+        {
+            const auto extent = context_->viewport().extent;
+            ImGui::GetIO().DisplaySize = ImVec2 { (float)extent.width, (float)extent.height };
+        }
+        else
+        {
+            ImGui_ImplGlfw_NewFrame();
+        }
+
+        ImGui::NewFrame();
+    }
 }
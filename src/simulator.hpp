@@ -1,7 +1,13 @@
 #ifndef VHS_SIMULATOR_HPP
 #define VHS_SIMULATOR_HPP
 
+#include <cstddef>
+#include <cstdint>
+
+#include <filesystem>
+
 #include "descriptor_pool.hpp"
+#include "hair_asset.hpp"
 #include "trace.hpp"
 
 
@@ -16,6 +22,47 @@ namespace vhs
     class RenderPass;
     struct FrameData;
 
+    // Initial hair parameters, the defaults are what the interactive application uses.
+    struct SimulatorConfig
+    {
+        // Root mesh to grow the strands from. The baked asset is mapped instead if it was built with the same parameters.
+        std::filesystem::path root_mesh = "data/obj/root.obj";
+        std::filesystem::path baked_asset = "data/obj/root.hair";
+
+        HairAssetConfig hair;
+
+        uint32_t ftl_iterations = 5;
+        uint32_t smooth_factor = 1;
+
+        // Workgroup size for the compute kernels, zero to use the context's choice for the device.
+        uint32_t compute_local_size = 0;
+
+        // Build the strands in the vertex shader straight from the particles instead of expanding them into a vertex
+        // buffer first. Saves a dispatch and the vertex buffer but the update can no longer overlap the draw.
+        bool vertex_pulling = false;
+
+        // Draw each strand as an instance of a single strip rather than through an index buffer with primitive restarts.
+        // There is no index buffer to build or upload, so changing the smooth factor costs nothing.
+        bool instanced_strands = false;
+
+        // Rasterise the strands in compute, binned into screen tiles with the coverage of each pixel worked out from the
+        // distance to the strand, then composite them over the frame. Scales better than the fixed function rasteriser
+        // when strands are thinner than a pixel. Needs the created vertices so is ignored when pulling vertices.
+        bool compute_raster = false;
+
+        // Segments the compute rasteriser can bin across all its tiles, zero for two tiles per segment at the largest
+        // smooth factor. Anything past the pool is dropped and traced.
+        uint32_t raster_tile_pool_size = 0;
+
+        // Skip root triangles whose strands are outside the view, or further than the cull distance when it's non-zero.
+        bool cull_strands = true;
+        float cull_distance = 0.0f;
+
+        // Draw the root mesh's depth before the hair and also skip root triangles hidden behind it. The test is against
+        // the previous frame's depth so a triangle can show up a frame late.
+        bool occlusion_culling = false;
+    };
+
     // Base class for various simulator implementations.
     class Simulator
     {
@@ -45,11 +92,18 @@ namespace vhs
         // Whether the camera should be updated by the main loop.
         virtual bool ui_active() const { return false; }
 
+        // Size of the simulation, used when benchmarking.
+        virtual uint32_t num_particles() const = 0;
+        virtual size_t memory_footprint() const = 0;
+
     protected:
         // ImGui management.
         void initialise_imgui(RenderPass& pass);
         void terminate_imgui();
 
+        // Start a new ImGui frame for the window, or for the offscreen images when headless.
+        void imgui_new_frame();
+
         GraphicsContext* context_ = nullptr;
         Camera* camera_ = nullptr;
 
@@ -0,0 +1,595 @@
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec4.hpp>
+#include <imgui/imgui.h>
+#include <imgui/backends/imgui_impl_vulkan.h>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define VHS_SIMD_AVX2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VHS_SIMD_NEON 1
+#endif
+
+#include "assert.hpp"
+#include "camera.hpp"
+#include "command_buffer.hpp"
+#include "graphics_context.hpp"
+#include "simulator_cpu.hpp"
+
+
+namespace vhs
+{
+    // Number of strands or root triangles handed to a worker at once.
+    static const uint32_t UPDATE_STRANDS_PER_TASK = 64;
+    static const uint32_t VERTEX_TRIANGLES_PER_TASK = 16;
+
+
+    // Vectorised kernels over the SoA arrays. Each handles a single axis and falls back to scalar code for the tail
+    // or when no vector extension is available.
+
+    // p[i] = p[i] + v[i] * dt + f * dt^2
+    static void integrate_positions(float* p, const float* v, float f, float dt, float dt_sq, uint32_t count)
+    {
+        const auto a = f * dt_sq;
+
+        uint32_t i = 0;
+
+#if defined(VHS_SIMD_AVX2)
+        const auto dt8 = _mm256_set1_ps(dt);
+        const auto a8 = _mm256_set1_ps(a);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            const auto p8 = _mm256_add_ps(_mm256_loadu_ps(p + i), a8);
+            _mm256_storeu_ps(p + i, _mm256_fmadd_ps(_mm256_loadu_ps(v + i), dt8, p8));
+        }
+#elif defined(VHS_SIMD_NEON)
+        const auto dt4 = vdupq_n_f32(dt);
+        const auto a4 = vdupq_n_f32(a);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const auto p4 = vaddq_f32(vld1q_f32(p + i), a4);
+            vst1q_f32(p + i, vmlaq_f32(p4, vld1q_f32(v + i), dt4));
+        }
+#endif
+
+        for (; i < count; ++i)
+            p[i] = p[i] + v[i] * dt + a;
+    }
+
+    // v[i] = (p[i] - o[i]) * dt_inv + (p[i + 1] - q[i + 1]) * damping
+    static void update_velocities(float* v, const float* p, const float* o, const float* q, float dt_inv, float damping, uint32_t count)
+    {
+        uint32_t i = 0;
+
+#if defined(VHS_SIMD_AVX2)
+        const auto dt_inv8 = _mm256_set1_ps(dt_inv);
+        const auto damping8 = _mm256_set1_ps(damping);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            const auto base = _mm256_sub_ps(_mm256_loadu_ps(p + i), _mm256_loadu_ps(o + i));
+            const auto correction = _mm256_sub_ps(_mm256_loadu_ps(p + i + 1), _mm256_loadu_ps(q + i + 1));
+
+            _mm256_storeu_ps(v + i, _mm256_fmadd_ps(correction, damping8, _mm256_mul_ps(base, dt_inv8)));
+        }
+#elif defined(VHS_SIMD_NEON)
+        const auto dt_inv4 = vdupq_n_f32(dt_inv);
+        const auto damping4 = vdupq_n_f32(damping);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const auto base = vsubq_f32(vld1q_f32(p + i), vld1q_f32(o + i));
+            const auto correction = vsubq_f32(vld1q_f32(p + i + 1), vld1q_f32(q + i + 1));
+
+            vst1q_f32(v + i, vmlaq_f32(vmulq_f32(base, dt_inv4), correction, damping4));
+        }
+#endif
+
+        for (; i < count; ++i)
+            v[i] = (p[i] - o[i]) * dt_inv + (p[i + 1] - q[i + 1]) * damping;
+    }
+
+
+    // Constructor.
+    SimulatorCpu::SimulatorCpu(GraphicsContext& context, Camera& camera, const SimulatorConfig& config) :
+        Simulator { context, camera },
+        rng_ { VHS_RANDOM_SEED }
+    {
+        VHS_TRACE(SIMULATOR, "Switched to Cpu using {} worker threads.", pool_.num_threads());
+
+        initialise_properties(config);
+        initialise_particles();
+
+        create_vertex_buffers();
+        create_index_buffer();
+
+        create_depth_buffer();
+        create_render_pass();
+        create_draw_pipeline();
+
+        framebuffers_ = context.create_swapchain_framebuffers(render_pass_, &depth_image_view_);
+
+        initialise_imgui(render_pass_);
+    }
+
+    SimulatorCpu::~SimulatorCpu()
+    {
+        VHS_TRACE(SIMULATOR, "Destroying Cpu.");
+
+        terminate_imgui();
+    }
+
+
+    // Simulator interface functions.
+    void SimulatorCpu::process_input(const KeyboardState& ks)
+    {
+        // Toggle user interface on space.
+        if (ks.down(GLFW_KEY_SPACE) && prev_key_state_.up(GLFW_KEY_SPACE))
+            draw_ui_ = !draw_ui_;
+
+        // IJKL move the hair root, UO rotate.
+        hair_root_move_ = glm::vec3 { 0 };
+        hair_root_rot_move_ = 0;
+
+        if (ks.down(GLFW_KEY_I))
+            hair_root_move_ += camera_->up();
+        else if (ks.down(GLFW_KEY_K))
+            hair_root_move_ -= camera_->up();
+        if (ks.down(GLFW_KEY_J))
+            hair_root_move_ -= camera_->right();
+        else if (ks.down(GLFW_KEY_L))
+            hair_root_move_ += camera_->right();
+
+        if (ks.down(GLFW_KEY_U))
+            hair_root_rot_move_ -= 1.0f;
+        else if (ks.down(GLFW_KEY_O))
+            hair_root_rot_move_ += 1.0f;
+
+        prev_key_state_ = ks;
+    }
+
+    void SimulatorCpu::update(float dt)
+    {
+        // Update the hair root transform in the same way as the GPU simulator.
+        hair_root_position_ += hair_root_move_ * dt;
+        hair_root_transform_ = glm::translate(glm::mat4 { 1 }, hair_root_position_);
+        hair_root_transform_ = glm::rotate(hair_root_transform_, hair_root_rot_move_ * dt, glm::vec3 { 0, 1, 0 });
+        hair_root_transform_ = glm::translate(hair_root_transform_, hair_root_move_ * dt - hair_root_position_);
+
+        if (!simulation_active_)
+            return;
+
+        // Strands are completely independent so split them between the workers.
+        pool_.parallel_for(0, hair_number_of_strands_, UPDATE_STRANDS_PER_TASK, [&](uint32_t begin, uint32_t end)
+        {
+            update_strands(begin, end, dt);
+        });
+    }
+
+    void SimulatorCpu::draw(FrameData& frame, float interp)
+    {
+        (void)interp;
+
+        // Prepare the user interface draw commands.
+        draw_imgui();
+
+        // Expand the current particle state straight into this frame's persistently mapped vertex buffer. The
+        // frame's fence has been waited on so the device is no longer reading it.
+        const auto num_triangles = (uint32_t)hair_root_indices_.size() / 3;
+
+        auto& vbo = vbos_.at(frame.frame_index);
+        auto vertices = vbo.mapped<glm::vec3>();
+
+        pool_.parallel_for(0, num_triangles, VERTEX_TRIANGLES_PER_TASK, [&](uint32_t begin, uint32_t end)
+        {
+            create_vertices(begin, end, vertices.data());
+        });
+
+        vbo.flush();
+
+        // Compute the model matrix for the hair root and view projection for rendering.
+        const auto model = glm::mat4 { 1 };
+        const auto mvp = camera_->projection() * camera_->view() * model;
+
+        const VkClearValue clears[] =
+        {
+            { .color = { .float32 = { 0.1f, 0.2f, 0.7f, 1.0f } } },
+            { .depthStencil = { .depth = 1 } }
+        };
+
+        // Record the draw commands.
+        CommandBuffer cmd { frame.command_buffers[0] };
+
+        auto& framebuffer = framebuffers_[frame.swapchain_image_index];
+
+        cmd.begin_render_pass(render_pass_, framebuffer, context_->viewport(), clears, std::size(clears));
+        cmd.bind_pipeline(draw_pipeline_);
+        cmd.push_constants(draw_pipeline_, VK_SHADER_STAGE_VERTEX_BIT, &mvp, sizeof mvp);
+        cmd.bind_vertex_buffer(vbo);
+        cmd.bind_index_buffer(ebo_);
+        cmd.draw_indexed(hair_indices_.size());
+
+        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.command_buffers[0]);
+
+        cmd.end_render_pass();
+        cmd.end();
+    }
+
+
+    // Depth buffer, render pass, and draw pipeline. These match the GPU simulator so the output is comparable.
+    void SimulatorCpu::create_depth_buffer()
+    {
+        {
+            ImageConfig config;
+
+            config.format = VK_FORMAT_D32_SFLOAT;
+            config.extent = { context_->viewport().extent.width, context_->viewport().extent.height, 1 };
+            config.usage_flags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+            depth_image_ = { "DepthImage", *context_, config };
+        }
+
+        {
+            ImageViewConfig config;
+
+            config.aspect_mask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+            depth_image_view_ = { "DepthImageView", *context_, depth_image_, config };
+        }
+    }
+
+    void SimulatorCpu::create_render_pass()
+    {
+        RenderPassConfig config;
+
+        AttachmentConfig colour_attachment_config;
+
+        colour_attachment_config.format = context_->swapchain_image_format().format;
+        colour_attachment_config.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colour_attachment_config.store_op = VK_ATTACHMENT_STORE_OP_STORE;
+        colour_attachment_config.final_layout = context_->swapchain_image_final_layout();
+
+        const auto colour_attachment = config.create_attachment(colour_attachment_config);
+
+        AttachmentConfig depth_attachment_config;
+
+        depth_attachment_config.format = depth_image_.format();
+        depth_attachment_config.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment_config.final_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        const auto depth_attachment = config.create_attachment(depth_attachment_config);
+
+        SubpassConfig subpass_config;
+
+        subpass_config.colour_attachments.push_back(colour_attachment);
+        subpass_config.depth_stencil_attachment = depth_attachment;
+
+        const auto subpass = config.create_subpass(subpass_config);
+
+        SubpassDependencyConfig colour_dependency;
+
+        colour_dependency.src = VK_SUBPASS_EXTERNAL;
+        colour_dependency.dst = subpass;
+        colour_dependency.dst_access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        config.create_subpass_dependency(colour_dependency);
+
+        SubpassDependencyConfig depth_dependency;
+
+        depth_dependency.src = VK_SUBPASS_EXTERNAL;
+        depth_dependency.dst = subpass;
+        depth_dependency.src_stage_mask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        depth_dependency.dst_stage_mask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        depth_dependency.dst_access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        config.create_subpass_dependency(depth_dependency);
+
+        render_pass_ = { "RenderPass", *context_, config };
+    }
+
+    void SimulatorCpu::create_draw_pipeline()
+    {
+        GraphicsPipelineConfig config;
+
+        PipelineColourBlendAttachmentConfig colour_attachment;
+
+        config.colour_blend_attachments.push_back(colour_attachment);
+
+        const VkPushConstantRange push_constants
+        {
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .size = sizeof(glm::mat4),
+            .offset = 0
+        };
+
+        config.push_constants.push_back(push_constants);
+
+        config.viewport = context_->viewport();
+        config.cull_mode = VK_CULL_MODE_NONE;
+        config.primitive_topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+        config.primitive_restart = VK_TRUE;
+
+        auto vs = context_->create_shader_module("VertexShader", VK_SHADER_STAGE_VERTEX_BIT, "data/shaders/vs.spv");
+        auto fs = context_->create_shader_module("FragmentShader", VK_SHADER_STAGE_FRAGMENT_BIT, "data/shaders/fs.spv");
+
+        config.shader_modules.push_back(&vs);
+        config.shader_modules.push_back(&fs);
+
+        // Vertices are tightly packed positions.
+        VkVertexInputBindingDescription binding { };
+
+        binding.binding = 0;
+        binding.stride = sizeof(glm::vec3);
+        binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkVertexInputAttributeDescription attribute { };
+
+        attribute.binding = 0;
+        attribute.location = 0;
+        attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+        attribute.offset = 0;
+
+        config.vertex_binding_descriptions.push_back(binding);
+        config.vertex_attribute_descriptions.push_back(attribute);
+
+        draw_pipeline_ = { "DrawPipeline", *context_, render_pass_, config };
+    }
+
+
+    // Buffer management.
+    void SimulatorCpu::create_vertex_buffers()
+    {
+        // Each particle of each interpolated strand is expanded into two vertices.
+        const auto num_strands = hair_strands_per_triangle_ * (uint32_t)hair_root_indices_.size() / 3;
+        const auto num_vertices = num_strands * hair_particles_per_strand_ * 2;
+
+        vbos_.reserve(context_->num_frames());
+
+        for (uint32_t i = 0; i < context_->num_frames(); ++i)
+        {
+            vbos_.push_back(context_->create_host_visible_buffer("Vertices" + std::to_string(i), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                sizeof(glm::vec3) * num_vertices));
+        }
+    }
+
+    void SimulatorCpu::create_index_buffer()
+    {
+        // Strands are triangle strips separated by the primitive restart.
+        const auto num_strands = hair_strands_per_triangle_ * (uint32_t)hair_root_indices_.size() / 3;
+
+        hair_indices_.reserve(num_strands * (hair_particles_per_strand_ * 2 + 1));
+
+        uint32_t index = 0;
+
+        for (uint32_t i = 0; i < num_strands; ++i)
+        {
+            for (uint32_t j = 0; j < hair_particles_per_strand_ * 2; ++j)
+                hair_indices_.push_back(index++);
+
+            hair_indices_.push_back(~0u);
+        }
+
+        ebo_ = context_->create_index_buffer("Indices", hair_indices_.data(), hair_indices_.size());
+    }
+
+
+    // Hair configuration.
+    void SimulatorCpu::initialise_properties(const SimulatorConfig& config)
+    {
+        load_obj(config.root_mesh, hair_root_vertices_, hair_root_indices_, &pool_);
+
+        hair_number_of_strands_ = hair_root_vertices_.size();
+        hair_particles_per_strand_ = config.hair.particles_per_strand;
+        hair_total_particles_ = hair_number_of_strands_ * hair_particles_per_strand_;
+        hair_particle_separation_ = config.hair.particle_separation;
+        hair_draw_radius_ = 0.0005f;
+        hair_particle_mass_ = 0.15f;
+        hair_strands_per_triangle_ = config.hair.strands_per_triangle;
+        ftl_iterations_ = config.ftl_iterations;
+
+        VHS_ASSERT(hair_particles_per_strand_ >= 2, "Strands need at least two particles to be drawn.");
+    }
+
+    size_t SimulatorCpu::memory_footprint() const
+    {
+        size_t size = ebo_.size();
+
+        for (const auto& vbo : vbos_)
+            size += vbo.size();
+
+        const auto floats = hair_state_.size() + original_positions_.size() + pre_constraint_positions_.size();
+
+        return size + floats * sizeof(float) + hair_root_vertices_.size() * sizeof(RootVertex)
+            + (hair_root_indices_.size() + hair_indices_.size()) * sizeof(uint32_t);
+    }
+
+    void SimulatorCpu::initialise_particles()
+    {
+        // Positions followed by velocities, all starting at zero.
+        hair_state_.resize(hair_total_particles_ * 3 * 2, 0.0f);
+
+        original_positions_.resize(hair_total_particles_ * 3);
+        pre_constraint_positions_.resize(hair_total_particles_ * 3);
+
+        // Grow hairs from the roots along their normals.
+        for (uint32_t i = 0; i < hair_number_of_strands_; ++i)
+        {
+            const auto& root = hair_root_vertices_.at(i);
+
+            for (uint32_t j = 0; j < hair_particles_per_strand_; ++j)
+            {
+                const auto position = root.position + root.normal * (hair_particle_separation_ * j);
+
+                hair_state_.at(i * hair_particles_per_strand_ + j + hair_total_particles_ * 0) = position.x;
+                hair_state_.at(i * hair_particles_per_strand_ + j + hair_total_particles_ * 1) = position.y;
+                hair_state_.at(i * hair_particles_per_strand_ + j + hair_total_particles_ * 2) = position.z;
+            }
+        }
+
+        // Use the same sequence of random barycentric coordinates as the GPU simulator.
+        hair_barycentric_coords_.resize(hair_strands_per_triangle_);
+
+        for (auto& b : hair_barycentric_coords_)
+        {
+            b = { random_float(), random_float(), random_float() };
+            b /= (b.x + b.y + b.z);
+        }
+    }
+
+
+    // Simulation.
+    void SimulatorCpu::update_strands(uint32_t begin, uint32_t end, float dt)
+    {
+        const auto n = hair_total_particles_;
+        const auto pps = hair_particles_per_strand_;
+
+        const auto first = begin * pps;
+        const auto count = (end - begin) * pps;
+
+        float* const p[] = { &hair_state_[n * 0 + first], &hair_state_[n * 1 + first], &hair_state_[n * 2 + first] };
+        float* const v[] = { &hair_state_[n * 3 + first], &hair_state_[n * 4 + first], &hair_state_[n * 5 + first] };
+        float* const o[] = { &original_positions_[n * 0 + first], &original_positions_[n * 1 + first], &original_positions_[n * 2 + first] };
+        float* const q[] = { &pre_constraint_positions_[n * 0 + first], &pre_constraint_positions_[n * 1 + first],
+            &pre_constraint_positions_[n * 2 + first] };
+
+        const auto gravity = gravity_enabled_ ? gravity_ : glm::vec3 { 0 };
+        const auto external_forces = gravity * hair_particle_mass_;
+
+        // Remember the original positions and integrate all particles. Roots are fixed up afterwards as they follow the
+        // root transform instead.
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            std::copy_n(p[axis], count, o[axis]);
+            integrate_positions(p[axis], v[axis], external_forces[axis], dt, dt * dt, count);
+        }
+
+        for (uint32_t i = 0; i < count; i += pps)
+        {
+            const auto root = hair_root_transform_ * glm::vec4 { o[0][i], o[1][i], o[2][i], 1.0f };
+
+            p[0][i] = root.x;
+            p[1][i] = root.y;
+            p[2][i] = root.z;
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+            std::copy_n(p[axis], count, q[axis]);
+
+        // Apply FTL alternately on even and odd particles of each strand, matching the red-black ordering of the kernel.
+        // This has a serial dependency along the strand so is run one strand at a time.
+        const auto load = [&](uint32_t i) { return glm::vec3 { p[0][i], p[1][i], p[2][i] }; };
+
+        for (uint32_t s = 0; s < count; s += pps)
+        {
+            for (uint32_t it = 0; it < ftl_iterations_; ++it)
+            {
+                for (uint32_t parity = 0; parity < 2; ++parity)
+                {
+                    for (uint32_t j = parity ? 1 : 2; j < pps; j += 2)
+                    {
+                        const auto prev = load(s + j - 1);
+                        const auto cur = prev + glm::normalize(load(s + j) - prev) * hair_particle_separation_;
+
+                        p[0][s + j] = cur.x;
+                        p[1][s + j] = cur.y;
+                        p[2][s + j] = cur.z;
+                    }
+                }
+            }
+        }
+
+        // Compute velocities including the damped correction from the next particle. The last particle of each strand
+        // has nothing after it so is fixed up separately.
+        const auto dt_inv = 1.0f / dt;
+        const auto damping = damping_factor_ / dt;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            update_velocities(v[axis], p[axis], o[axis], q[axis], dt_inv, damping, count - 1);
+
+            for (uint32_t i = pps - 1; i < count; i += pps)
+                v[axis][i] = (p[axis][i] - o[axis][i]) * dt_inv;
+        }
+    }
+
+    void SimulatorCpu::create_vertices(uint32_t begin, uint32_t end, glm::vec3* vertices) const
+    {
+        const auto n = hair_total_particles_;
+        const auto pps = hair_particles_per_strand_;
+
+        const auto load = [&](uint32_t strand, uint32_t particle)
+        {
+            const auto i = strand * pps + particle;
+            return glm::vec3 { hair_state_[n * 0 + i], hair_state_[n * 1 + i], hair_state_[n * 2 + i] };
+        };
+
+        std::vector<glm::vec3> strand(pps);
+
+        for (uint32_t t = begin; t < end; ++t)
+        {
+            const auto r0 = hair_root_indices_[t * 3 + 0];
+            const auto r1 = hair_root_indices_[t * 3 + 1];
+            const auto r2 = hair_root_indices_[t * 3 + 2];
+
+            for (uint32_t s = 0; s < hair_strands_per_triangle_; ++s)
+            {
+                // Interpolate the new strand from the three simulated strands at the triangle vertices.
+                const auto& b = hair_barycentric_coords_[s];
+
+                for (uint32_t j = 0; j < pps; ++j)
+                    strand[j] = load(r0, j) * b.x + load(r1, j) * b.y + load(r2, j) * b.z;
+
+                auto* out = vertices + (t * hair_strands_per_triangle_ + s) * pps * 2;
+
+                for (uint32_t j = 0; j < pps; ++j)
+                {
+                    // Compute vector perpendicular to the camera and hair direction.
+                    const auto last = j == pps - 1;
+
+                    const auto i0 = last ? (j - 1) : j;
+                    const auto i1 = last ? j : (j + 1);
+
+                    const auto perp = hair_draw_radius_ * glm::normalize(glm::cross(strand[i1] - strand[i0], camera_->front()));
+
+                    out[2 * j + 0] = strand[j] - perp;
+                    out[2 * j + 1] = strand[j] + perp;
+                }
+            }
+        }
+    }
+
+
+    // ImGui.
+    void SimulatorCpu::draw_imgui()
+    {
+        imgui_new_frame();
+
+        if (draw_ui_)
+        {
+            ImGui::Checkbox("Simulation Active", &simulation_active_);
+            ImGui::SliderFloat("Hair Particle Separation", &hair_particle_separation_, 0.0f, 1.0f);
+            ImGui::SliderFloat("Hair Particle Mass", &hair_particle_mass_, 0.01f, 1.0f);
+            ImGui::SliderFloat("Hair Draw Radius", &hair_draw_radius_, 1e-4f, 1e-2f, "%.6f");
+            ImGui::SliderFloat("Damping Factor", &damping_factor_, -1.0f, 0.0f);
+            ImGui::Checkbox("Gravity Enabled", &gravity_enabled_);
+            ImGui::SliderFloat3("Gravity", reinterpret_cast<float*>(&gravity_), -15.0f, 15.0f, "%.2f");
+            ImGui::SliderInt("FTL Iterations", reinterpret_cast<int*>(&ftl_iterations_), 2, 8);
+        }
+
+        ImGui::Render();
+    }
+
+
+    // Random number generators.
+    float SimulatorCpu::random_float(float min, float max)
+    {
+        std::uniform_real_distribution<float> dist { min, max };
+        return dist(rng_);
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef VHS_SIMULATOR_CPU_HPP
+#define VHS_SIMULATOR_CPU_HPP
+
+#include <random>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "buffer.hpp"
+#include "framebuffer.hpp"
+#include "image.hpp"
+#include "image_view.hpp"
+#include "io.hpp"
+#include "pipeline.hpp"
+#include "render_pass.hpp"
+#include "simulator.hpp"
+#include "thread_pool.hpp"
+
+
+namespace vhs
+{
+    // Host simulator implementation. Runs the same integrate, FTL and damping step as the optimised GPU update kernel
+    // across a pool of worker threads, with the particle state kept in the same SoA layout as the GPU buffer.
+    class SimulatorCpu final : public Simulator
+    {
+    public:
+        SimulatorCpu() = delete;
+        SimulatorCpu(const SimulatorCpu&) = delete;
+        SimulatorCpu(SimulatorCpu&&) = delete;
+
+        SimulatorCpu(GraphicsContext& context, Camera& camera, const SimulatorConfig& config = { });
+        ~SimulatorCpu();
+
+
+        SimulatorCpu& operator=(const SimulatorCpu&) = delete;
+        SimulatorCpu& operator=(SimulatorCpu&&) = delete;
+
+
+        // Implement base simulator interface.
+        void process_input(const KeyboardState& ks) final;
+        void update(float dt) final;
+        void draw(FrameData& frame, float interp) final;
+        bool ui_active() const final { return draw_ui_; }
+        uint32_t num_particles() const final { return hair_total_particles_; }
+        size_t memory_footprint() const final;
+
+    private:
+        // Rendering resources.
+        void create_depth_buffer();
+        void create_render_pass();
+        void create_draw_pipeline();
+
+        // Buffers.
+        void create_vertex_buffers();
+        void create_index_buffer();
+
+        // Hair management.
+        void initialise_properties(const SimulatorConfig& config);
+        void initialise_particles();
+
+        // Simulate the strands in the range [begin, end).
+        void update_strands(uint32_t begin, uint32_t end, float dt);
+
+        // Expand the strands of the root triangles in the range [begin, end) into camera facing vertices.
+        void create_vertices(uint32_t begin, uint32_t end, glm::vec3* vertices) const;
+
+        // Draw the ImGui components.
+        void draw_imgui();
+
+        // Generate a random float in the specified range.
+        float random_float(float min = 0, float max = 1);
+
+        // Worker threads for the update and vertex creation.
+        ThreadPool pool_;
+
+        // Depth buffer.
+        Image depth_image_;
+        ImageView depth_image_view_;
+
+        // Main rendering pass and associated pipeline.
+        RenderPass render_pass_;
+        Pipeline draw_pipeline_;
+
+        // Framebuffers created by the context.
+        std::vector<Framebuffer> framebuffers_;
+
+        // Vertices are rebuilt on the host every frame so keep one mapped buffer per frame in flight.
+        std::vector<Buffer> vbos_;
+        Buffer ebo_;
+
+        // Hair properties.
+        std::vector<RootVertex> hair_root_vertices_;
+        std::vector<uint32_t> hair_root_indices_;
+
+        glm::vec3 gravity_ = { 0.0f, -9.81f, 0.0f };
+
+        uint32_t hair_number_of_strands_;
+        uint32_t hair_particles_per_strand_;
+        uint32_t hair_total_particles_;
+        uint32_t hair_strands_per_triangle_;
+        uint32_t ftl_iterations_ = 5;
+
+        float hair_particle_separation_;
+        float hair_draw_radius_;
+        float hair_particle_mass_;
+        float damping_factor_ = -0.56f;
+
+        // Particle state in the same layout as the GPU state buffer: x, y and z of all positions followed by x, y
+        // and z of all velocities.
+        std::vector<float> hair_state_;
+        std::vector<glm::vec3> hair_barycentric_coords_;
+        std::vector<uint32_t> hair_indices_;
+
+        // Scratch space for the original and pre-constraint positions, laid out the same as the positions.
+        std::vector<float> original_positions_;
+        std::vector<float> pre_constraint_positions_;
+
+        glm::mat4 hair_root_transform_ = glm::mat4 { 1 };
+        glm::vec3 hair_root_position_ = glm::vec3 { 0 };
+        glm::vec3 hair_root_move_;
+        float hair_root_rot_move_;
+
+        // Previous keyboard state.
+        KeyboardState prev_key_state_;
+
+        // Whether to draw the user interface.
+        bool draw_ui_ = false;
+
+        // Extra flags controlled via the UI.
+        bool simulation_active_ = true;
+        bool gravity_enabled_ = true;
+
+        // RNG.
+        std::mt19937 rng_;
+    };
+}
+
+#endif
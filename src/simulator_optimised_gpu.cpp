@@ -1,17 +1,22 @@
+#include <algorithm>
+#include <thread>
+#include <utility>
+
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/random.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <imgui/imgui.h>
-#include <imgui/backends/imgui_impl_glfw.h>
 #include <imgui/backends/imgui_impl_vulkan.h>
 
 #include "assert.hpp"
 #include "camera.hpp"
 #include "command_buffer.hpp"
+#include "gpu_profiler.hpp"
 #include "graphics_context.hpp"
 #include "io.hpp"
 #include "simulator_optimised_gpu.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 
 
 namespace vhs
@@ -55,7 +60,14 @@ namespace vhs
         uint32_t hair_particles_per_strand;
         uint32_t hair_strands_per_triangle;
         uint32_t triangles_per_group;
-        uint32_t padding[22];
+        uint32_t visible_triangles_offset;
+        uint32_t root_indices_offset;
+        uint32_t root_indices_wide;
+        uint32_t barycentric_offset;
+        uint32_t previous_positions_offset;
+        float interpolation;
+        uint32_t hair_smooth_factor;
+        uint32_t padding[15];
     };
 
     struct UpdatePushConstants
@@ -70,43 +82,221 @@ namespace vhs
         uint32_t hair_total_particles;
         uint32_t hair_particles_per_strand;
         uint32_t ftl_iterations;
+        uint32_t hair_particles_per_group;
+        uint32_t previous_positions_offset;
+    };
+
+    struct CullPushConstants
+    {
+        glm::mat4 model_view_projection;
+        alignas(16) glm::vec3 camera_position;
+        float cull_distance;
+        float cull_margin;
+        uint32_t hair_total_particles;
+        uint32_t hair_particles_per_strand;
+        uint32_t hair_strands_per_triangle;
+        uint32_t num_triangles;
+        uint32_t triangles_per_group;
+        uint32_t root_indices_offset;
+        uint32_t root_indices_wide;
+        uint32_t previous_positions_offset;
+        uint32_t draw_vertex_count;
+        uint32_t cull_enabled;
+    };
+
+    struct HiZPushConstants
+    {
+        uint32_t src_offset;
+        uint32_t src_width;
+        uint32_t src_height;
+        uint32_t dst_offset;
+        uint32_t dst_width;
+        uint32_t dst_height;
+        uint32_t padding[26];
+    };
+
+    // Created vertices read by instance when drawing instanced strands.
+    struct InstancedVerticesPushConstants
+    {
+        glm::mat4 model_view_projection;
+        uint32_t vertices_per_strand;
+    };
+
+    // Shared by the binning and rasterising kernels.
+    struct RasterPushConstants
+    {
+        glm::mat4 model_view_projection;
+        uint32_t screen_width;
+        uint32_t screen_height;
+        uint32_t tiles_x;
+        uint32_t tiles_y;
+        uint32_t tile_pool_size;
+        uint32_t points_per_strand;
+        uint32_t hair_strands_per_triangle;
+        uint32_t visible_triangles_offset;
+        uint32_t depth_test;
+        uint32_t padding[7];
+    };
+
+    struct ScalpPushConstants
+    {
+        glm::mat4 model_view_projection;
+        uint32_t scalp_offset;
+    };
+
+    // Everything the vertex shader needs to build the strands itself when pulling vertices.
+    struct PullVerticesPushConstants
+    {
+        glm::mat4 model_view_projection;
+        alignas(16) glm::vec3 camera_front;
+        float hair_draw_radius;
+        uint32_t hair_total_particles;
+        uint32_t hair_particles_per_strand;
+        uint32_t hair_strands_per_triangle;
+        uint32_t hair_smooth_factor;
+        uint32_t root_indices_offset;
+        uint32_t root_indices_wide;
+        uint32_t barycentric_offset;
+        uint32_t previous_positions_offset;
+        float interpolation;
     };
 
     // In order to have compatible pipeline layouts push constant ranges need to be the same.
     static_assert(sizeof(CreateVerticesPushConstants) == sizeof(UpdatePushConstants));
+    static_assert(sizeof(CullPushConstants) == sizeof(UpdatePushConstants));
+    static_assert(sizeof(HiZPushConstants) == sizeof(UpdatePushConstants));
+    static_assert(sizeof(RasterPushConstants) == sizeof(UpdatePushConstants));
     static_assert(sizeof(UpdatePushConstants) <= 128);
+    static_assert(sizeof(PullVerticesPushConstants) <= 128);
+
+
+    // Number of update ticks the host can record ahead of the device in timeline mode.
+    static const uint32_t MAX_TICKS_AHEAD = 3;
+
+    // Specialisation constant IDs shared by the compute kernels.
+    static const uint32_t SPEC_LOCAL_SIZE = 0;
+    static const uint32_t SPEC_INSTANCED_STRANDS = 2;
+    static const uint32_t SPEC_SCATTER = 3;
+
+    // Start of the cull buffer, reset by the host before each cull. The visible count is also the draw count, followed by
+    // the create vertices dispatch size and the depth pyramid to test against.
+    struct CullHeader
+    {
+        uint32_t num_visible_triangles;
+        uint32_t dispatch_x;
+        uint32_t dispatch_y;
+        uint32_t dispatch_z;
+        glm::mat4 occlusion_view_projection;
+        uint32_t occlusion_width;
+        uint32_t occlusion_height;
+        uint32_t occlusion_levels;
+        uint32_t scalp_enabled;
+    };
+
+    static_assert(sizeof(CullHeader) == 96, "Cull header must match the cull buffer block in buffers.glslh.");
+
+    // Layout of the cull buffer in bytes. The draws follow the header, the visible triangle indices come after all the
+    // draws and the root mesh for the depth pre-pass after those. Instanced draws are smaller but use the same stride.
+    static const VkDeviceSize CULL_COUNT_OFFSET = offsetof(CullHeader, num_visible_triangles);
+    static const VkDeviceSize CULL_DISPATCH_OFFSET = offsetof(CullHeader, dispatch_x);
+    static const VkDeviceSize CULL_DRAWS_OFFSET = sizeof(CullHeader);
+    static const uint32_t CULL_DRAW_STRIDE = sizeof(VkDrawIndexedIndirectCommand);
+
+    static_assert(CULL_DRAW_STRIDE == sizeof(uint32_t) * VHS_CULL_DRAW_WORDS, "Cull draws must match the stride in the shaders.");
 
 
     // Constructor.
-    SimulatorOptimisedGpu::SimulatorOptimisedGpu(GraphicsContext& context, Camera& camera) :
-        Simulator { context, camera },
-        rng_ { VHS_RANDOM_SEED }
+    SimulatorOptimisedGpu::SimulatorOptimisedGpu(GraphicsContext& context, Camera& camera, const SimulatorConfig& config) :
+        Simulator { context, camera }
     {
+        VHS_TRACE_SCOPE(SIMULATOR, "Startup");
         VHS_TRACE(SIMULATOR, "Switched to OptimisedGpu.");
 
-        initialise_properties();
-        initialise_particles();
+        // Time each stage for the startup breakdown.
+        std::vector<std::pair<const char*, double>> stages;
+
+        const auto stage = [&, last = Trace::now_ns()](const char* name) mutable
+        {
+            const auto now = Trace::now_ns();
+            stages.emplace_back(name, (now - std::exchange(last, now)) * 1e-6);
+        };
+
+        initialise_properties(config);
+        stage("properties");
+
+        if (!vertex_pulling_)
+            create_vertex_buffer();
+
+        if (!instanced_strands_)
+            create_index_buffer();
 
-        create_vertex_buffer();
-        create_index_buffer();
         create_particle_buffer();
+        create_cull_buffer();
+        create_hiz_buffer();
+        create_raster_buffers();
+        stage("buffers");
 
         create_desc_pool();
         create_desc_layout();
         create_desc_set();
 
         create_update_command_pool();
-
-        create_create_vertices_pipeline();
-        create_update_pipeline();
+        create_compute_sync();
 
         create_depth_buffer();
         create_render_pass();
-        create_draw_pipeline();
+
+        if (occlusion_)
+            create_depth_prepass();
+
+        stage("descriptors and sync");
+
+        // Shaders are loaded and pipelines compiled on workers, all joined before anything is recorded.
+        {
+            VHS_TRACE_SCOPE(SIMULATOR, "CreatePipelines");
+
+            std::vector<ThreadPool::Task> tasks
+            {
+                [this] { create_update_pipeline(); },
+                [this] { create_cull_pipeline(); },
+                [this] { create_draw_pipeline(); }
+            };
+
+            if (!vertex_pulling_)
+                tasks.push_back([this] { create_create_vertices_pipeline(); });
+
+            if (occlusion_)
+            {
+                tasks.push_back([this] { create_scalp_pipeline(); });
+                tasks.push_back([this] { create_hiz_pipeline(); });
+            }
+
+            if (compute_raster_)
+            {
+                tasks.push_back([this] { create_raster_pipelines(); });
+                tasks.push_back([this] { create_composite_pipeline(); });
+            }
+
+            ThreadPool pool { static_cast<uint32_t>(std::min<size_t>(tasks.size(), std::thread::hardware_concurrency())) };
+            pool.run_all(tasks);
+        }
+
+        stage("pipelines");
 
         framebuffers_ = context.create_swapchain_framebuffers(render_pass_, &depth_image_view_);
 
         initialise_imgui(render_pass_);
+        stage("framebuffers and imgui");
+
+        double total_ms = 0;
+
+        for (const auto& [name, ms] : stages)
+        {
+            VHS_TRACE(SIMULATOR, "Startup {}: {:.3f} ms.", name, ms);
+            total_ms += ms;
+        }
+
+        VHS_TRACE(SIMULATOR, "Startup took {:.3f} ms.", total_ms);
     }
 
     SimulatorOptimisedGpu::~SimulatorOptimisedGpu()
@@ -147,8 +337,11 @@ namespace vhs
 
     void SimulatorOptimisedGpu::update(float dt)
     {
+        VHS_TRACE_SCOPE(SIMULATOR, "Update");
+
         // Update index buffer if some state has changed.
-        update_index_buffer(true);
+        if (!instanced_strands_)
+            update_index_buffer(true);
 
         // First update the hair root transform so we can send it to the GPU.
         hair_root_position_ += hair_root_move_ * dt;
@@ -156,64 +349,78 @@ namespace vhs
         hair_root_transform_ = glm::rotate(hair_root_transform_, hair_root_rot_move_ * dt, glm::vec3 { 0, 1, 0 });
         hair_root_transform_ = glm::translate(hair_root_transform_, hair_root_move_ * dt - hair_root_position_);
 
-        // Wait for the update fence - this will be signalled once the previous update is complete.
-        update_command_fence_.wait();
-        update_command_fence_.reset();
-
-        // Reset buffer and start command recording.
-        update_command_pool_.reset();
+        // Nothing to do on the GPU if the simulation is paused, the vertices are still created for each draw.
+        if (!simulation_active_)
+            return;
 
-        CommandBuffer cmd { update_command_buffer_ };
+        const bool timeline = context_->sync_mode() == SyncMode::TIMELINE;
 
-        // Bind the descriptor set once up front for all the compute shaders.
-        cmd.bind_descriptor_sets(create_vertices_pipeline_, &desc_set_, 1);
+        // Wait for the last tick recorded into this slot to complete. With a single slot in fence mode this is the previous
+        // tick, in timeline mode the host only blocks once it's a full set of slots ahead.
+        auto& slot = update_slots_[current_update_slot_];
+        current_update_slot_ = (current_update_slot_ + 1) % update_slots_.size();
 
-        if (simulation_active_)
+        if (timeline)
         {
-            // Before starting the first update stage we need to wait for the previous update tick to have finished any reads
-            // from the particle buffer. The last reads are performed in the create vertices stage of the previous tick and
-            // now we're going to write to it in the next compute shader.
-            PipelineBarrier prev_to_cur { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
-            prev_to_cur.add_buffer(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, ssbo_particles_);
-
-            cmd.barrier(prev_to_cur);
-
-            record_update_commands(cmd, dt);
+            tick_timeline_.wait(slot.tick);
+        }
+        else
+        {
+            slot.fence.wait();
+            slot.fence.reset();
         }
 
-        // In order to start the vertex creation we need the previous update kernels to have finished AND for the previous
-        // draw call to have finished reading the vertices we're going to write.
-        PipelineBarrier before_create { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
-        before_create.add_buffer(VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, vbo_);
-
-        if (simulation_active_)
-            before_create.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, ssbo_particles_);
+        // Reset buffer and start command recording.
+        slot.command_pool.reset();
 
-        cmd.barrier(before_create);
+        CommandBuffer cmd { slot.command_buffer };
 
-        record_create_vertices_commands(cmd);
+        // Bind the descriptor set once up front for all the compute shaders.
+        cmd.bind_descriptor_sets(*update_pipeline_, &desc_set_, 1);
 
-        // Add another barrier for the next draw after we've written the vertex buffer.
-        PipelineBarrier create_to_draw { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
-        create_to_draw.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, vbo_);
+        // Before starting the update we need to wait for any earlier reads from the particle buffer, the last of which are
+        // performed by the create vertices stage of the previous draw.
+        record_particle_barrier(cmd, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
 
-        cmd.barrier(create_to_draw);
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "Update" };
+            record_update_commands(cmd, dt);
+        }
 
         cmd.end();
 
-        // Commands are now complete so submit to the queue.
+        // The update only touches the particle buffer so it goes to the compute queue without waiting for any draws, which
+        // lets it overlap with rendering of the previous frame. When pulling vertices the draw reads the particles directly
+        // so the update has to wait for it to finish.
         QueueSubmitConfig submit;
 
-        submit.command_buffers.push_back(update_command_buffer_);
-        submit.signal_fence = update_command_fence_.vk_fence();
+        submit.command_buffers.push_back(slot.command_buffer);
+
+        if (vertex_pulling_)
+            wait_for_draw(submit);
+
+        if (timeline)
+        {
+            slot.tick = ++tick_value_;
+
+            submit.signal_semaphores.push_back(tick_timeline_.vk_semaphore());
+            submit.signal_values.push_back(slot.tick);
+        }
+        else
+        {
+            submit.signal_fence = slot.fence.vk_fence();
+        }
 
-        context_->queue_submit(context_->graphics_queue(), submit);
+        context_->queue_submit(context_->compute_queue(), submit);
     }
 
     void SimulatorOptimisedGpu::draw(FrameData& frame, float interp)
     {
-        (void)interp;
+        VHS_TRACE_SCOPE(SIMULATOR, "Draw");
+
+        // Draw part way between the last two ticks. There is nothing to blend between while paused as the positions
+        // aren't changing.
+        interpolation_ = (interpolate_ && simulation_active_) ? std::clamp(interp, 0.0f, 1.0f) : 1.0f;
 
         // Prepare the user interface draw commands.
         draw_imgui();
@@ -222,6 +429,50 @@ namespace vhs
         const auto model = glm::mat4 { 1 };
         const auto mvp = camera_->projection() * camera_->view() * model;
 
+        // Instanced strands read the created vertices as a storage buffer rather than through the vertex input, and the
+        // compute rasteriser reads them before the render pass.
+        VkPipelineStageFlags vertex_read_stage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        VkAccessFlags vertex_read_access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+        if (compute_raster_)
+        {
+            vertex_read_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            vertex_read_access = VK_ACCESS_SHADER_READ_BIT;
+        }
+        else if (instanced_strands_)
+        {
+            vertex_read_stage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+            vertex_read_access = VK_ACCESS_SHADER_READ_BIT;
+        }
+
+        // Build the vertices from the latest particle state on the compute queue. The frame waits for them to be ready
+        // and signals when it has finished reading them so the next frame's vertices can overwrite them. Vertex pulling
+        // reads the particles instead so only has to wait for the latest tick.
+        if (vertex_pulling_)
+        {
+            submit_particles_ready(frame);
+        }
+        else
+        {
+            submit_create_vertices(mvp);
+
+            // The depth pre-pass also reads the root mesh written by the cull kernel, and the pyramid it read mustn't be
+            // rebuilt until it has finished.
+            const auto occlusion_stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            const auto wait_stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | vertex_read_stage
+                | (occlusion_ ? occlusion_stages : 0);
+
+            frame.submit_wait_semaphores.push_back(vertices_ready_semaphore_.vk_semaphore());
+            frame.submit_wait_stages.push_back(wait_stages);
+
+            if (context_->sync_mode() == SyncMode::TIMELINE)
+                frame.submit_wait_values.push_back(vertices_value_);
+            else
+                frame.submit_signal_semaphores.push_back(draw_finished_semaphore_.vk_semaphore());
+        }
+
+        draw_submitted_ = true;
+
         // Prepare the two clears for the draw - colour with the background and clear with nearest.
         const VkClearValue clears[] =
         {
@@ -234,17 +485,114 @@ namespace vhs
 
         auto& framebuffer = framebuffers_[frame.swapchain_image_index];
 
+        // Acquire the vertices from the compute queue.
+        const auto graphics_family = context_->graphics_queue_family();
+        const auto compute_family = context_->compute_queue_family();
+
+        if (!vertex_pulling_)
+        {
+            PipelineBarrier acquire_vertices { vertex_read_stage, vertex_read_stage };
+            acquire_vertices.add_buffer(0, vertex_read_access, vbo_, compute_family, graphics_family);
+
+            cmd.barrier(acquire_vertices);
+        }
+        else
+        {
+            // With no compute pass ahead of the draw the culling runs here, the vertex shader handles the rest.
+            record_cull_commands(cmd, mvp);
+        }
+
+        // Lay down the root mesh's depth for the main pass and build the pyramid the next frame's cull tests against.
+        if (occlusion_)
+        {
+            record_depth_prepass_commands(cmd, mvp);
+            record_hiz_commands(cmd);
+
+            hiz_view_projection_ = mvp;
+            hiz_valid_ = true;
+        }
+
+        if (compute_raster_)
+            record_raster_commands(cmd, mvp, frame.frame_index);
+
         cmd.begin_render_pass(render_pass_, framebuffer, context_->viewport(), clears, std::size(clears));
-        cmd.bind_pipeline(draw_pipeline_);
-        cmd.push_constants(draw_pipeline_, VK_SHADER_STAGE_VERTEX_BIT, &mvp, sizeof mvp);
-        cmd.bind_vertex_buffer(vbo_);
-        cmd.bind_index_buffer(ebo_);
-        cmd.draw_indexed(num_active_indices_);
+
+        if (compute_raster_)
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "Composite" };
+
+            const uint32_t screen_width = context_->viewport().extent.width;
+
+            cmd.bind_pipeline(composite_pipeline_);
+            cmd.bind_descriptor_sets(composite_pipeline_, &desc_set_, 1);
+            cmd.push_constants(composite_pipeline_, VK_SHADER_STAGE_FRAGMENT_BIT, &screen_width, sizeof screen_width);
+            cmd.draw(3);
+        }
+        else
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "DrawHair" };
+
+            cmd.bind_pipeline(draw_pipeline_);
+
+            if (vertex_pulling_)
+            {
+                PullVerticesPushConstants consts;
+
+                consts.model_view_projection = mvp;
+                consts.camera_front = camera_->front();
+                consts.hair_draw_radius = hair_draw_radius_;
+                consts.hair_total_particles = hair_total_particles_;
+                consts.hair_particles_per_strand = hair_particles_per_strand_;
+                consts.hair_strands_per_triangle = hair_strands_per_triangle_;
+                consts.hair_smooth_factor = hair_smooth_factor_;
+                consts.root_indices_offset = buf_positions_size_ + buf_velocities_size_;
+                consts.root_indices_wide = hair_asset_.index_type() == RootIndexType::UINT32;
+                consts.barycentric_offset = buf_total_size_ - buf_barycentric_size_;
+                consts.previous_positions_offset = buf_previous_positions_offset_;
+                consts.interpolation = interpolation_;
+
+                cmd.bind_descriptor_sets(draw_pipeline_, &desc_set_, 1);
+                cmd.push_constants(draw_pipeline_, VK_SHADER_STAGE_VERTEX_BIT, &consts, sizeof consts);
+            }
+            else if (instanced_strands_)
+            {
+                InstancedVerticesPushConstants consts;
+
+                consts.model_view_projection = mvp;
+                consts.vertices_per_strand = 2 * hair_particles_per_strand_ * hair_smooth_factor_;
+
+                cmd.bind_descriptor_sets(draw_pipeline_, &desc_set_, 1);
+                cmd.push_constants(draw_pipeline_, VK_SHADER_STAGE_VERTEX_BIT, &consts, sizeof consts);
+            }
+            else
+            {
+                cmd.push_constants(draw_pipeline_, VK_SHADER_STAGE_VERTEX_BIT, &mvp, sizeof mvp);
+                cmd.bind_vertex_buffer(vbo_);
+            }
+
+            if (!instanced_strands_)
+                cmd.bind_index_buffer(ebo_);
+
+            record_draw_hair_commands(cmd);
+        }
 
         // Shove the ImGui rendering into the end of the render pass.
-        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.command_buffers[0]);
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "ImGui" };
+            ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), frame.command_buffers[0]);
+        }
 
         cmd.end_render_pass();
+
+        // Hand the vertices back to the compute queue for the next frame.
+        if (!vertex_pulling_)
+        {
+            PipelineBarrier release_vertices { vertex_read_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
+            release_vertices.add_buffer(0, 0, vbo_, graphics_family, compute_family);
+
+            cmd.barrier(release_vertices);
+        }
+
         cmd.end();
     }
 
@@ -259,6 +607,10 @@ namespace vhs
             config.extent = { context_->viewport().extent.width, context_->viewport().extent.height, 1 };
             config.usage_flags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
 
+            // The root mesh's depth is copied out for the occlusion pyramid.
+            if (occlusion_)
+                config.usage_flags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
             depth_image_ = { "DepthImage", *context_, config };
         }
 
@@ -283,7 +635,7 @@ namespace vhs
         colour_attachment_config.format = context_->swapchain_image_format().format;
         colour_attachment_config.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
         colour_attachment_config.store_op = VK_ATTACHMENT_STORE_OP_STORE;
-        colour_attachment_config.final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colour_attachment_config.final_layout = context_->swapchain_image_final_layout();
 
         const auto colour_attachment = config.create_attachment(colour_attachment_config);
 
@@ -294,6 +646,13 @@ namespace vhs
         depth_attachment_config.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
         depth_attachment_config.final_layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+        // Keep the root mesh's depth from the pre-pass, which leaves it ready for copying.
+        if (occlusion_)
+        {
+            depth_attachment_config.load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
+            depth_attachment_config.initial_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        }
+
         const auto depth_attachment = config.create_attachment(depth_attachment_config);
 
         // Main subpass.
@@ -322,184 +681,227 @@ namespace vhs
         depth_dependency.dst_stage_mask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
         depth_dependency.dst_access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+        // The loaded depth must also wait for the pyramid's copy.
+        if (occlusion_)
+        {
+            depth_dependency.src_stage_mask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+            depth_dependency.dst_access_mask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+        }
+
         config.create_subpass_dependency(depth_dependency);
 
         render_pass_ = { "RenderPass", *context_, config };
     }
 
-    void SimulatorOptimisedGpu::create_draw_pipeline()
+    void SimulatorOptimisedGpu::create_depth_prepass()
+    {
+        RenderPassConfig config;
+
+        // Depth only, stored for the main pass and left ready to copy into the pyramid.
+        AttachmentConfig depth_attachment_config;
+
+        depth_attachment_config.format = depth_image_.format();
+        depth_attachment_config.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment_config.store_op = VK_ATTACHMENT_STORE_OP_STORE;
+        depth_attachment_config.final_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        const auto depth_attachment = config.create_attachment(depth_attachment_config);
+
+        SubpassConfig subpass_config;
+
+        subpass_config.depth_stencil_attachment = depth_attachment;
+
+        const auto subpass = config.create_subpass(subpass_config);
+
+        // The previous frame's main pass and copy must be done with the depth buffer before it's cleared, and its depth
+        // writes made available so they can't land after the clear.
+        SubpassDependencyConfig begin_dependency;
+
+        begin_dependency.src = VK_SUBPASS_EXTERNAL;
+        begin_dependency.dst = subpass;
+        begin_dependency.src_stage_mask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+            | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        begin_dependency.src_access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        begin_dependency.dst_stage_mask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        begin_dependency.dst_access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        config.create_subpass_dependency(begin_dependency);
+
+        // Make the depth visible to the copy into the pyramid.
+        SubpassDependencyConfig end_dependency;
+
+        end_dependency.src = subpass;
+        end_dependency.dst = VK_SUBPASS_EXTERNAL;
+        end_dependency.src_stage_mask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        end_dependency.dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        end_dependency.src_access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        end_dependency.dst_access_mask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        config.create_subpass_dependency(end_dependency);
+
+        depth_pass_ = { "DepthPrepass", *context_, config };
+
+        FramebufferConfig framebuffer_config;
+
+        framebuffer_config.attachments.push_back(depth_image_view_.vk_image_view());
+        framebuffer_config.width = context_->viewport().extent.width;
+        framebuffer_config.height = context_->viewport().extent.height;
+
+        depth_framebuffer_ = { "DepthPrepassFramebuffer", *context_, depth_pass_, framebuffer_config };
+    }
+
+    void SimulatorOptimisedGpu::create_composite_pipeline()
     {
         GraphicsPipelineConfig config;
 
-        // Colour attachment for drawing to.
+        // The rasterised hair is premultiplied by its coverage.
         PipelineColourBlendAttachmentConfig colour_attachment;
 
+        colour_attachment.blend = VK_TRUE;
+        colour_attachment.src_blend_factor = VK_BLEND_FACTOR_ONE;
+        colour_attachment.dst_blend_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+
         config.colour_blend_attachments.push_back(colour_attachment);
 
-        // Push constaints for the model view projection matrix.
         const VkPushConstantRange push_constants
         {
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-            .size = sizeof(glm::mat4),
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .size = sizeof(uint32_t),
             .offset = 0
         };
 
         config.push_constants.push_back(push_constants);
+        config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
 
-        // Render to the full visible area.
         config.viewport = context_->viewport();
 
-        // Disable back-face culling so we can always see the rotating triangle.
+        // One triangle over the whole screen, the rasteriser has already done the depth test.
         config.cull_mode = VK_CULL_MODE_NONE;
+        config.depth_test = VK_FALSE;
+        config.depth_write = VK_FALSE;
 
-        // Each strand of hair is drawn as a triangle strip with indices being separated by the restart value.
-        config.primitive_topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-        config.primitive_restart = VK_TRUE;
-
-        // Add the vertex and fragment shaders. It's okay for these to be destroyed at the end of the function as
-        // the pipeline has been finalised.
-        auto vs = context_->create_shader_module("VertexShader", VK_SHADER_STAGE_VERTEX_BIT, "data/shaders/vs.spv");
-        auto fs = context_->create_shader_module("FragmentShader", VK_SHADER_STAGE_FRAGMENT_BIT, "data/shaders/fs.spv");
+        auto vs = context_->create_shader_module("CompositeVertexShader", VK_SHADER_STAGE_VERTEX_BIT, "data/shaders/optimised_gpu/composite/vs.spv");
+        auto fs = context_->create_shader_module("CompositeFragmentShader", VK_SHADER_STAGE_FRAGMENT_BIT, "data/shaders/optimised_gpu/composite/fs.spv");
 
         config.shader_modules.push_back(&vs);
         config.shader_modules.push_back(&fs);
 
-        // Configure the vertex attributes and bindings for our triangle.
-        config.vertex_binding_descriptions.push_back(Vertex::vertex_binding_description());
-        config.vertex_attribute_descriptions = Vertex::vertex_attribute_descriptions();
-
-        draw_pipeline_ = { "DrawPipeline", *context_, render_pass_, config };
+        composite_pipeline_ = { "CompositePipeline", *context_, render_pass_, config };
     }
 
-
-    // Buffer management.
-    void SimulatorOptimisedGpu::create_vertex_buffer()
+    void SimulatorOptimisedGpu::create_scalp_pipeline()
     {
-        const auto particles_per_tri = hair_strands_per_triangle_ * hair_particles_per_strand_ * VHS_MAX_HAIR_SMOOTH_FACTOR;
-        const auto tris_per_group = VHS_COMPUTE_LOCAL_SIZE / particles_per_tri;
-        const auto particles_per_group = tris_per_group * particles_per_tri;
-
-        const auto num_triangles = (uint32_t)hair_root_indices_.size() / 3;
-        const auto total_compute_size = num_triangles * particles_per_tri;
-
-        uint32_t create_vertices_groups = total_compute_size / particles_per_group;
-
-        if (total_compute_size % particles_per_group)
-            create_vertices_groups++;
-
-        std::vector<glm::vec3> vertices(total_compute_size * 2);
+        GraphicsPipelineConfig config;
 
-        for (uint32_t i = 0; i < create_vertices_groups; ++i)
+        // The root mesh is read straight from the cull buffer so there are no vertex inputs, and with no colour
+        // attachments only a vertex shader is needed.
+        const VkPushConstantRange push_constants
         {
-            std::vector<glm::vec3> barycentric_coords(VHS_COMPUTE_LOCAL_SIZE);
-            std::vector<uint32_t> hair_root_indices(VHS_COMPUTE_LOCAL_SIZE);
-            std::vector<glm::vec3> positions(VHS_COMPUTE_LOCAL_SIZE);
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .size = sizeof(ScalpPushConstants),
+            .offset = 0
+        };
 
-            for (uint32_t j = 0; j < VHS_COMPUTE_LOCAL_SIZE; ++j)
-            {
-                const auto num_indices = tris_per_group * 3;
+        config.push_constants.push_back(push_constants);
+        config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
 
-                const auto lid = j;
-                const auto gid = i * num_indices + lid;
+        config.viewport = context_->viewport();
 
-                // Load the barycentric coordinates.
-                if (lid < hair_strands_per_triangle_)
-                {
-                    const auto offset = hair_total_particles_ * 3 * 2 + num_triangles * 3;
+        // The root mesh's winding isn't known so draw both sides.
+        config.cull_mode = VK_CULL_MODE_NONE;
 
-                    barycentric_coords.at(lid).x = ssbo_hair_data_.at(offset + 3 * lid + 0);
-                    barycentric_coords.at(lid).y = ssbo_hair_data_.at(offset + 3 * lid + 1);
-                    barycentric_coords.at(lid).z = ssbo_hair_data_.at(offset + 3 * lid + 2);
-                }
+        auto vs = context_->create_shader_module("ScalpVertexShader", VK_SHADER_STAGE_VERTEX_BIT, "data/shaders/optimised_gpu/scalp/vs.spv");
 
-                // Load root vertex indices.
-                if (lid < num_indices)
-                {
-                    const auto offset = hair_total_particles_ * 3 * 2;
+        config.shader_modules.push_back(&vs);
 
-                    hair_root_indices.at(lid) = ssbo_hair_data_.at(offset + gid);
-                }
+        scalp_pipeline_ = { "ScalpPipeline", *context_, depth_pass_, config };
+    }
 
-            }
+    void SimulatorOptimisedGpu::create_draw_pipeline()
+    {
+        GraphicsPipelineConfig config;
 
-            for (uint32_t j = 0; j < VHS_COMPUTE_LOCAL_SIZE; ++j)
-            {
-                const auto lid = j;
+        // Colour attachment for drawing to.
+        PipelineColourBlendAttachmentConfig colour_attachment;
 
-                // Load initial particle positions.
-                const auto num_initial_particles = hair_particles_per_strand_ * tris_per_group * 3;
+        config.colour_blend_attachments.push_back(colour_attachment);
 
-                if (lid < num_initial_particles)
-                {
-                    const auto triangle_index = lid / (hair_particles_per_strand_ * 3);
-                    const auto strand_index = (lid / hair_particles_per_strand_) % 3;
-                    const auto particle_index = lid % hair_particles_per_strand_;
+        // Push constaints for the model view projection matrix, with vertex pulling everything needed to build the strands
+        // and with instanced strands the length of each strand's strip.
+        uint32_t push_constants_size = sizeof(glm::mat4);
 
-                    const auto index_offset = hair_root_indices.at(triangle_index * 3 + strand_index) * hair_particles_per_strand_;
-                    const auto particle_offset = index_offset + particle_index;
+        if (vertex_pulling_)
+            push_constants_size = sizeof(PullVerticesPushConstants);
+        else if (instanced_strands_)
+            push_constants_size = sizeof(InstancedVerticesPushConstants);
 
-                    positions.at(lid).x = ssbo_hair_data_.at(particle_offset + hair_total_particles_ * 0);
-                    positions.at(lid).y = ssbo_hair_data_.at(particle_offset + hair_total_particles_ * 1);
-                    positions.at(lid).z = ssbo_hair_data_.at(particle_offset + hair_total_particles_ * 2);
-                }
-            }
+        const VkPushConstantRange push_constants
+        {
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .size = push_constants_size,
+            .offset = 0
+        };
 
-            for (uint32_t j = 0; j < VHS_COMPUTE_LOCAL_SIZE; ++j)
-            {
-                const auto lid = j;
-                const auto gid = i * tris_per_group * hair_particles_per_strand_ * hair_strands_per_triangle_ + lid;
+        config.push_constants.push_back(push_constants);
 
-                const auto num_initial_particles = hair_particles_per_strand_ * tris_per_group * 3;
+        if (vertex_pulling_ || instanced_strands_)
+            config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
+
+        // Render to the full visible area.
+        config.viewport = context_->viewport();
 
-                if (lid >= num_initial_particles)
-                    continue;
+        // Disable back-face culling so we can always see the rotating triangle.
+        config.cull_mode = VK_CULL_MODE_NONE;
 
-                // Load original vertices for interpolation.
-                const auto triangle_index = lid / (hair_particles_per_strand_ * 3);
-                const auto particle_index = lid % hair_particles_per_strand_;
+        // Each strand of hair is drawn as a triangle strip, either as its own instance or with indices being separated by
+        // the restart value.
+        config.primitive_topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+        config.primitive_restart = instanced_strands_ ? VK_FALSE : VK_TRUE;
 
-                const auto b0 = positions.at(triangle_index * hair_particles_per_strand_ * 3 + hair_particles_per_strand_ * 0 + particle_index);
-                const auto b1 = positions.at(triangle_index * hair_particles_per_strand_ * 3 + hair_particles_per_strand_ * 1 + particle_index);
-                const auto b2 = positions.at(triangle_index * hair_particles_per_strand_ * 3 + hair_particles_per_strand_ * 2 + particle_index);
+        // Add the vertex and fragment shaders. It's okay for these to be destroyed at the end of the function as
+        // the pipeline has been finalised.
+        auto vs_path = "data/shaders/vs.spv";
 
-                // Load the barycentric coordinates and compute new interpolated particle position.
-                const auto b = barycentric_coords.at(lid / hair_particles_per_strand_);//% hair_strands_per_triangle_);
-                const auto p = b0 * b.x + b1 * b.y + b2 * b.z;
+        if (vertex_pulling_)
+            vs_path = "data/shaders/optimised_gpu/vs.spv";
+        else if (instanced_strands_)
+            vs_path = "data/shaders/optimised_gpu/instanced/vs.spv";
 
-                // Compute vector perpendicular to the camera and hair direction.
-                const bool valid = lid < (tris_per_group * hair_particles_per_strand_ * hair_strands_per_triangle_);
-                const auto end = particle_index == (hair_particles_per_strand_ - 1);
+        auto vs = context_->create_shader_module("VertexShader", VK_SHADER_STAGE_VERTEX_BIT, vs_path);
+        auto fs = context_->create_shader_module("FragmentShader", VK_SHADER_STAGE_FRAGMENT_BIT, "data/shaders/fs.spv");
 
-                const auto i0 = end ? (particle_index - 1) : particle_index;
-                const auto i1 = end ? particle_index : (particle_index + 1);
+        config.shader_modules.push_back(&vs);
+        config.shader_modules.push_back(&fs);
 
-                const auto v0 = positions.at(triangle_index * hair_particles_per_strand_ * 3 + i0);
-                const auto v1 = positions.at(triangle_index * hair_particles_per_strand_ * 3 + i1);
+        // Configure the vertex attributes and bindings for our triangle. Pulled vertices and instanced strands have no
+        // inputs.
+        if (!vertex_pulling_ && !instanced_strands_)
+        {
+            config.vertex_binding_descriptions.push_back(Vertex::vertex_binding_description());
+            config.vertex_attribute_descriptions = Vertex::vertex_attribute_descriptions();
+        }
 
-                const auto perp = hair_draw_radius_ * glm::normalize(glm::cross(v1 - v0, camera_->front()));
+        draw_pipeline_ = { "DrawPipeline", *context_, render_pass_, config };
+    }
 
-                // Create the two vertices.
-                const auto p0 = p - perp;
-                const auto p1 = p + perp;
 
-                // Write vertex if valid.
-                if (valid)
-                {
-                    vertices.at(2 * gid + 0) = p0;
-                    vertices.at(2 * gid + 1) = p1;
-                }
-            }
-        }
+    // Buffer management.
+    void SimulatorOptimisedGpu::create_vertex_buffer()
+    {
+        // Every particle is tessellated into up to the maximum smooth factor points, each expanded into two vertices. The
+        // contents are written by the create vertices kernel before every draw.
+        const auto num_strands = hair_strands_per_triangle_ * hair_asset_.num_root_indices() / 3;
+        const auto num_vertices = 2 * num_strands * hair_particles_per_strand_ * VHS_MAX_HAIR_SMOOTH_FACTOR;
 
         vbo_ = context_->create_device_local_buffer("Vertices", VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            vertices.data(), vertices.size());
+            sizeof(glm::vec3) * num_vertices);
     }
 
     void SimulatorOptimisedGpu::create_index_buffer()
     {
         // All hairs are rendered as triangle strips using a single index buffer. We split up the indices for each
         // hair by using the primitive restart.
-        const uint32_t num_strands = hair_strands_per_triangle_ * hair_root_indices_.size() / 3;
+        const uint32_t num_strands = hair_strands_per_triangle_ * hair_asset_.num_root_indices() / 3;
         hair_indices_.resize(2 * num_strands * hair_particles_per_strand_ * VHS_MAX_HAIR_SMOOTH_FACTOR + num_strands);
 
         update_index_buffer(false);
@@ -510,7 +912,7 @@ namespace vhs
     void SimulatorOptimisedGpu::update_index_buffer(bool copy)
     {
         // Recalculate the indices if one of the params have changed.
-        const uint32_t num_strands = hair_strands_per_triangle_ * hair_root_indices_.size() / 3;
+        const uint32_t num_strands = hair_strands_per_triangle_ * hair_asset_.num_root_indices() / 3;
 
         // If nothing has changed then don't do an update.
         const uint32_t new_num_indices = num_strands * hair_particles_per_strand_ * hair_smooth_factor_ * 2 + num_strands;
@@ -540,86 +942,228 @@ namespace vhs
         {
             VHS_TRACE(SIMULATOR, "Writing new indices to GPU.", num_active_indices_);
 
-            auto staging_buffer = context_->create_staging_buffer("IndexUpdateStaging", sizeof(uint32_t) * hair_indices_.size());
-            staging_buffer.write(hair_indices_.data(), num_active_indices_);
-            context_->copy_buffer(ebo_, staging_buffer);
+            // The copy is batched into the next frame ahead of the draw that uses it.
+            context_->upload(ebo_, hair_indices_.data(), sizeof(uint32_t) * num_active_indices_, 0,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
         }
     }
 
     void SimulatorOptimisedGpu::create_particle_buffer()
     {
-        ssbo_particles_ = context_->create_device_local_buffer("Particles", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ssbo_hair_data_.data(), ssbo_hair_data_.size());
+        // The initial state is already in the buffer layout so goes straight from the asset into the staging buffer. The
+        // previous positions start out the same as the current ones.
+        const auto size = sizeof(float) * (buf_total_size_ + buf_positions_size_);
+
+        // When pulling vertices the particles are read by the graphics queue every frame so are shared between the queues
+        // rather than transferred back and forth.
+        if (vertex_pulling_)
+            ssbo_particles_ = context_->create_shared_device_local_buffer("Particles", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size);
+        else
+            ssbo_particles_ = context_->create_device_local_buffer("Particles", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size);
+
+        context_->upload_immediate(ssbo_particles_, hair_asset_.state(), sizeof(float) * buf_total_size_);
+        context_->upload_immediate(ssbo_particles_, hair_asset_.state(), sizeof(float) * buf_positions_size_,
+            sizeof(float) * buf_previous_positions_offset_);
     }
 
 
-    // Hair configuration.
-    void SimulatorOptimisedGpu::initialise_properties()
+    void SimulatorOptimisedGpu::create_cull_buffer()
     {
-        // Load the root mesh data so we know how many base strands are required.
-        load_obj("data/obj/root.obj", hair_root_vertices_, hair_root_indices_);
-
-        // Use this to set the initial properties.
-        hair_number_of_strands_ = hair_root_vertices_.size();
-        hair_particles_per_strand_ = 8;
-        hair_total_particles_ = hair_number_of_strands_ * hair_particles_per_strand_;
-        hair_particle_separation_ = 0.08f;
-        hair_draw_radius_ = 0.0005f;
-        hair_particle_mass_ = 0.15f;
-        hair_strands_per_triangle_ = 9;
-        hair_smooth_factor_ = 1;
+        // Header, then a draw and a visible triangle index for every root triangle, then the three corners of every root
+        // triangle when drawing the depth pre-pass. Written on whichever queue runs the cull kernel and read by the graphics
+        // queue, so shared rather than transferred.
+        const auto num_triangles = hair_asset_.num_root_indices() / 3;
+        auto size = CULL_DRAWS_OFFSET + (CULL_DRAW_STRIDE + sizeof(uint32_t)) * num_triangles;
 
-        // For each particle we need to store 3d position and velocity. Positions are stored first.
-        buf_positions_size_ = hair_total_particles_ * 3;
-        buf_velocities_size_ = hair_total_particles_ * 3;
+        if (occlusion_)
+            size += sizeof(glm::vec3) * 3 * num_triangles;
 
-        // Store the vertex indices of the triangles that make up the root for interpolation.
-        buf_tri_indices_size_ = hair_root_indices_.size();
-
-        // Barycentric coordinates for hair strand interpolation are placed at the end of the buffer.
-        buf_barycentric_size_ = hair_strands_per_triangle_ * 3;
-
-        buf_total_size_ = buf_positions_size_ + buf_velocities_size_ + buf_tri_indices_size_ + buf_barycentric_size_;
+        cull_buffer_ = context_->create_shared_device_local_buffer("Cull",
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, size);
     }
 
-    void SimulatorOptimisedGpu::initialise_particles()
+    void SimulatorOptimisedGpu::create_hiz_buffer()
     {
-        // Start with all state at zero.
-        ssbo_hair_data_.resize(buf_total_size_, 0.0f);
+        // Full resolution depth followed by every level down to a single texel, each half the size of the one before
+        // rounded up. Built on the graphics queue and read by whichever queue runs the cull kernel. Without occlusion
+        // culling a placeholder keeps the descriptor set the same shape.
+        uint32_t size = 1;
 
-        // Grow hairs from the roots along their normals.
-        for (uint32_t i = 0; i < hair_number_of_strands_; ++i)
+        if (occlusion_)
         {
-            const auto& root = hair_root_vertices_.at(i);
+            auto width = context_->viewport().extent.width;
+            auto height = context_->viewport().extent.height;
 
-            for (uint32_t j = 0; j < hair_particles_per_strand_; ++j)
+            size = 0;
+
+            while (true)
             {
-                const auto position = root.position + root.normal * (hair_particle_separation_ * j);
+                hiz_levels_.push_back({ size, width, height });
+                size += width * height;
+
+                if (width == 1 && height == 1)
+                    break;
 
-                ssbo_hair_data_.at(i * hair_particles_per_strand_ + j + hair_total_particles_ * 0) = position.x;
-                ssbo_hair_data_.at(i * hair_particles_per_strand_ + j + hair_total_particles_ * 1) = position.y;
-                ssbo_hair_data_.at(i * hair_particles_per_strand_ + j + hair_total_particles_ * 2) = position.z;
+                width = (width + 1) / 2;
+                height = (height + 1) / 2;
             }
+
+            VHS_TRACE(SIMULATOR, "Occlusion culling with {} depth pyramid levels.", hiz_levels_.size());
         }
 
-        // Store the root triangle indices after the velocities. This could be stored in fewer bytes as we're expanding a 16b index
-        // int a 32b float but it's easier to keep everything in the same buffer and we aren't short of memory so eh.
-        const auto tri_indices_offset = buf_positions_size_ + buf_velocities_size_;
+        hiz_buffer_ = context_->create_shared_device_local_buffer("HiZ", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(float) * size);
+    }
 
-        for (uint32_t i = 0; i < buf_tri_indices_size_; ++i)
-            ssbo_hair_data_.at(tri_indices_offset + i) = hair_root_indices_.at(i);
 
-        // Place the barycentric coordinates at the end of the buffer.
-        const auto barycentric_offset = buf_total_size_ - buf_barycentric_size_;
+    void SimulatorOptimisedGpu::create_raster_buffers()
+    {
+        // The total binned, a segment count and list end for every tile and the pool the tiles' lists are packed into,
+        // then the rasterised hair for each pixel. Placeholders keep the descriptor set the same shape when rasterising
+        // with the fixed function pipeline.
+        uint32_t tiles_size = 1;
+        uint32_t raster_size = 1;
 
-        for (uint32_t i = 0; i < hair_strands_per_triangle_; ++i)
+        if (compute_raster_)
         {
-            glm::vec3 b { random_float(), random_float(), random_float() };
-            b /= (b.x + b.y + b.z);
+            const auto width = context_->viewport().extent.width;
+            const auto height = context_->viewport().extent.height;
+
+            raster_tiles_x_ = (width + VHS_RASTER_TILE_SIZE - 1) / VHS_RASTER_TILE_SIZE;
+            raster_tiles_y_ = (height + VHS_RASTER_TILE_SIZE - 1) / VHS_RASTER_TILE_SIZE;
+
+            // Strands are thin so most segments only touch a tile or two.
+            if (!raster_tile_pool_size_)
+            {
+                const auto num_strands = hair_strands_per_triangle_ * hair_asset_.num_root_indices() / 3;
+                raster_tile_pool_size_ = 2 * num_strands * (hair_particles_per_strand_ * VHS_MAX_HAIR_SMOOTH_FACTOR - 1);
+            }
+
+            tiles_size = 1 + 2 * raster_tiles_x_ * raster_tiles_y_ + raster_tile_pool_size_;
+            raster_size = width * height;
+
+            VHS_TRACE(SIMULATOR, "Rasterising in compute with {}x{} tiles and a pool of {} segments.", raster_tiles_x_, raster_tiles_y_,
+                raster_tile_pool_size_);
+
+            // Frames that haven't run yet read back as empty.
+            const std::vector<uint32_t> totals(context_->num_frames(), 0);
 
-            ssbo_hair_data_.at(barycentric_offset + 3 * i + 0) = b.x;
-            ssbo_hair_data_.at(barycentric_offset + 3 * i + 1) = b.y;
-            ssbo_hair_data_.at(barycentric_offset + 3 * i + 2) = b.z;
+            raster_total_buffer_ = context_->create_host_visible_buffer("RasterTotal", VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                sizeof(uint32_t) * totals.size());
+            raster_total_buffer_.write(totals.data(), totals.size());
         }
+
+        raster_tile_buffer_ = context_->create_device_local_buffer("RasterTiles",
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(uint32_t) * tiles_size);
+        raster_buffer_ = context_->create_device_local_buffer("Raster", VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * raster_size);
+    }
+
+
+    // Hair configuration.
+    void SimulatorOptimisedGpu::initialise_properties(const SimulatorConfig& sim_config)
+    {
+        // Map the baked asset if it matches, otherwise build the same data from the root mesh.
+        const auto matches = [&](const HairAssetConfig& c)
+        {
+            return c.particles_per_strand == sim_config.hair.particles_per_strand
+                && c.strands_per_triangle == sim_config.hair.strands_per_triangle
+                && c.particle_separation == sim_config.hair.particle_separation;
+        };
+
+        auto asset = HairAsset::load(sim_config.baked_asset);
+
+        if (asset && matches(asset->config()))
+            hair_asset_ = std::move(*asset);
+        else
+            hair_asset_ = { sim_config.root_mesh, sim_config.hair };
+
+        const auto config = hair_asset_.config();
+        const auto& header = hair_asset_.header();
+
+        VHS_TRACE(SIMULATOR, "Using {}-bit root indices for {} root vertices.",
+            (hair_asset_.index_type() == RootIndexType::UINT16) ? 16 : 32, hair_asset_.num_root_vertices());
+
+        // Use this to set the initial properties.
+        hair_number_of_strands_ = hair_asset_.num_root_vertices();
+        hair_particles_per_strand_ = config.particles_per_strand;
+        hair_total_particles_ = hair_number_of_strands_ * hair_particles_per_strand_;
+        hair_particle_separation_ = config.particle_separation;
+        hair_draw_radius_ = 0.0005f;
+        hair_particle_mass_ = 0.15f;
+        hair_strands_per_triangle_ = config.strands_per_triangle;
+
+        // Vertex creation holds every strand of a root triangle, and at least its three guides, in a single group, so the
+        // longest strand depends on the strands per triangle and the device's group size as well as the update kernel.
+        const auto max_particles_per_strand = std::min<uint32_t>(VHS_MAX_PARTICLES_PER_STRAND,
+            context_->max_compute_local_size() / std::max(hair_strands_per_triangle_, 3u));
+
+        VHS_ASSERT(hair_particles_per_strand_ >= 2 && hair_particles_per_strand_ <= max_particles_per_strand,
+            "Particles per strand must be between 2 and {} with {} strands per triangle on this device.", max_particles_per_strand,
+            hair_strands_per_triangle_);
+        hair_smooth_factor_ = std::clamp(sim_config.smooth_factor, 1u, static_cast<uint32_t>(VHS_MAX_HAIR_SMOOTH_FACTOR));
+        ftl_iterations_ = sim_config.ftl_iterations;
+
+        vertex_pulling_ = sim_config.vertex_pulling;
+        VHS_TRACE(SIMULATOR, "Drawing with {}.", vertex_pulling_ ? "vertex pulling" : "created vertices");
+
+        instanced_strands_ = sim_config.instanced_strands;
+        VHS_TRACE(SIMULATOR, "Drawing strands {}.", instanced_strands_ ? "as instances" : "from the index buffer");
+
+        // The compute rasteriser works from the created vertices.
+        compute_raster_ = sim_config.compute_raster && !vertex_pulling_;
+
+        if (sim_config.compute_raster && vertex_pulling_)
+            VHS_TRACE(SIMULATOR, "Compute rasteriser needs created vertices, drawing with the fixed function pipeline.");
+
+        raster_tile_pool_size_ = sim_config.raster_tile_pool_size;
+
+        // Without multi draw indirect the cull kernel still lists every triangle for vertex creation but the draw can't
+        // skip any of them. Instanced draws start each triangle at its first strand, which needs a non-zero first
+        // instance in the indirect commands.
+        indirect_draws_ = context_->multi_draw_indirect() && (!instanced_strands_ || context_->draw_indirect_first_instance());
+        cull_strands_ = sim_config.cull_strands && indirect_draws_;
+        cull_distance_ = sim_config.cull_distance;
+
+        if (!context_->multi_draw_indirect())
+            VHS_TRACE(SIMULATOR, "Multi draw indirect not supported, culling is disabled.");
+        else if (!indirect_draws_)
+            VHS_TRACE(SIMULATOR, "Draw indirect first instance not supported, culling of instanced strands is disabled.");
+
+        occlusion_ = sim_config.occlusion_culling;
+        occlusion_test_ = occlusion_;
+
+        // Vertex creation needs the guides and interpolated strands of at least one triangle in each group.
+        compute_local_size_ = sim_config.compute_local_size ? sim_config.compute_local_size : context_->compute_local_size();
+        compute_local_size_ = std::max(compute_local_size_, create_vertices_particles_per_triangle());
+
+        VHS_ASSERT(compute_local_size_ <= context_->max_compute_local_size(), "Compute local size {} is larger than the device allows.",
+            compute_local_size_);
+        VHS_TRACE(SIMULATOR, "Compute local size is {}.", compute_local_size_);
+
+        // Positions and velocities come first, then the root triangle indices and barycentric coordinates.
+        buf_positions_size_ = header.positions_size;
+        buf_velocities_size_ = header.velocities_size;
+        buf_tri_indices_size_ = header.tri_indices_size;
+        buf_barycentric_size_ = header.barycentric_size;
+
+        buf_total_size_ = hair_asset_.state_size();
+        buf_previous_positions_offset_ = buf_total_size_;
+    }
+
+    uint32_t SimulatorOptimisedGpu::create_vertices_particles_per_triangle() const
+    {
+        // Invocations hold either the three guide strands or the interpolated strands, whichever there are more of.
+        return std::max(hair_strands_per_triangle_, 3u) * hair_particles_per_strand_;
+    }
+
+    uint32_t SimulatorOptimisedGpu::create_vertices_triangles_per_group() const
+    {
+        return compute_local_size_ / create_vertices_particles_per_triangle();
+    }
+
+    size_t SimulatorOptimisedGpu::memory_footprint() const
+    {
+        return vbo_.size() + ebo_.size() + ssbo_particles_.size() + cull_buffer_.size() + hiz_buffer_.size()
+            + raster_tile_buffer_.size() + raster_buffer_.size() + hair_asset_.size_bytes();
     }
 
 
@@ -631,8 +1175,9 @@ namespace vhs
         // A single descriptor set is needed as this will be shared between all shaders.
         config.max_sets = 1;
 
-        // We need to bind the vertex buffer and particle state buffer at the same time which both count as SSBOs.
-        config.sizes[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] = 2;
+        // We need to bind the vertex buffer, particle state, cull, depth pyramid and both rasteriser buffers at the same time
+        // which all count as SSBOs.
+        config.sizes[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] = 6;
 
         desc_pool_ = { "DescPool", *context_, config };
     }
@@ -645,16 +1190,62 @@ namespace vhs
         bind_ssbo_hair_data.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         bind_ssbo_hair_data.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-        DescriptorSetLayoutBindingConfig bind_vbo;
+        DescriptorSetLayoutBindingConfig bind_cull;
 
-        bind_vbo.binding = VHS_VERTEX_BUFFER_BINDING;
-        bind_vbo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        bind_vbo.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bind_cull.binding = VHS_CULL_BUFFER_BINDING;
+        bind_cull.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bind_cull.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // The depth pre-pass draws the root mesh out of the cull buffer.
+        if (occlusion_)
+            bind_cull.stage_flags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+        DescriptorSetLayoutBindingConfig bind_hiz;
+
+        bind_hiz.binding = VHS_HIZ_BUFFER_BINDING;
+        bind_hiz.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bind_hiz.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        DescriptorSetLayoutBindingConfig bind_raster_tiles;
+
+        bind_raster_tiles.binding = VHS_RASTER_TILE_BUFFER_BINDING;
+        bind_raster_tiles.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bind_raster_tiles.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // The rasterised hair is read back by the composite pass.
+        DescriptorSetLayoutBindingConfig bind_raster;
+
+        bind_raster.binding = VHS_RASTER_BUFFER_BINDING;
+        bind_raster.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bind_raster.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
         DescriptorSetLayoutConfig config;
 
-        config.bindings.push_back(bind_ssbo_hair_data);
-        config.bindings.push_back(bind_vbo);
+        config.bindings.push_back(bind_cull);
+        config.bindings.push_back(bind_hiz);
+        config.bindings.push_back(bind_raster_tiles);
+        config.bindings.push_back(bind_raster);
+
+        // Pulled vertices are read straight from the particles so there is no vertex buffer to bind.
+        if (vertex_pulling_)
+        {
+            bind_ssbo_hair_data.stage_flags |= VK_SHADER_STAGE_VERTEX_BIT;
+            config.bindings.push_back(bind_ssbo_hair_data);
+        }
+        else
+        {
+            DescriptorSetLayoutBindingConfig bind_vbo;
+
+            bind_vbo.binding = VHS_VERTEX_BUFFER_BINDING;
+            bind_vbo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bind_vbo.stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+            if (instanced_strands_)
+                bind_vbo.stage_flags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+            config.bindings.push_back(bind_ssbo_hair_data);
+            config.bindings.push_back(bind_vbo);
+        }
 
         desc_layout_ = { "DescLayout", *context_, config };
     }
@@ -668,17 +1259,53 @@ namespace vhs
         ssbo_particles_config.buffer = ssbo_particles_.vk_buffer();
         ssbo_particles_config.size = ssbo_particles_.size();
 
-        DescriptorSetBufferConfig vbo_config;
+        DescriptorSetBufferConfig cull_config;
+
+        cull_config.binding = VHS_CULL_BUFFER_BINDING;
+        cull_config.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cull_config.buffer = cull_buffer_.vk_buffer();
+        cull_config.size = cull_buffer_.size();
+
+        DescriptorSetBufferConfig hiz_config;
+
+        hiz_config.binding = VHS_HIZ_BUFFER_BINDING;
+        hiz_config.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        hiz_config.buffer = hiz_buffer_.vk_buffer();
+        hiz_config.size = hiz_buffer_.size();
+
+        DescriptorSetBufferConfig raster_tiles_config;
+
+        raster_tiles_config.binding = VHS_RASTER_TILE_BUFFER_BINDING;
+        raster_tiles_config.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        raster_tiles_config.buffer = raster_tile_buffer_.vk_buffer();
+        raster_tiles_config.size = raster_tile_buffer_.size();
 
-        vbo_config.binding = VHS_VERTEX_BUFFER_BINDING;
-        vbo_config.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        vbo_config.buffer = vbo_.vk_buffer();
-        vbo_config.size = vbo_.size();
+        DescriptorSetBufferConfig raster_config;
+
+        raster_config.binding = VHS_RASTER_BUFFER_BINDING;
+        raster_config.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        raster_config.buffer = raster_buffer_.vk_buffer();
+        raster_config.size = raster_buffer_.size();
 
         DescriptorSetConfig config;
 
         config.buffers.push_back(ssbo_particles_config);
-        config.buffers.push_back(vbo_config);
+        config.buffers.push_back(cull_config);
+        config.buffers.push_back(hiz_config);
+        config.buffers.push_back(raster_tiles_config);
+        config.buffers.push_back(raster_config);
+
+        if (!vertex_pulling_)
+        {
+            DescriptorSetBufferConfig vbo_config;
+
+            vbo_config.binding = VHS_VERTEX_BUFFER_BINDING;
+            vbo_config.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            vbo_config.buffer = vbo_.vk_buffer();
+            vbo_config.size = vbo_.size();
+
+            config.buffers.push_back(vbo_config);
+        }
 
         desc_set_ = desc_pool_.allocate(desc_layout_, config);
     }
@@ -687,10 +1314,7 @@ namespace vhs
     // ImGui.
     void SimulatorOptimisedGpu::draw_imgui()
     {
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-
-        ImGui::NewFrame();
+        imgui_new_frame();
 
         if (draw_ui_)
         {
@@ -703,6 +1327,33 @@ namespace vhs
             ImGui::Checkbox("Gravity Enabled", &gravity_enabled_);
             ImGui::SliderFloat3("Gravity", reinterpret_cast<float*>(&gravity_), -15.0f, 15.0f, "%.2f");
             ImGui::SliderInt("FTL Iterations", reinterpret_cast<int*>(&ftl_iterations_), 2, 8);
+            ImGui::Checkbox("Interpolate Between Ticks", &interpolate_);
+
+            if (indirect_draws_)
+            {
+                ImGui::Checkbox("Cull Strands", &cull_strands_);
+                ImGui::SliderFloat("Cull Distance", &cull_distance_, 0.0f, 10.0f, cull_distance_ > 0 ? "%.2f" : "off");
+
+                if (occlusion_)
+                    ImGui::Checkbox("Occlusion Culling", &occlusion_test_);
+            }
+            ImGui::Text("Update kernel: %s", update_subgroup_ ? "subgroup" : "shared memory");
+            ImGui::Text("Render path: %s", vertex_pulling_ ? "vertex pulling" : "create vertices");
+            ImGui::Text("Strands: %s", instanced_strands_ ? "instanced" : "indexed");
+            ImGui::Text("Rasteriser: %s", compute_raster_ ? "compute" : "fixed function");
+
+            if (compute_raster_)
+                ImGui::Text("Tile pool: %u / %u segments", raster_tile_total_, raster_tile_pool_size_);
+
+            // GPU timings averaged over the last few frames.
+            if (const auto* profiler = context_->gpu_profiler())
+            {
+                ImGui::Separator();
+                ImGui::Text("GPU time (ms, %u frame average)", GpuProfiler::AVERAGE_FRAMES);
+
+                for (const auto& region : profiler->regions())
+                    ImGui::Text("%-16s %8.3f", region.name.c_str(), region.average_ms);
+            }
         }
 
         ImGui::Render();
@@ -714,9 +1365,7 @@ namespace vhs
     {
         ComputePipelineConfig config;
 
-        // Load the kernel from the disk.
-        auto kernel = context_->create_shader_module("CreateVertices", VK_SHADER_STAGE_COMPUTE_BIT, "data/shaders/optimised_gpu/create_vertices.spv");
-        config.shader_module = &kernel;
+        config.specialisation_constants.push_back({ SPEC_LOCAL_SIZE, compute_local_size_ });
 
         // Add our descriptor set layout.
         config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
@@ -729,15 +1378,104 @@ namespace vhs
 
         config.push_constants.push_back(push_constants);
 
-        create_vertices_pipeline_ = { "CreateVertices", *context_, config };
+        create_vertices_pipeline_ = &context_->compute_pipeline_variant("CreateVertices", "data/shaders/optimised_gpu/create_vertices.spv", config);
+    }
+
+    void SimulatorOptimisedGpu::create_cull_pipeline()
+    {
+        ComputePipelineConfig config;
+
+        config.specialisation_constants.push_back({ SPEC_LOCAL_SIZE, compute_local_size_ });
+        config.specialisation_constants.push_back({ SPEC_INSTANCED_STRANDS, instanced_strands_ });
+        config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
+
+        VkPushConstantRange push_constants { };
+
+        push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constants.size = sizeof(CullPushConstants);
+
+        config.push_constants.push_back(push_constants);
+
+        cull_pipeline_ = &context_->compute_pipeline_variant("Cull", "data/shaders/optimised_gpu/cull.spv", config);
+    }
+
+    void SimulatorOptimisedGpu::create_hiz_pipeline()
+    {
+        ComputePipelineConfig config;
+
+        config.specialisation_constants.push_back({ SPEC_LOCAL_SIZE, compute_local_size_ });
+        config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
+
+        VkPushConstantRange push_constants { };
+
+        push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constants.size = sizeof(HiZPushConstants);
+
+        config.push_constants.push_back(push_constants);
+
+        hiz_pipeline_ = &context_->compute_pipeline_variant("HiZ", "data/shaders/optimised_gpu/hiz.spv", config);
+    }
+
+    void SimulatorOptimisedGpu::create_raster_pipelines()
+    {
+        VkPushConstantRange push_constants { };
+
+        push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constants.size = sizeof(RasterPushConstants);
+
+        // Binning is one invocation per segment, counting and then scattering into the lists. The scan is a single group
+        // and rasterising is one group per tile so has a fixed size.
+        ComputePipelineConfig bin_config;
+
+        bin_config.specialisation_constants.push_back({ SPEC_LOCAL_SIZE, compute_local_size_ });
+        bin_config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
+        bin_config.push_constants.push_back(push_constants);
+
+        scan_tiles_pipeline_ = &context_->compute_pipeline_variant("ScanTiles", "data/shaders/optimised_gpu/scan_tiles.spv", bin_config);
+
+        bin_config.specialisation_constants.push_back({ SPEC_SCATTER, false });
+        count_strands_pipeline_ = &context_->compute_pipeline_variant("CountStrands", "data/shaders/optimised_gpu/bin_strands.spv", bin_config);
+
+        bin_config.specialisation_constants.back().value = true;
+        bin_strands_pipeline_ = &context_->compute_pipeline_variant("BinStrands", "data/shaders/optimised_gpu/bin_strands.spv", bin_config);
+
+        ComputePipelineConfig raster_config;
+
+        raster_config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
+        raster_config.push_constants.push_back(push_constants);
+
+        rasterise_strands_pipeline_ = &context_->compute_pipeline_variant("RasteriseStrands", "data/shaders/optimised_gpu/rasterise_strands.spv",
+            raster_config);
     }
 
     void SimulatorOptimisedGpu::create_update_pipeline()
     {
+        // Use the subgroup kernel when whole strands fit in a subgroup and the device can shuffle in compute shaders. The
+        // dispatch may run with any subgroup size down to the device minimum, so strands must fit in the smallest one.
+        const auto& subgroup = context_->subgroup_properties();
+
+        update_subgroup_ = (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+            && (subgroup.supportedOperations & VK_SUBGROUP_FEATURE_SHUFFLE_RELATIVE_BIT)
+            && hair_particles_per_strand_ <= context_->min_subgroup_size();
+
+        // Update groups hold as many whole strands as fit, either packed into each subgroup or across the whole group. The
+        // group is always at least three strands long for vertex creation so every strand fits.
+        if (update_subgroup_)
+        {
+            update_strands_per_group_ = std::max(1u, compute_local_size_ / subgroup.subgroupSize)
+                * (subgroup.subgroupSize / hair_particles_per_strand_);
+        }
+        else
+        {
+            update_strands_per_group_ = std::max(1u, compute_local_size_ / hair_particles_per_strand_);
+        }
+
+        VHS_TRACE(SIMULATOR, "Using {} update kernel with {} strands per group.", update_subgroup_ ? "subgroup" : "shared memory",
+            update_strands_per_group_);
+
         ComputePipelineConfig config;
 
-        auto kernel = context_->create_shader_module("Update", VK_SHADER_STAGE_COMPUTE_BIT, "data/shaders/optimised_gpu/update.spv");
-        config.shader_module = &kernel;
+        config.specialisation_constants.push_back({ SPEC_LOCAL_SIZE, compute_local_size_ });
 
         config.descriptor_set_layouts.push_back(desc_layout_.vk_descriptor_set_layout());
 
@@ -748,39 +1486,220 @@ namespace vhs
 
         config.push_constants.push_back(push_constants);
 
-        update_pipeline_ = { "Update", *context_, config };
+        const auto path = update_subgroup_ ? "data/shaders/optimised_gpu/update_subgroup.spv" : "data/shaders/optimised_gpu/update.spv";
+        update_pipeline_ = &context_->compute_pipeline_variant("Update", path, config);
     }
 
 
     // Update command management and recording.
     void SimulatorOptimisedGpu::create_update_command_pool()
     {
-        // Create the pool and allocate the buffer.
-        update_command_pool_ = { "Update", *context_, context_->graphics_queue_family() };
-        update_command_pool_.allocate(&update_command_buffer_, 1);
+        const bool timeline = context_->sync_mode() == SyncMode::TIMELINE;
 
-        // Create the fence for waiting.
-        update_command_fence_ = { "UpdateComplete", *context_, VK_FENCE_CREATE_SIGNALED_BIT };
+        update_slots_.resize(timeline ? MAX_TICKS_AHEAD : 1);
+
+        for (uint32_t i = 0; i < update_slots_.size(); ++i)
+        {
+            auto& slot = update_slots_[i];
+            const auto suffix = std::to_string(i);
+
+            // Create the pool and allocate the buffer.
+            slot.command_pool = { "Update" + suffix, *context_, context_->compute_queue_family() };
+            slot.command_pool.allocate(&slot.command_buffer, 1);
+
+            // Create the fence for waiting, timeline mode uses the tick timeline instead.
+            if (!timeline)
+                slot.fence = { "UpdateComplete" + suffix, *context_, VK_FENCE_CREATE_SIGNALED_BIT };
+        }
+
+        if (timeline)
+            tick_timeline_ = { "TickTimeline", *context_, tick_value_ };
     }
 
-    void SimulatorOptimisedGpu::record_create_vertices_commands(CommandBuffer& cmd)
+    void SimulatorOptimisedGpu::create_compute_sync()
     {
-        // We want to keep strands from the same triangle in the same group, so try and pack as many as possible into our workgroup
-        // size. This could be done in a more optimal manner but keep it simple for now.
-        const auto particles_per_tri = hair_strands_per_triangle_ * hair_particles_per_strand_;
-        const auto tris_per_group = VHS_COMPUTE_LOCAL_SIZE / particles_per_tri;
-        const auto particles_per_group = tris_per_group * particles_per_tri;
+        VHS_TRACE(SIMULATOR, "Running compute on queue family {}, graphics on {}.", context_->compute_queue_family(),
+            context_->graphics_queue_family());
+
+        create_vertices_command_pool_ = { "CreateVertices", *context_, context_->compute_queue_family() };
+        create_vertices_command_pool_.allocate(&create_vertices_command_buffer_, 1);
+
+        if (context_->sync_mode() == SyncMode::TIMELINE)
+        {
+            vertices_ready_semaphore_ = { "VerticesReady", *context_, vertices_value_ };
+        }
+        else
+        {
+            create_vertices_command_fence_ = { "CreateVerticesComplete", *context_, VK_FENCE_CREATE_SIGNALED_BIT };
 
-        const auto num_triangles = hair_root_indices_.size() / 3;
-        const auto total_compute_size = num_triangles * particles_per_tri;
+            vertices_ready_semaphore_ = { "VerticesReady", *context_ };
+            draw_finished_semaphore_ = { "DrawFinished", *context_ };
+        }
+
+        // Both buffers were filled by copies on the graphics queue so must be handed over to the compute queue. The first
+        // compute submissions record the matching acquires. Shared particles need no transfer and there are no vertices.
+        if (vertex_pulling_)
+            return;
 
-        uint32_t create_vertices_groups = total_compute_size / particles_per_group;
+        const auto compute_family = context_->compute_queue_family();
 
-        if (total_compute_size % particles_per_group)
-            create_vertices_groups++;
+        context_->release_buffer(ssbo_particles_, compute_family, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        context_->release_buffer(vbo_, compute_family, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+        acquire_particles_ = true;
+    }
+
+    void SimulatorOptimisedGpu::record_particle_barrier(CommandBuffer& cmd, VkAccessFlags src_access, VkAccessFlags dst_access)
+    {
+        PipelineBarrier barrier { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+
+        // The first compute submission takes ownership from the graphics queue, after that the particles never leave the
+        // compute queue.
+        if (acquire_particles_)
+        {
+            barrier.add_buffer(0, dst_access, ssbo_particles_, context_->graphics_queue_family(), context_->compute_queue_family());
+            acquire_particles_ = false;
+        }
+        else
+        {
+            barrier.add_buffer(src_access, dst_access, ssbo_particles_);
+        }
+
+        cmd.barrier(barrier);
+    }
+
+    void SimulatorOptimisedGpu::submit_create_vertices(const glm::mat4& mvp)
+    {
+        const bool timeline = context_->sync_mode() == SyncMode::TIMELINE;
+
+        // Wait for the previous vertex creation before re-recording its commands.
+        if (timeline)
+        {
+            vertices_ready_semaphore_.wait(vertices_value_);
+        }
+        else
+        {
+            create_vertices_command_fence_.wait();
+            create_vertices_command_fence_.reset();
+        }
+
+        create_vertices_command_pool_.reset();
+
+        CommandBuffer cmd { create_vertices_command_buffer_ };
+
+        cmd.bind_descriptor_sets(*create_vertices_pipeline_, &desc_set_, 1);
+
+        const auto graphics_family = context_->graphics_queue_family();
+        const auto compute_family = context_->compute_queue_family();
+
+        // Wait for the update kernels to finish writing the particles and take the vertices back from the graphics queue.
+        // The previous draw's reads are covered by the semaphore wait.
+        record_particle_barrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        PipelineBarrier acquire_vertices { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+        acquire_vertices.add_buffer(0, VK_ACCESS_SHADER_WRITE_BIT, vbo_, graphics_family, compute_family);
+
+        cmd.barrier(acquire_vertices);
+
+        // Find the visible triangles, vertices are only created for those.
+        record_cull_commands(cmd, mvp);
+
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "CreateVertices" };
+            record_create_vertices_commands(cmd);
+        }
+
+        // Release the written vertices to the graphics queue for drawing.
+        PipelineBarrier release_vertices { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT };
+        release_vertices.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, 0, vbo_, compute_family, graphics_family);
+
+        cmd.barrier(release_vertices);
+        cmd.end();
+
+        QueueSubmitConfig submit;
+
+        submit.command_buffers.push_back(create_vertices_command_buffer_);
+        submit.signal_semaphores.push_back(vertices_ready_semaphore_.vk_semaphore());
+
+        if (timeline)
+        {
+            // Wait on the device for the latest tick and for the previous frame to finish reading the vertices and draws.
+            submit.wait_semaphores.push_back(tick_timeline_.vk_semaphore());
+            submit.wait_stages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            submit.wait_values.push_back(tick_value_);
+
+            submit.wait_semaphores.push_back(context_->frame_timeline().vk_semaphore());
+            submit.wait_stages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            submit.wait_values.push_back(context_->frame_timeline_value());
+
+            submit.signal_values.push_back(++vertices_value_);
+        }
+        else
+        {
+            if (draw_submitted_)
+            {
+                submit.wait_semaphores.push_back(draw_finished_semaphore_.vk_semaphore());
+                submit.wait_stages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+
+            submit.signal_fence = create_vertices_command_fence_.vk_fence();
+        }
+
+        context_->queue_submit(context_->compute_queue(), submit);
+    }
+
+    void SimulatorOptimisedGpu::submit_particles_ready(FrameData& frame)
+    {
+        // The cull and vertex shaders read the particles written by the latest tick.
+        frame.submit_wait_stages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+
+        if (context_->sync_mode() == SyncMode::TIMELINE)
+        {
+            frame.submit_wait_semaphores.push_back(tick_timeline_.vk_semaphore());
+            frame.submit_wait_values.push_back(tick_value_);
+            return;
+        }
+
+        // Binary semaphores can only be signalled from a submission, so an empty one on the compute queue marks the point
+        // after every tick submitted so far. It also consumes the last draw's signal if no update has.
+        QueueSubmitConfig submit;
+
+        wait_for_draw(submit);
+        submit.signal_semaphores.push_back(vertices_ready_semaphore_.vk_semaphore());
+
+        context_->queue_submit(context_->compute_queue(), submit);
+
+        frame.submit_wait_semaphores.push_back(vertices_ready_semaphore_.vk_semaphore());
+        frame.submit_signal_semaphores.push_back(draw_finished_semaphore_.vk_semaphore());
+
+        draw_finished_pending_ = true;
+    }
+
+    void SimulatorOptimisedGpu::wait_for_draw(QueueSubmitConfig& submit)
+    {
+        // Particles read by the last submitted frame mustn't be overwritten until it has finished.
+        if (context_->sync_mode() == SyncMode::TIMELINE)
+        {
+            submit.wait_semaphores.push_back(context_->frame_timeline().vk_semaphore());
+            submit.wait_stages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            submit.wait_values.push_back(context_->frame_timeline_value());
+        }
+        else if (std::exchange(draw_finished_pending_, false))
+        {
+            submit.wait_semaphores.push_back(draw_finished_semaphore_.vk_semaphore());
+            submit.wait_stages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+    }
+
+    void SimulatorOptimisedGpu::record_create_vertices_commands(CommandBuffer& cmd)
+    {
+        // We want to keep strands from the same triangle in the same group, so pack as many whole triangles as possible into
+        // our workgroup size. The cull kernel counted the groups needed for the visible triangles, which follow the draws.
+        const auto tris_per_group = create_vertices_triangles_per_group();
+        const auto num_triangles = hair_asset_.num_root_indices() / 3;
 
         // Bind the vertex creation pipeline.
-        cmd.bind_pipeline(create_vertices_pipeline_);
+        cmd.bind_pipeline(*create_vertices_pipeline_);
 
         // Fill the push constants for vertex creation.
         CreateVerticesPushConstants create_vertices_consts;
@@ -791,17 +1710,302 @@ namespace vhs
         create_vertices_consts.hair_particles_per_strand = hair_particles_per_strand_;
         create_vertices_consts.hair_strands_per_triangle = hair_strands_per_triangle_;
         create_vertices_consts.triangles_per_group = tris_per_group;
+        create_vertices_consts.visible_triangles_offset = CULL_DRAW_STRIDE / sizeof(uint32_t) * num_triangles;
+        create_vertices_consts.root_indices_offset = buf_positions_size_ + buf_velocities_size_;
+        create_vertices_consts.root_indices_wide = hair_asset_.index_type() == RootIndexType::UINT32;
+        create_vertices_consts.barycentric_offset = buf_total_size_ - buf_barycentric_size_;
+        create_vertices_consts.previous_positions_offset = buf_previous_positions_offset_;
+        create_vertices_consts.interpolation = interpolation_;
+        create_vertices_consts.hair_smooth_factor = hair_smooth_factor_;
+
+        cmd.push_constants(*create_vertices_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &create_vertices_consts, sizeof create_vertices_consts);
+
+        // Dispatch with the size written by the cull kernel.
+        cmd.dispatch_indirect(cull_buffer_, CULL_DISPATCH_OFFSET);
+    }
+
+    void SimulatorOptimisedGpu::record_cull_commands(CommandBuffer& cmd, const glm::mat4& mvp)
+    {
+        const auto num_triangles = hair_asset_.num_root_indices() / 3;
+
+        // Occlusion is only tested once there is a pyramid, and can be switched off while still drawing the pre-pass.
+        CullHeader header { };
+
+        header.dispatch_y = 1;
+        header.dispatch_z = 1;
+        header.scalp_enabled = occlusion_;
+
+        if (occlusion_ && occlusion_test_ && hiz_valid_)
+        {
+            header.occlusion_view_projection = hiz_view_projection_;
+            header.occlusion_width = hiz_levels_.front().width;
+            header.occlusion_height = hiz_levels_.front().height;
+            header.occlusion_levels = static_cast<uint32_t>(hiz_levels_.size());
+        }
+
+        // The previous frame's vertex creation, depth pre-pass and draws must be done with the buffer before it's reset.
+        // Without a count buffer the draws are always read up to the number of triangles, so the unused ones are cleared
+        // to nothing. The pre-pass is only in the same queue when pulling vertices, otherwise the semaphores cover it.
+        const VkPipelineStageFlags vertex_stage = vertex_pulling_ ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : 0;
 
-        cmd.push_constants(create_vertices_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &create_vertices_consts, sizeof create_vertices_consts);
+        PipelineBarrier before_reset { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | vertex_stage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT };
+        before_reset.add_buffer(0, VK_ACCESS_TRANSFER_WRITE_BIT, cull_buffer_);
 
-        // Dispatch with the calculated size.
-        cmd.dispatch(create_vertices_groups);
+        cmd.barrier(before_reset);
+        cmd.update_buffer(cull_buffer_, &header, sizeof header, CULL_COUNT_OFFSET);
+
+        if (!context_->draw_indirect_count())
+            cmd.fill_buffer(cull_buffer_, 0, CULL_DRAW_STRIDE * num_triangles, CULL_DRAWS_OFFSET);
+
+        PipelineBarrier after_reset { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+        after_reset.add_buffer(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, cull_buffer_);
+
+        cmd.barrier(after_reset);
+
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "Cull" };
+
+            // Instanced draws are one strand's strip, indexed draws cover every strand of the triangle and their restarts.
+            const auto vertices_per_strand = 2 * hair_particles_per_strand_ * hair_smooth_factor_;
+
+            CullPushConstants consts;
+
+            consts.model_view_projection = mvp;
+            consts.camera_position = camera_->position();
+            consts.cull_distance = cull_distance_;
+            consts.cull_margin = hair_draw_radius_ + hair_particle_separation_;
+            consts.hair_total_particles = hair_total_particles_;
+            consts.hair_particles_per_strand = hair_particles_per_strand_;
+            consts.hair_strands_per_triangle = hair_strands_per_triangle_;
+            consts.num_triangles = num_triangles;
+            consts.triangles_per_group = create_vertices_triangles_per_group();
+            consts.root_indices_offset = buf_positions_size_ + buf_velocities_size_;
+            consts.root_indices_wide = hair_asset_.index_type() == RootIndexType::UINT32;
+            consts.previous_positions_offset = buf_previous_positions_offset_;
+            consts.draw_vertex_count = instanced_strands_ ? vertices_per_strand : hair_strands_per_triangle_ * (vertices_per_strand + 1);
+            consts.cull_enabled = cull_strands_;
+
+            cmd.bind_pipeline(*cull_pipeline_);
+            cmd.bind_descriptor_sets(*cull_pipeline_, &desc_set_, 1);
+            cmd.push_constants(*cull_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &consts, sizeof consts);
+            cmd.dispatch((num_triangles + compute_local_size_ - 1) / compute_local_size_);
+        }
+
+        // Vertex creation reads the visible triangles and its dispatch size, the draws and root mesh are read by the
+        // graphics queue.
+        PipelineBarrier after_cull { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | vertex_stage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+        after_cull.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT, cull_buffer_);
+
+        cmd.barrier(after_cull);
+    }
+
+    void SimulatorOptimisedGpu::record_draw_hair_commands(CommandBuffer& cmd)
+    {
+        // Draw only the visible triangles' strands, each a range of the full index buffer or a set of instances.
+        const auto num_triangles = hair_asset_.num_root_indices() / 3;
+
+        if (instanced_strands_)
+        {
+            if (!indirect_draws_)
+                cmd.draw(2 * hair_particles_per_strand_ * hair_smooth_factor_, hair_strands_per_triangle_ * num_triangles);
+            else if (context_->draw_indirect_count())
+                cmd.draw_indirect_count(cull_buffer_, CULL_DRAWS_OFFSET, cull_buffer_, CULL_COUNT_OFFSET, num_triangles, CULL_DRAW_STRIDE);
+            else
+                cmd.draw_indirect(cull_buffer_, CULL_DRAWS_OFFSET, num_triangles, CULL_DRAW_STRIDE);
+
+            return;
+        }
+
+        if (!indirect_draws_)
+            cmd.draw_indexed(num_active_indices_);
+        else if (context_->draw_indirect_count())
+            cmd.draw_indexed_indirect_count(cull_buffer_, CULL_DRAWS_OFFSET, cull_buffer_, CULL_COUNT_OFFSET, num_triangles, CULL_DRAW_STRIDE);
+        else
+            cmd.draw_indexed_indirect(cull_buffer_, CULL_DRAWS_OFFSET, num_triangles, CULL_DRAW_STRIDE);
+    }
+
+    void SimulatorOptimisedGpu::record_depth_prepass_commands(CommandBuffer& cmd, const glm::mat4& mvp)
+    {
+        const auto num_triangles = hair_asset_.num_root_indices() / 3;
+
+        const VkClearValue clear { .depthStencil = { .depth = 1 } };
+
+        cmd.begin_render_pass(depth_pass_, depth_framebuffer_, context_->viewport(), &clear, 1);
+
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "DepthPrepass" };
+
+            // The root mesh follows the draws and visible triangle indices.
+            ScalpPushConstants consts;
+
+            consts.model_view_projection = mvp;
+            consts.scalp_offset = (CULL_DRAW_STRIDE / sizeof(uint32_t) + 1) * num_triangles;
+
+            cmd.bind_pipeline(scalp_pipeline_);
+            cmd.bind_descriptor_sets(scalp_pipeline_, &desc_set_, 1);
+            cmd.push_constants(scalp_pipeline_, VK_SHADER_STAGE_VERTEX_BIT, &consts, sizeof consts);
+            cmd.draw(3 * num_triangles);
+        }
+
+        cmd.end_render_pass();
+    }
+
+    void SimulatorOptimisedGpu::record_hiz_commands(CommandBuffer& cmd)
+    {
+        // The last cull must be done reading the pyramid before it's replaced.
+        PipelineBarrier before_copy { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT };
+        before_copy.add_buffer(0, VK_ACCESS_TRANSFER_WRITE_BIT, hiz_buffer_);
+
+        cmd.barrier(before_copy);
+
+        GpuProfileScope profile { cmd, context_->gpu_profiler(), "BuildHiZ" };
+
+        // The depth is copied in as the top level, each level after is reduced from the one before.
+        const auto& top = hiz_levels_.front();
+
+        cmd.copy_image_to_buffer(hiz_buffer_, depth_image_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT,
+            { top.width, top.height, 1 });
+
+        PipelineBarrier after_copy { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+        after_copy.add_buffer(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, hiz_buffer_);
+
+        cmd.barrier(after_copy);
+
+        cmd.bind_pipeline(*hiz_pipeline_);
+        cmd.bind_descriptor_sets(*hiz_pipeline_, &desc_set_, 1);
+
+        for (size_t i = 1; i < hiz_levels_.size(); ++i)
+        {
+            const auto& src = hiz_levels_[i - 1];
+            const auto& dst = hiz_levels_[i];
+
+            HiZPushConstants consts;
+
+            consts.src_offset = src.offset;
+            consts.src_width = src.width;
+            consts.src_height = src.height;
+            consts.dst_offset = dst.offset;
+            consts.dst_width = dst.width;
+            consts.dst_height = dst.height;
+
+            cmd.push_constants(*hiz_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &consts, sizeof consts);
+            cmd.dispatch((dst.width * dst.height + compute_local_size_ - 1) / compute_local_size_);
+
+            // Each level is read by the next, and the last by the next frame's cull kernel.
+            PipelineBarrier barrier { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+            barrier.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, hiz_buffer_);
+
+            cmd.barrier(barrier);
+        }
+    }
+
+    void SimulatorOptimisedGpu::record_raster_commands(CommandBuffer& cmd, const glm::mat4& mvp, uint32_t frame_index)
+    {
+        const auto num_triangles = hair_asset_.num_root_indices() / 3;
+        const auto num_tiles = raster_tiles_x_ * raster_tiles_y_;
+        const auto points_per_strand = hair_particles_per_strand_ * hair_smooth_factor_;
+
+        // This frame's slot was last written the previous time it was recorded, which has finished by now.
+        const auto previous_total = raster_tile_total_;
+        raster_total_buffer_.read(&raster_tile_total_, 1, frame_index);
+
+        if (raster_tile_total_ > raster_tile_pool_size_ && previous_total <= raster_tile_pool_size_)
+        {
+            VHS_TRACE(SIMULATOR, "Binned {} segments into a tile pool of {}, dropping the rest.", raster_tile_total_,
+                raster_tile_pool_size_);
+        }
+
+        // The previous frame's rasterisation, composite and copy of the total must be done with the buffers before the
+        // tile counts are reset. The rasterised hair isn't written until after the reset so the same barrier covers it.
+        const auto raster_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        PipelineBarrier before_reset { raster_stages, VK_PIPELINE_STAGE_TRANSFER_BIT };
+        before_reset.add_buffer(0, VK_ACCESS_TRANSFER_WRITE_BIT, raster_tile_buffer_);
+
+        cmd.barrier(before_reset);
+        cmd.fill_buffer(raster_tile_buffer_, 0, sizeof(uint32_t) * (1 + num_tiles));
+
+        PipelineBarrier after_reset { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+        after_reset.add_buffer(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, raster_tile_buffer_);
+
+        cmd.barrier(after_reset);
+
+        RasterPushConstants consts;
+
+        consts.model_view_projection = mvp;
+        consts.screen_width = context_->viewport().extent.width;
+        consts.screen_height = context_->viewport().extent.height;
+        consts.tiles_x = raster_tiles_x_;
+        consts.tiles_y = raster_tiles_y_;
+        consts.tile_pool_size = raster_tile_pool_size_;
+        consts.points_per_strand = points_per_strand;
+        consts.hair_strands_per_triangle = hair_strands_per_triangle_;
+        consts.visible_triangles_offset = CULL_DRAW_STRIDE / sizeof(uint32_t) * num_triangles;
+        consts.depth_test = occlusion_;
+
+        cmd.bind_descriptor_sets(*bin_strands_pipeline_, &desc_set_, 1);
+
+        // Count and then bin every segment of the visible triangles' strands, with the counts turned into offsets into
+        // the pool in between. The binning dispatches are sized for every triangle being visible.
+        const auto num_segments = num_triangles * hair_strands_per_triangle_ * (points_per_strand - 1);
+        const auto num_bin_groups = (num_segments + compute_local_size_ - 1) / compute_local_size_;
+
+        PipelineBarrier between_passes { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+        between_passes.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, raster_tile_buffer_);
+
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "BinStrands" };
+
+            cmd.bind_pipeline(*count_strands_pipeline_);
+            cmd.push_constants(*count_strands_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &consts, sizeof consts);
+            cmd.dispatch(num_bin_groups);
+
+            cmd.barrier(between_passes);
+
+            cmd.bind_pipeline(*scan_tiles_pipeline_);
+            cmd.push_constants(*scan_tiles_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &consts, sizeof consts);
+            cmd.dispatch(1);
+
+            cmd.barrier(between_passes);
+
+            cmd.bind_pipeline(*bin_strands_pipeline_);
+            cmd.push_constants(*bin_strands_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &consts, sizeof consts);
+            cmd.dispatch(num_bin_groups);
+        }
+
+        // The total is read back by the host once the frame has finished.
+        PipelineBarrier after_bin { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT };
+        after_bin.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, raster_tile_buffer_);
+
+        cmd.barrier(after_bin);
+        cmd.copy_buffer(raster_total_buffer_, raster_tile_buffer_, sizeof(uint32_t), 0, sizeof(uint32_t) * frame_index);
+
+        PipelineBarrier after_copy { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT };
+        after_copy.add_buffer(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, raster_total_buffer_);
+
+        cmd.barrier(after_copy);
+
+        {
+            GpuProfileScope profile { cmd, context_->gpu_profiler(), "RasteriseStrands" };
+
+            cmd.bind_pipeline(*rasterise_strands_pipeline_);
+            cmd.push_constants(*rasterise_strands_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &consts, sizeof consts);
+            cmd.dispatch(raster_tiles_x_, raster_tiles_y_);
+        }
+
+        // The composite reads the rasterised hair in the main pass.
+        PipelineBarrier after_raster { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+        after_raster.add_buffer(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, raster_buffer_);
+
+        cmd.barrier(after_raster);
     }
 
     void SimulatorOptimisedGpu::record_update_commands(CommandBuffer& cmd, float dt)
     {
         // Bind the update pipeline.
-        cmd.bind_pipeline(update_pipeline_);
+        cmd.bind_pipeline(*update_pipeline_);
 
         // Fill in the push constants.
         UpdatePushConstants update_consts;
@@ -818,23 +2022,17 @@ namespace vhs
         update_consts.hair_total_particles = hair_total_particles_;
         update_consts.hair_particles_per_strand = hair_particles_per_strand_;
         update_consts.ftl_iterations = ftl_iterations_;
+        update_consts.hair_particles_per_group = update_strands_per_group_ * hair_particles_per_strand_;
+        update_consts.previous_positions_offset = buf_previous_positions_offset_;
 
-        cmd.push_constants(update_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &update_consts, sizeof update_consts);
+        cmd.push_constants(*update_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, &update_consts, sizeof update_consts);
 
         // Submit to queue.
-        uint32_t update_groups = hair_total_particles_ / VHS_COMPUTE_LOCAL_SIZE;
+        uint32_t update_groups = hair_number_of_strands_ / update_strands_per_group_;
 
-        if (hair_total_particles_ % VHS_COMPUTE_LOCAL_SIZE)
+        if (hair_number_of_strands_ % update_strands_per_group_)
             update_groups++;
 
         cmd.dispatch(update_groups);
     }
-
-
-    // Random number generators.
-    float SimulatorOptimisedGpu::random_float(float min, float max)
-    {
-        std::uniform_real_distribution<float> dist { min, max };
-        return dist(rng_);
-    }
 }
@@ -1,7 +1,6 @@
 #ifndef VHS_SIMULATOR_OPTIMISED_GPU_HPP
 #define VHS_SIMULATOR_OPTIMISED_GPU_HPP
 
-#include <random>
 #include <vector>
 
 #include "command_pool.hpp"
@@ -9,11 +8,13 @@
 #include "descriptor_set_layout.hpp"
 #include "fence.hpp"
 #include "framebuffer.hpp"
+#include "hair_asset.hpp"
 #include "image.hpp"
 #include "image_view.hpp"
 #include "io.hpp"
 #include "pipeline.hpp"
 #include "render_pass.hpp"
+#include "semaphore.hpp"
 #include "shader_module.hpp"
 #include "simulator.hpp"
 
@@ -21,6 +22,7 @@
 namespace vhs
 {
     class CommandBuffer;
+    struct QueueSubmitConfig;
 
     // Standard optimised simulator implementation.
     class SimulatorOptimisedGpu final : public Simulator
@@ -30,7 +32,7 @@ namespace vhs
         SimulatorOptimisedGpu(const SimulatorOptimisedGpu&) = delete;
         SimulatorOptimisedGpu(SimulatorOptimisedGpu&&) = default;
 
-        SimulatorOptimisedGpu(GraphicsContext& context, Camera& camera);
+        SimulatorOptimisedGpu(GraphicsContext& context, Camera& camera, const SimulatorConfig& config = { });
         ~SimulatorOptimisedGpu();
 
 
@@ -43,6 +45,8 @@ namespace vhs
         void update(float dt) final;
         void draw(FrameData& frame, float interp) final;
         bool ui_active() const final { return draw_ui_; }
+        uint32_t num_particles() const final { return hair_total_particles_; }
+        size_t memory_footprint() const final;
 
     private:
         // Depth buffer management.
@@ -57,31 +61,56 @@ namespace vhs
         void create_render_pass();
         void create_draw_pipeline();
 
+        // Depth pre-pass of the root mesh and the pyramid built from it for occlusion culling.
+        void create_depth_prepass();
+        void create_scalp_pipeline();
+
         // Buffers.
         void create_vertex_buffer();
         void create_index_buffer();
         void update_index_buffer(bool copy);
         void create_particle_buffer();
+        void create_cull_buffer();
+        void create_hiz_buffer();
+        void create_raster_buffers();
 
         // Hair management.
-        void initialise_properties();
-        void initialise_particles();
+        void initialise_properties(const SimulatorConfig& config);
+
+        // Invocations needed per root triangle when creating vertices, and the whole triangles that fit in a group.
+        uint32_t create_vertices_particles_per_triangle() const;
+        uint32_t create_vertices_triangles_per_group() const;
 
         // Compute pipelines.
         void create_create_vertices_pipeline();
         void create_update_pipeline();
+        void create_cull_pipeline();
+        void create_hiz_pipeline();
+        void create_raster_pipelines();
+        void create_composite_pipeline();
 
         // Command management and recording.
         void create_update_command_pool();
         void record_update_commands(CommandBuffer& cmd, float dt);
         void record_create_vertices_commands(CommandBuffer& cmd);
+        void record_cull_commands(CommandBuffer& cmd, const glm::mat4& mvp);
+        void record_draw_hair_commands(CommandBuffer& cmd);
+        void record_depth_prepass_commands(CommandBuffer& cmd, const glm::mat4& mvp);
+        void record_hiz_commands(CommandBuffer& cmd);
+        void record_raster_commands(CommandBuffer& cmd, const glm::mat4& mvp, uint32_t frame_index);
+
+        // Synchronisation between the compute and graphics queues.
+        void create_compute_sync();
+        void record_particle_barrier(CommandBuffer& cmd, VkAccessFlags src_access, VkAccessFlags dst_access);
+        void submit_create_vertices(const glm::mat4& mvp);
+
+        // Vertex pulling equivalents, ordering the draw after the latest tick and the next tick after the draw.
+        void submit_particles_ready(FrameData& frame);
+        void wait_for_draw(QueueSubmitConfig& submit);
 
         // Draw the ImGui components.
         void draw_imgui();
 
-        // Generate a random float in the specified range.
-        float random_float(float min = 0, float max = 1);
-
         // Depth buffer.
         Image depth_image_;
         ImageView depth_image_view_;
@@ -91,19 +120,70 @@ namespace vhs
         DescriptorSetLayout desc_layout_;
         VkDescriptorSet desc_set_ = VK_NULL_HANDLE;
 
-        // Command pool and buffer for updates.
-        CommandPool update_command_pool_;
-        Fence update_command_fence_;
-        VkCommandBuffer update_command_buffer_ = VK_NULL_HANDLE;
-
-        // Compute pipelines.
-        Pipeline create_vertices_pipeline_;
-        Pipeline update_pipeline_;
+        // Command pool and buffer for each update tick in flight. Fence mode only uses one so waits for the previous tick
+        // before recording the next, timeline mode allows the host to get a few ticks ahead.
+        struct UpdateSlot
+        {
+            CommandPool command_pool;
+            Fence fence;
+            VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+            uint64_t tick = 0;
+        };
+
+        std::vector<UpdateSlot> update_slots_;
+        uint32_t current_update_slot_ = 0;
+
+        // Vertex creation is submitted to the compute queue once per draw. The vertex buffer alternates ownership between
+        // the compute and graphics queues, ordered by the two semaphores in fence mode. In timeline mode vertices ready
+        // is a timeline and the draws are tracked by the frame timeline instead.
+        CommandPool create_vertices_command_pool_;
+        Fence create_vertices_command_fence_;
+        VkCommandBuffer create_vertices_command_buffer_ = VK_NULL_HANDLE;
+
+        Semaphore vertices_ready_semaphore_;
+        Semaphore draw_finished_semaphore_;
+
+        // Timeline mode only, counts completed update ticks.
+        Semaphore tick_timeline_;
+        uint64_t tick_value_ = 0;
+        uint64_t vertices_value_ = 0;
+
+        bool draw_submitted_ = false;
+        bool acquire_particles_ = false;
+
+        // Whether the draw reads the particles directly, and in fence mode whether the last draw's finished semaphore has
+        // still to be waited on.
+        bool vertex_pulling_ = false;
+        bool draw_finished_pending_ = false;
+
+        // Whether each strand is drawn as an instance, in which case there is no index buffer.
+        bool instanced_strands_ = false;
+
+        // Whether the strands are rasterised in compute instead of drawn.
+        bool compute_raster_ = false;
+
+        // Compute pipelines, owned by the context's variant cache.
+        Pipeline* create_vertices_pipeline_ = nullptr;
+        Pipeline* update_pipeline_ = nullptr;
+        Pipeline* cull_pipeline_ = nullptr;
+        Pipeline* hiz_pipeline_ = nullptr;
+        Pipeline* count_strands_pipeline_ = nullptr;
+        Pipeline* scan_tiles_pipeline_ = nullptr;
+        Pipeline* bin_strands_pipeline_ = nullptr;
+        Pipeline* rasterise_strands_pipeline_ = nullptr;
 
         // Main rendering pass and associated pipeline.
         RenderPass render_pass_;
         Pipeline draw_pipeline_;
 
+        // Depth only pass drawing the root mesh ahead of the main pass when occlusion culling.
+        RenderPass depth_pass_;
+        Framebuffer depth_framebuffer_;
+        Pipeline scalp_pipeline_;
+
+        // Draws the compute rasterised hair over the frame in the main pass.
+        Pipeline composite_pipeline_;
+
         // Framebuffers created by the context.
         std::vector<Framebuffer> framebuffers_;
 
@@ -112,10 +192,36 @@ namespace vhs
         Buffer ebo_;
         Buffer ssbo_particles_;
 
-        // Hair properties.
-        std::vector<RootVertex> hair_root_vertices_;
-        std::vector<uint16_t> hair_root_indices_;
+        // Visible root triangles and their indirect draws, written by the cull kernel each frame and shared by both queues.
+        Buffer cull_buffer_;
+
+        // Furthest root mesh depth over ever larger areas of the screen, every level packed one after another. Built on the
+        // graphics queue and tested against by the next frame's cull kernel with the view projection it was drawn with.
+        struct HiZLevel
+        {
+            uint32_t offset;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        Buffer hiz_buffer_;
+        std::vector<HiZLevel> hiz_levels_;
+        glm::mat4 hiz_view_projection_ = glm::mat4 { 1 };
+
+        // Compute rasteriser's per tile segment lists and the rasterised hair, both only used on the graphics queue. The
+        // total binned by each frame is read back once the frame has finished to spot the pool overflowing.
+        Buffer raster_tile_buffer_;
+        Buffer raster_buffer_;
+        Buffer raster_total_buffer_;
+        uint32_t raster_tiles_x_ = 0;
+        uint32_t raster_tiles_y_ = 0;
+        uint32_t raster_tile_pool_size_ = 0;
+        uint32_t raster_tile_total_ = 0;
+
+        // Root mesh and initial particle state, either mapped from the baked asset or built from the OBJ.
+        HairAsset hair_asset_;
 
+        // Hair properties.
         glm::vec3 gravity_ = { 0.0f, -9.81f, 0.0f };
 
         uint32_t hair_number_of_strands_;
@@ -125,12 +231,18 @@ namespace vhs
         uint32_t hair_smooth_factor_;
         uint32_t ftl_iterations_ = 5;
 
+        // Workgroup size the compute kernels are specialised with.
+        uint32_t compute_local_size_;
+
+        // Whole strands handled by each update group, and whether the subgroup kernel is used.
+        uint32_t update_strands_per_group_;
+        bool update_subgroup_ = false;
+
         float hair_particle_separation_;
         float hair_draw_radius_;
         float hair_particle_mass_;
         float damping_factor_ = -0.56f;
 
-        std::vector<float> ssbo_hair_data_;
         std::vector<uint32_t> hair_indices_;
         uint32_t num_active_indices_ = 0;
 
@@ -140,6 +252,10 @@ namespace vhs
         uint32_t buf_barycentric_size_;
         uint32_t buf_total_size_;
 
+        // Positions at the start of the latest tick follow the asset's state so draws can blend towards the new ones.
+        uint32_t buf_previous_positions_offset_;
+        float interpolation_ = 1.0f;
+
         glm::mat4 hair_root_transform_ = glm::mat4 { 1 };
         glm::vec3 hair_root_position_ = glm::vec3 { 0 };
         glm::vec3 hair_root_move_;
@@ -154,9 +270,18 @@ namespace vhs
         // Extra flags controlled via the UI.
         bool simulation_active_ = true;
         bool gravity_enabled_ = true;
-
-        // RNG.
-        std::mt19937 rng_;
+        bool interpolate_ = true;
+
+        // Culling needs multi draw indirect, without it every strand is drawn.
+        bool cull_strands_ = true;
+        float cull_distance_ = 0.0f;
+        bool indirect_draws_ = false;
+
+        // Whether the depth pre-pass and pyramid exist, whether the cull kernel tests against them and whether a pyramid
+        // has been built yet.
+        bool occlusion_ = false;
+        bool occlusion_test_ = false;
+        bool hiz_valid_ = false;
     };
 }
 
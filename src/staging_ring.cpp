@@ -0,0 +1,100 @@
+#include "assert.hpp"
+#include "graphics_context.hpp"
+#include "staging_ring.hpp"
+#include "trace.hpp"
+
+
+VHS_TRACE_DEFINE(STAGING_RING);
+
+
+namespace vhs
+{
+    StagingRing::StagingRing(std::string_view name, GraphicsContext& context, const StagingRingConfig& config) :
+        marks_(config.num_frames)
+    {
+        VHS_TRACE(STAGING_RING, "Creating '{}' with {} bytes for {} frames.", name, config.size, config.num_frames);
+
+        BufferConfig buffer_config;
+
+        buffer_config.size = config.size;
+        buffer_config.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_config.memory_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        buffer_config.persistently_mapped = true;
+
+        buffer_ = { name, context, buffer_config };
+    }
+
+
+    std::optional<StagingRing::Allocation> StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        const auto capacity = buffer_.size();
+
+        // Start from the beginning again whenever the ring drains to keep allocations contiguous. Outstanding marks
+        // cover nothing that hasn't already been released, but their heads are from before the rewind and would move
+        // the tail back into the new allocations when reclaimed, so they're dropped.
+        if (!used())
+        {
+            head_ = tail_ = 0;
+
+            for (auto& mark : marks_)
+                mark.reset();
+        }
+
+        auto offset = (head_ + alignment - 1) & ~(alignment - 1);
+        auto skipped = offset - head_;
+
+        // Free space is [head, capacity) followed by [0, tail) while the head is ahead of the tail, and only
+        // [head, tail) once it has wrapped.
+        const bool full = used() == capacity;
+        const bool wrapped = head_ < tail_ || full;
+
+        if (wrapped)
+        {
+            if (full || offset + size > tail_)
+                return std::nullopt;
+        }
+        else if (offset + size > capacity)
+        {
+            // Skip the remainder of the buffer and wrap to the start.
+            if (size > tail_)
+                return std::nullopt;
+
+            skipped = capacity - head_;
+            offset = 0;
+        }
+
+        head_ = offset + size;
+        allocated_ += skipped + size;
+
+        return Allocation { offset, buffer_.mapped<std::byte>().data() + offset };
+    }
+
+
+    void StagingRing::mark_frame(uint32_t frame)
+    {
+        marks_.at(frame) = Mark { head_, allocated_ };
+    }
+
+    void StagingRing::reclaim_frame(uint32_t frame)
+    {
+        auto& mark = marks_.at(frame);
+
+        if (!mark)
+            return;
+
+        // Frames complete in order so anything before this mark is no longer in use.
+        tail_ = mark->head;
+        released_ = mark->allocated;
+
+        mark.reset();
+    }
+
+    void StagingRing::reset()
+    {
+        head_ = tail_ = 0;
+        released_ = allocated_;
+
+        for (auto& mark : marks_)
+            mark.reset();
+    }
+}
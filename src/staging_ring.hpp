@@ -0,0 +1,88 @@
+#ifndef VHS_STAGING_RING_HPP
+#define VHS_STAGING_RING_HPP
+
+#include <cstddef>
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "buffer.hpp"
+
+
+namespace vhs
+{
+    class GraphicsContext;
+
+    struct StagingRingConfig
+    {
+        VkDeviceSize size;
+        uint32_t num_frames;
+    };
+
+    // Ring allocator over a single persistently mapped staging buffer. Space is handed out in submission order and
+    // reclaimed once the frame that last used it has been waited on, so uploads never need a fresh buffer or a
+    // blocking wait.
+    class StagingRing
+    {
+    public:
+        struct Allocation
+        {
+            VkDeviceSize offset;
+            std::byte* data;
+        };
+
+        StagingRing(const StagingRing&) = delete;
+
+        StagingRing() = default;
+        StagingRing(StagingRing&&) = default;
+        ~StagingRing() = default;
+
+        StagingRing(std::string_view name, GraphicsContext& context, const StagingRingConfig& config);
+
+
+        StagingRing& operator=(const StagingRing&) = delete;
+        StagingRing& operator=(StagingRing&&) = default;
+
+
+        // Allocate space for an upload. Returns nothing if the ring is too full, in which case the caller should fall
+        // back to a dedicated staging buffer.
+        std::optional<Allocation> allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+        // Record the end of the allocations used by a frame that is being submitted.
+        void mark_frame(uint32_t frame);
+
+        // Release everything up to the mark of a frame whose fence has been waited on.
+        void reclaim_frame(uint32_t frame);
+
+        // Release everything. Only valid when the device is no longer using any allocations.
+        void reset();
+
+        // Write the data to the device. No-op for coherent memory.
+        void flush(const Allocation& alloc, VkDeviceSize size) { buffer_.flush(alloc.offset, size); }
+
+        Buffer& buffer() { return buffer_; }
+        VkDeviceSize capacity() const { return buffer_.size(); }
+        VkDeviceSize used() const { return allocated_ - released_; }
+
+    private:
+        struct Mark
+        {
+            VkDeviceSize head;
+            VkDeviceSize allocated;
+        };
+
+        Buffer buffer_;
+
+        // Allocations are made at the head and released from the tail. Running totals of allocated and released
+        // bytes, including any padding or space skipped when wrapping, distinguish a full ring from an empty one.
+        VkDeviceSize head_ = 0;
+        VkDeviceSize tail_ = 0;
+        VkDeviceSize allocated_ = 0;
+        VkDeviceSize released_ = 0;
+
+        std::vector<std::optional<Mark>> marks_;
+    };
+}
+
+#endif
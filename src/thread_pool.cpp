@@ -0,0 +1,143 @@
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+
+VHS_TRACE_DEFINE(THREAD_POOL);
+
+
+namespace vhs
+{
+    ThreadPool::ThreadPool(uint32_t num_threads)
+    {
+        if (!num_threads)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        VHS_TRACE(THREAD_POOL, "Creating thread pool with {} workers.", num_threads);
+
+        workers_.reserve(num_threads);
+        for (uint32_t i = 0; i < num_threads; ++i)
+            workers_.push_back(std::make_unique<Worker>());
+
+        threads_.reserve(num_threads);
+        for (uint32_t i = 0; i < num_threads; ++i)
+            threads_.emplace_back([this, i] { worker_main(i); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        VHS_TRACE(THREAD_POOL, "Destroying thread pool.");
+
+        {
+            std::lock_guard lock { wake_mutex_ };
+            stop_ = true;
+        }
+
+        wake_.notify_all();
+
+        for (auto& thread : threads_)
+            thread.join();
+    }
+
+
+    void ThreadPool::submit(Task task)
+    {
+        // Spread tasks submitted from outside the pool over all the queues, idle workers will steal anything that
+        // ends up unbalanced.
+        const auto index = next_queue_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        auto& worker = *workers_[index];
+
+        {
+            std::lock_guard lock { worker.mutex };
+            worker.tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard lock { wake_mutex_ };
+            num_queued_.fetch_add(1, std::memory_order_release);
+        }
+
+        wake_.notify_one();
+    }
+
+
+    bool ThreadPool::try_pop(uint32_t index, Task& task)
+    {
+        auto& worker = *workers_[index];
+        std::lock_guard lock { worker.mutex };
+
+        if (worker.tasks.empty())
+            return false;
+
+        task = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+
+        num_queued_.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    bool ThreadPool::try_steal(uint32_t thief, Task& task)
+    {
+        const auto num_workers = workers_.size();
+
+        for (uint32_t i = 1; i <= num_workers; ++i)
+        {
+            const auto victim = (thief + i) % num_workers;
+            auto& worker = *workers_[victim];
+
+            std::lock_guard lock { worker.mutex };
+
+            if (worker.tasks.empty())
+                continue;
+
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+
+            num_queued_.fetch_sub(1, std::memory_order_relaxed);
+
+            return true;
+        }
+
+        return false;
+    }
+
+
+    void ThreadPool::help_until(const std::function<bool()>& done)
+    {
+        // The calling thread doesn't own a queue so it always steals, starting from a different victim each time to
+        // avoid hammering the first worker.
+        uint32_t start = 0;
+
+        while (!done())
+        {
+            Task task;
+
+            if (try_steal(start++, task))
+                task();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    void ThreadPool::worker_main(uint32_t index)
+    {
+        set_trace_thread_name(fmt::format(FMT_STRING("worker{}"), index));
+
+        while (true)
+        {
+            Task task;
+
+            if (try_pop(index, task) || try_steal(index, task))
+            {
+                task();
+                continue;
+            }
+
+            std::unique_lock lock { wake_mutex_ };
+            wake_.wait(lock, [this] { return stop_ || num_queued_.load(std::memory_order_acquire) > 0; });
+
+            if (stop_)
+                break;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef VHS_THREAD_POOL_HPP
+#define VHS_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace vhs
+{
+    // Pool of worker threads with per-worker task queues. Workers take work from the front of their own queue and
+    // steal from the back of the other queues when they run dry.
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+
+        // Passing zero threads uses one worker per hardware thread.
+        ThreadPool(uint32_t num_threads = 0);
+        ~ThreadPool();
+
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool& operator=(ThreadPool&&) = delete;
+
+
+        // Queue a task to be run on one of the workers.
+        void submit(Task task);
+
+        // Run func(begin, end) over [begin, end) split into chunks of at most grain elements. The calling thread helps
+        // with the work and the function returns once all chunks are complete.
+        template <class Func>
+        void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, Func&& func)
+        {
+            if (begin >= end)
+                return;
+
+            if (!grain)
+                grain = 1;
+
+            const auto num_chunks = (end - begin + grain - 1) / grain;
+
+            // Small ranges aren't worth the overhead of waking the workers.
+            if (num_chunks == 1)
+            {
+                func(begin, end);
+                return;
+            }
+
+            auto remaining = std::make_shared<std::atomic<uint32_t>>(num_chunks);
+
+            for (uint32_t i = 0; i < num_chunks; ++i)
+            {
+                const auto chunk_begin = begin + i * grain;
+                const auto chunk_end = std::min(chunk_begin + grain, end);
+
+                submit([=, &func]
+                {
+                    func(chunk_begin, chunk_end);
+                    remaining->fetch_sub(1, std::memory_order_release);
+                });
+            }
+
+            help_until([&] { return remaining->load(std::memory_order_acquire) == 0; });
+        }
+
+        // Run every task on the workers, helping on the calling thread, and return once they have all completed.
+        void run_all(const std::vector<Task>& tasks)
+        {
+            parallel_for(0, tasks.size(), 1, [&](uint32_t begin, uint32_t end)
+            {
+                for (auto i = begin; i < end; ++i)
+                    tasks[i]();
+            });
+        }
+
+        uint32_t num_threads() const { return threads_.size(); }
+
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        // Pop from the front of a worker's own queue or steal from the back of another.
+        bool try_pop(uint32_t index, Task& task);
+        bool try_steal(uint32_t thief, Task& task);
+
+        // Run queued tasks on the calling thread until the predicate is satisfied.
+        void help_until(const std::function<bool()>& done);
+
+        void worker_main(uint32_t index);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::vector<std::thread> threads_;
+
+        std::mutex wake_mutex_;
+        std::condition_variable wake_;
+
+        std::atomic<int32_t> num_queued_ = 0;
+        std::atomic<uint32_t> next_queue_ = 0;
+        std::atomic<bool> stop_ = false;
+    };
+}
+
+#endif
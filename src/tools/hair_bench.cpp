@@ -0,0 +1,388 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+#include <glm/vec3.hpp>
+
+#include "camera.hpp"
+#include "gpu_profiler.hpp"
+#include "graphics_context.hpp"
+#include "simulator_cpu.hpp"
+#include "simulator_optimised_gpu.hpp"
+
+
+// Run the simulators headless for a fixed number of ticks over a sweep of hair parameters and write the timings as JSON.
+// Each tick is one update followed by one frame. The profiler moves to its next frame at the end of each frame, so the
+// update's GPU region lands in the same profiler frame as the draw and all the GPU regions of a frame belong to a single
+// tick. Every option taking a list sweeps over all combinations.
+//
+// Sweeping --local-size gives an offline tune of the compute workgroup size, zero leaves it to the device heuristic.
+// Sweeping --pulling 0,1 compares creating the vertices in compute against pulling them in the vertex shader,
+// --instanced 0,1 drawing through the index buffer against drawing each strand as an instance, --occlusion 0,1 the cost
+// of the depth pre-pass against what it culls, and --compute-raster 0,1 the fixed function rasteriser against the binned
+// compute one.
+//
+// Usage: hair_bench.out [--ticks N] [--warmup N] [--particles 8,16] [--strands 9] [--ftl 5] [--smooth 1]
+//                       [--local-size 0,128,256] [--pulling 0,1] [--instanced 0,1] [--occlusion 0,1]
+//                       [--compute-raster 0,1] [--mesh data/obj/root.obj] [--backends gpu,cpu] [--output bench.json]
+
+
+struct Options
+{
+    uint32_t ticks = 256;
+    uint32_t warmup = 16;
+
+    std::vector<uint32_t> particles_per_strand { 8 };
+    std::vector<uint32_t> strands_per_triangle { 9 };
+    std::vector<uint32_t> ftl_iterations { 5 };
+    std::vector<uint32_t> smooth_factors { 1 };
+    std::vector<uint32_t> local_sizes { 0 };
+    std::vector<uint32_t> vertex_pulling { 0 };
+    std::vector<uint32_t> instanced_strands { 0 };
+    std::vector<uint32_t> occlusion_culling { 0 };
+    std::vector<uint32_t> compute_raster { 0 };
+    std::vector<std::string> meshes { "data/obj/root.obj" };
+    std::vector<std::string> backends { "gpu" };
+
+    std::string output;
+};
+
+// Timings for a single tick.
+struct Tick
+{
+    double host_update_ms = 0;
+    double host_frame_ms = 0;
+    std::map<std::string, double> gpu_ms;
+};
+
+
+static std::vector<std::string> split(const char* list)
+{
+    std::vector<std::string> items;
+
+    for (const char* start = list; *start;)
+    {
+        const auto end = std::strchr(start, ',');
+        const auto length = end ? static_cast<size_t>(end - start) : std::strlen(start);
+
+        if (length)
+            items.emplace_back(start, length);
+
+        start += length + (end ? 1 : 0);
+    }
+
+    return items;
+}
+
+static std::vector<uint32_t> split_uints(const char* list)
+{
+    std::vector<uint32_t> values;
+
+    for (const auto& item : split(list))
+        values.push_back(std::strtoul(item.c_str(), nullptr, 10));
+
+    return values;
+}
+
+static Options parse_options(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const auto value = argv[i + 1];
+
+        if (std::strcmp(argv[i], "--ticks") == 0)
+            options.ticks = std::max(1ul, std::strtoul(value, nullptr, 10));
+        else if (std::strcmp(argv[i], "--warmup") == 0)
+            options.warmup = std::strtoul(value, nullptr, 10);
+        else if (std::strcmp(argv[i], "--particles") == 0)
+            options.particles_per_strand = split_uints(value);
+        else if (std::strcmp(argv[i], "--strands") == 0)
+            options.strands_per_triangle = split_uints(value);
+        else if (std::strcmp(argv[i], "--ftl") == 0)
+            options.ftl_iterations = split_uints(value);
+        else if (std::strcmp(argv[i], "--smooth") == 0)
+            options.smooth_factors = split_uints(value);
+        else if (std::strcmp(argv[i], "--local-size") == 0)
+            options.local_sizes = split_uints(value);
+        else if (std::strcmp(argv[i], "--pulling") == 0)
+            options.vertex_pulling = split_uints(value);
+        else if (std::strcmp(argv[i], "--instanced") == 0)
+            options.instanced_strands = split_uints(value);
+        else if (std::strcmp(argv[i], "--occlusion") == 0)
+            options.occlusion_culling = split_uints(value);
+        else if (std::strcmp(argv[i], "--compute-raster") == 0)
+            options.compute_raster = split_uints(value);
+        else if (std::strcmp(argv[i], "--mesh") == 0)
+            options.meshes = split(value);
+        else if (std::strcmp(argv[i], "--backends") == 0)
+            options.backends = split(value);
+        else if (std::strcmp(argv[i], "--output") == 0)
+            options.output = value;
+        else
+            fmt::print(stderr, FMT_STRING("Ignoring unknown option '{}'.\n"), argv[i]);
+    }
+
+    return options;
+}
+
+
+static std::unique_ptr<vhs::Simulator> create_simulator(const std::string& backend, vhs::GraphicsContext& context,
+    vhs::Camera& camera, const vhs::SimulatorConfig& config)
+{
+    if (backend == "cpu")
+        return std::make_unique<vhs::SimulatorCpu>(context, camera, config);
+
+    return std::make_unique<vhs::SimulatorOptimisedGpu>(context, camera, config);
+}
+
+static std::string json_string(const std::string& str)
+{
+    std::string out = "\"";
+
+    for (const auto c : str)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+
+    return out + "\"";
+}
+
+// Mean, median and maximum of a set of samples.
+static std::string json_summary(std::vector<double> samples)
+{
+    if (samples.empty())
+        return "null";
+
+    std::sort(std::begin(samples), std::end(samples));
+
+    const auto mean = std::accumulate(std::begin(samples), std::end(samples), 0.0) / samples.size();
+
+    return fmt::format(FMT_STRING("{{\"mean\": {:.6f}, \"median\": {:.6f}, \"max\": {:.6f}}}"), mean,
+        samples[samples.size() / 2], samples.back());
+}
+
+
+// Run a single configuration, returning its JSON object.
+static std::string run(vhs::GraphicsContext& context, const Options& options, const std::string& backend,
+    const vhs::SimulatorConfig& config)
+{
+    const float dt = 1.0f / 32.0f;
+
+    vhs::Camera camera { context.viewport().extent.width, context.viewport().extent.height, glm::vec3 { -0.75f, -0.25f, 0.0f } };
+
+    auto sim = create_simulator(backend, context, camera, config);
+
+    // GPU results arrive a few frames late so map them back to ticks by frame number.
+    std::vector<Tick> ticks(options.ticks);
+    std::map<uint64_t, uint32_t> frame_ticks;
+
+    auto profiler = context.gpu_profiler();
+
+    if (profiler)
+    {
+        profiler->set_sample_callback([&](uint64_t frame, const vhs::GpuProfileRegion& region)
+        {
+            if (const auto it = frame_ticks.find(frame); it != std::end(frame_ticks))
+                ticks[it->second].gpu_ms[region.name] = region.last_ms;
+        });
+    }
+
+    for (uint32_t i = 0; i < options.warmup + options.ticks; ++i)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        // The update is recorded into the profiler frame the draw will use.
+        if (profiler && i >= options.warmup)
+            frame_ticks[profiler->frame_number()] = i - options.warmup;
+
+        const auto start = Clock::now();
+
+        sim->update(dt);
+
+        const auto updated = Clock::now();
+
+        auto& frame = context.begin_frame();
+
+        sim->draw(frame, 0.0f);
+        context.end_frame();
+
+        const auto end = Clock::now();
+
+        if (i >= options.warmup)
+        {
+            auto& tick = ticks[i - options.warmup];
+
+            tick.host_update_ms = std::chrono::duration<double, std::milli> { updated - start }.count();
+            tick.host_frame_ms = std::chrono::duration<double, std::milli> { end - start }.count();
+        }
+    }
+
+    context.wait_idle();
+
+    if (profiler)
+    {
+        profiler->flush();
+        profiler->set_sample_callback(nullptr);
+    }
+
+    // Summarise. The simulation cost of a tick is the GPU update where there is one, otherwise the host update.
+    std::vector<double> host_update, host_frame, sim_ms;
+    std::map<std::string, std::vector<double>> gpu;
+
+    for (const auto& tick : ticks)
+    {
+        host_update.push_back(tick.host_update_ms);
+        host_frame.push_back(tick.host_frame_ms);
+
+        for (const auto& [name, ms] : tick.gpu_ms)
+            gpu[name].push_back(ms);
+
+        const auto it = tick.gpu_ms.find("Update");
+        sim_ms.push_back(std::max(tick.host_update_ms, (it != std::end(tick.gpu_ms)) ? it->second : 0.0));
+    }
+
+    std::sort(std::begin(sim_ms), std::end(sim_ms));
+
+    const auto median_sim_ms = sim_ms[sim_ms.size() / 2];
+    const auto particles_per_second = median_sim_ms > 0 ? sim->num_particles() / (median_sim_ms * 0.001) : 0.0;
+
+    std::string json = fmt::format(FMT_STRING("    {{\n      \"backend\": {}, \"mesh\": {}, \"particles_per_strand\": {}, "
+        "\"strands_per_triangle\": {}, \"ftl_iterations\": {}, \"smooth_factor\": {}, \"local_size\": {}, "
+        "\"vertex_pulling\": {}, \"instanced_strands\": {}, \"occlusion_culling\": {}, \"compute_raster\": {},\n"),
+        json_string(backend), json_string(config.root_mesh.string()), config.hair.particles_per_strand,
+        config.hair.strands_per_triangle, config.ftl_iterations, config.smooth_factor, config.compute_local_size,
+        config.vertex_pulling, config.instanced_strands, config.occlusion_culling, config.compute_raster);
+
+    json += fmt::format(FMT_STRING("      \"num_particles\": {}, \"memory_bytes\": {}, \"particles_per_second\": {:.1f},\n"),
+        sim->num_particles(), sim->memory_footprint(), particles_per_second);
+
+    json += fmt::format(FMT_STRING("      \"host_update_ms\": {},\n      \"host_frame_ms\": {},\n      \"gpu_ms\": {{"),
+        json_summary(host_update), json_summary(host_frame));
+
+    for (auto it = std::begin(gpu); it != std::end(gpu); ++it)
+    {
+        json += fmt::format(FMT_STRING("{}{}: {}"), (it == std::begin(gpu)) ? "" : ", ", json_string(it->first),
+            json_summary(it->second));
+    }
+
+    json += "},\n      \"ticks\": [\n";
+
+    for (uint32_t i = 0; i < ticks.size(); ++i)
+    {
+        const auto& tick = ticks[i];
+
+        json += fmt::format(FMT_STRING("        {{\"host_update_ms\": {:.6f}, \"host_frame_ms\": {:.6f}, \"gpu_ms\": {{"),
+            tick.host_update_ms, tick.host_frame_ms);
+
+        for (auto it = std::begin(tick.gpu_ms); it != std::end(tick.gpu_ms); ++it)
+        {
+            json += fmt::format(FMT_STRING("{}{}: {:.6f}"), (it == std::begin(tick.gpu_ms)) ? "" : ", ",
+                json_string(it->first), it->second);
+        }
+
+        json += (i + 1 < ticks.size()) ? "}},\n" : "}}\n";
+    }
+
+    json += "      ]\n    }";
+
+    fmt::print(stderr, FMT_STRING("{} {} pps={} spt={} ftl={} smooth={} local={} pulling={} instanced={} occlusion={} "
+        "raster={}: {} particles, {:.3f} ms/tick, {:.3g} particles/s\n"), backend, config.root_mesh.string(),
+        config.hair.particles_per_strand, config.hair.strands_per_triangle, config.ftl_iterations, config.smooth_factor,
+        config.compute_local_size, config.vertex_pulling, config.instanced_strands, config.occlusion_culling,
+        config.compute_raster ? "compute" : "fixed", sim->num_particles(), median_sim_ms, particles_per_second);
+
+    return json;
+}
+
+
+int main(int argc, char** argv)
+{
+    const auto options = parse_options(argc, argv);
+
+    vhs::GraphicsContextConfig context_config;
+    context_config.headless = true;
+
+    vhs::GraphicsContext context { context_config };
+
+    if (!context.gpu_profiler())
+        fmt::print(stderr, FMT_STRING("GPU profiling is unavailable, only host times will be reported.\n"));
+
+    // Every combination of the swept options, expanded one option at a time so the first varies slowest.
+    std::vector<vhs::SimulatorConfig> configs(1);
+
+    const auto sweep = [&](const auto& values, const auto& apply)
+    {
+        std::vector<vhs::SimulatorConfig> expanded;
+
+        for (const auto& config : configs)
+        {
+            for (const auto& value : values)
+            {
+                expanded.push_back(config);
+                apply(expanded.back(), value);
+            }
+        }
+
+        configs = std::move(expanded);
+    };
+
+    sweep(options.meshes, [](auto& config, const auto& mesh)
+    {
+        config.root_mesh = mesh;
+        config.baked_asset = std::filesystem::path { mesh }.replace_extension(".hair");
+    });
+
+    sweep(options.particles_per_strand, [](auto& config, auto value) { config.hair.particles_per_strand = value; });
+    sweep(options.strands_per_triangle, [](auto& config, auto value) { config.hair.strands_per_triangle = value; });
+    sweep(options.ftl_iterations, [](auto& config, auto value) { config.ftl_iterations = value; });
+    sweep(options.smooth_factors, [](auto& config, auto value) { config.smooth_factor = value; });
+    sweep(options.local_sizes, [](auto& config, auto value) { config.compute_local_size = value; });
+    sweep(options.vertex_pulling, [](auto& config, auto value) { config.vertex_pulling = value != 0; });
+    sweep(options.instanced_strands, [](auto& config, auto value) { config.instanced_strands = value != 0; });
+    sweep(options.occlusion_culling, [](auto& config, auto value) { config.occlusion_culling = value != 0; });
+    sweep(options.compute_raster, [](auto& config, auto value) { config.compute_raster = value != 0; });
+
+    std::vector<std::string> runs;
+
+    for (const auto& backend : options.backends)
+    {
+        for (const auto& config : configs)
+            runs.push_back(run(context, options, backend, config));
+    }
+
+    std::string json = fmt::format(FMT_STRING("{{\n  \"device\": {},\n  \"default_local_size\": {},\n  \"ticks\": {},\n  "
+        "\"warmup\": {},\n  \"runs\": [\n"), json_string(context.physical_device_properties().deviceName),
+        context.compute_local_size(), options.ticks, options.warmup);
+
+    for (size_t i = 0; i < runs.size(); ++i)
+        json += runs[i] + ((i + 1 < runs.size()) ? ",\n" : "\n");
+
+    json += "  ]\n}\n";
+
+    if (options.output.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream { options.output, std::ios::trunc } << json;
+        fmt::print(stderr, FMT_STRING("Wrote results for {} runs to '{}'.\n"), runs.size(), options.output);
+    }
+
+    return 0;
+}
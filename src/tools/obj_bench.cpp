@@ -0,0 +1,63 @@
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "io.hpp"
+#include "thread_pool.hpp"
+
+
+// Measure OBJ load times on a single thread and across the thread pool.
+//
+// Usage: obj_bench.out [path] [iterations]
+
+
+static void bench(const char* name, const std::filesystem::path& path, uint32_t iterations, vhs::ThreadPool* pool)
+{
+    std::vector<double> times;
+    size_t num_vertices = 0, num_indices = 0;
+
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        std::vector<vhs::RootVertex> vertices;
+        std::vector<uint32_t> indices;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        vhs::load_obj(path, vertices, indices, pool);
+
+        const auto end = std::chrono::steady_clock::now();
+
+        times.push_back(std::chrono::duration<double, std::milli> { end - start }.count());
+
+        num_vertices = vertices.size();
+        num_indices = indices.size();
+    }
+
+    std::sort(std::begin(times), std::end(times));
+
+    const auto file_mb = std::filesystem::file_size(path) / (1024.0 * 1024.0);
+    const auto median = times[times.size() / 2];
+
+    fmt::print(FMT_STRING("{:<8} {} vertices, {} indices: min {:.3f} ms, median {:.3f} ms, max {:.3f} ms ({:.1f} MB/s)\n"),
+        name, num_vertices, num_indices, times.front(), median, times.back(), file_mb / (median * 0.001));
+}
+
+int main(int argc, char** argv)
+{
+    const std::filesystem::path path = (argc > 1) ? argv[1] : "data/obj/root.obj";
+    const uint32_t iterations = std::max(1ul, (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 100ul);
+
+    fmt::print(FMT_STRING("Loading '{}' {} times.\n"), path.c_str(), iterations);
+
+    vhs::ThreadPool pool;
+
+    bench("serial", path, iterations, nullptr);
+    bench("parallel", path, iterations, &pool);
+
+    return 0;
+}
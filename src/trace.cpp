@@ -1,20 +1,275 @@
 #include <cstdlib>
 
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include "trace.hpp"
 
 
 namespace vhs
 {
+    namespace
+    {
+        // Operating system thread ID so the trace matches what other profilers show.
+        uint64_t current_thread_id()
+        {
+#if defined(__linux__)
+            return static_cast<uint64_t>(syscall(SYS_gettid));
+#elif defined(__APPLE__)
+            uint64_t id = 0;
+            pthread_threadid_np(nullptr, &id);
+            return id;
+#else
+            return std::hash<std::thread::id> { }(std::this_thread::get_id());
+#endif
+        }
+
+        uint64_t current_process_id()
+        {
+#if defined(__linux__) || defined(__APPLE__)
+            return static_cast<uint64_t>(getpid());
+#else
+            return 0;
+#endif
+        }
+
+
+        struct TraceEvent
+        {
+            const char* category;
+            const char* name;
+            uint64_t start_ns;
+            uint64_t duration_ns;
+            double value;
+            char phase;
+        };
+
+        // Events are appended to fixed size chunks owned by a single thread. The count and next pointer are published
+        // with release stores so the recorder can read everything up to them at exit without any locking.
+        struct TraceChunk
+        {
+            static constexpr size_t SIZE = 4096;
+
+            std::array<TraceEvent, SIZE> events;
+            std::atomic<size_t> count { 0 };
+            std::atomic<TraceChunk*> next { nullptr };
+        };
+
+        struct TraceThread
+        {
+            TraceThread(uint64_t id) :
+                id { id },
+                name { fmt::format(FMT_STRING("{}"), id) },
+                head { new TraceChunk },
+                tail { head }
+            { }
+
+            ~TraceThread()
+            {
+                for (auto chunk = head; chunk;)
+                    delete std::exchange(chunk, chunk->next.load(std::memory_order_acquire));
+            }
+
+            void record(const TraceEvent& event)
+            {
+                auto count = tail->count.load(std::memory_order_relaxed);
+
+                if (count == TraceChunk::SIZE)
+                {
+                    const auto chunk = new TraceChunk;
+
+                    tail->next.store(chunk, std::memory_order_release);
+                    tail = chunk;
+                    count = 0;
+                }
+
+                tail->events[count] = event;
+                tail->count.store(count + 1, std::memory_order_release);
+            }
+
+            uint64_t id;
+            std::string name;
+
+            TraceChunk* head;
+            TraceChunk* tail;
+        };
+
+
+        void write_json_string(std::ostream& out, std::string_view str)
+        {
+            out << '"';
+
+            for (const auto c : str)
+            {
+                if (c == '"' || c == '\\')
+                    out << '\\' << c;
+                else if (static_cast<unsigned char>(c) < 0x20)
+                    out << ' ';
+                else
+                    out << c;
+            }
+
+            out << '"';
+        }
+
+
+        // Owns the per-thread buffers and writes them out on destruction. The mutex is only taken when a thread is seen
+        // for the first time, when it's named, and when writing the file.
+        class TraceRecorder
+        {
+        public:
+            static TraceRecorder& instance()
+            {
+                static TraceRecorder recorder;
+                return recorder;
+            }
+
+            ~TraceRecorder()
+            {
+                if (!path_.empty())
+                    write();
+            }
+
+
+            bool enabled() const { return !path_.empty(); }
+
+            TraceThread& thread()
+            {
+                thread_local TraceThread* current = nullptr;
+
+                if (!current)
+                {
+                    std::lock_guard lock { mutex_ };
+                    current = threads_.emplace_back(std::make_unique<TraceThread>(current_thread_id())).get();
+                }
+
+                return *current;
+            }
+
+            void set_thread_name(TraceThread& thread, std::string_view name)
+            {
+                std::lock_guard lock { mutex_ };
+                thread.name = name;
+            }
+
+            const char* intern(std::string_view name)
+            {
+                std::lock_guard lock { mutex_ };
+                return names_.emplace(name).first->c_str();
+            }
+
+        private:
+            TraceRecorder()
+            {
+                if (const auto path = std::getenv("VHS_TRACE_CHROME"); path && *path)
+                    path_ = path;
+            }
+
+            void write()
+            {
+                std::lock_guard lock { mutex_ };
+
+                std::ofstream out { path_, std::ios::trunc };
+
+                if (!out)
+                {
+                    std::cerr << "Failed to write Chrome trace to '" << path_ << "'.\n";
+                    return;
+                }
+
+                const auto pid = current_process_id();
+                bool first = true;
+
+                const auto separator = [&]
+                {
+                    out << (std::exchange(first, false) ? "\n" : ",\n");
+                };
+
+                out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+                for (const auto& thread : threads_)
+                {
+                    separator();
+                    out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << thread->id
+                        << ",\"args\":{\"name\":";
+                    write_json_string(out, thread->name);
+                    out << "}}";
+
+                    for (auto chunk = thread->head; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+                    {
+                        const auto count = chunk->count.load(std::memory_order_acquire);
+
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            const auto& event = chunk->events[i];
+
+                            separator();
+                            out << "{\"ph\":\"" << event.phase << "\",\"cat\":";
+                            write_json_string(out, event.category);
+                            out << ",\"name\":";
+                            write_json_string(out, event.name);
+                            out << ",\"pid\":" << pid << ",\"tid\":" << thread->id
+                                << fmt::format(FMT_STRING(",\"ts\":{:.3f}"), event.start_ns * 1e-3);
+
+                            if (event.phase == 'X')
+                                out << fmt::format(FMT_STRING(",\"dur\":{:.3f}"), event.duration_ns * 1e-3);
+                            else
+                                out << ",\"args\":{\"value\":" << event.value << '}';
+
+                            out << '}';
+                        }
+                    }
+                }
+
+                out << "\n]}\n";
+            }
+
+            std::string path_;
+
+            std::mutex mutex_;
+            std::vector<std::unique_ptr<TraceThread>> threads_;
+            std::unordered_set<std::string> names_;
+        };
+
+
+        std::string& thread_name()
+        {
+            thread_local std::string name = fmt::format(FMT_STRING("{}"), current_thread_id());
+            return name;
+        }
+    }
+
+
     Trace::Trace(const char* tag, const char* env) :
         tag_ { tag }
     {
-        const auto value = std::getenv(env);
-        enabled_ = value && *value != '0';
+        // Any value other than a level enables info traces so VHS_TRACE_X=yes and similar still work.
+        if (const auto value = std::getenv(env); value && *value && *value != '0')
+        {
+            const auto level = std::strtol(value, nullptr, 10);
+            level_ = (level >= VHS_TRACE_LEVEL_INFO) ? std::min<int>(level, VHS_TRACE_LEVEL_VERBOSE) : VHS_TRACE_LEVEL_INFO;
+        }
 
         if (!start_time_initialised_)
         {
             start_time_ = std::chrono::high_resolution_clock::now();
             start_time_initialised_ = true;
+            recording_ = TraceRecorder::instance().enabled();
         }
     }
 
@@ -24,6 +279,49 @@ namespace vhs
     }
 
 
+    const std::string& Trace::trace_thread_name()
+    {
+        return thread_name();
+    }
+
+
+    TraceScope::~TraceScope()
+    {
+        if (!Trace::recording())
+            return;
+
+        const auto end_ns = Trace::now_ns();
+
+        TraceRecorder::instance().thread().record({ trace_, name_, start_ns_, end_ns - start_ns_, 0, 'X' });
+    }
+
+
+    void trace_counter(const Trace& trace, const char* name, double value)
+    {
+        if (!Trace::recording())
+            return;
+
+        TraceRecorder::instance().thread().record({ trace.tag(), name, Trace::now_ns(), 0, value, 'C' });
+    }
+
+    void set_trace_thread_name(std::string_view name)
+    {
+        thread_name() = name;
+
+        if (Trace::recording())
+        {
+            auto& recorder = TraceRecorder::instance();
+            recorder.set_thread_name(recorder.thread(), name);
+        }
+    }
+
+    const char* trace_intern(std::string_view name)
+    {
+        return TraceRecorder::instance().intern(name);
+    }
+
+
     std::chrono::time_point<std::chrono::high_resolution_clock> Trace::start_time_;
     bool Trace::start_time_initialised_ = false;
+    bool Trace::recording_ = false;
 }
@@ -1,22 +1,63 @@
 #ifndef VHS_TRACE_HPP
 #define VHS_TRACE_HPP
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <ratio>
+#include <string>
+#include <string_view>
 #include <utility>
 
 #include <fmt/format.h>
 
 
-#define VHS_TRACE_DECLARE(tag) namespace vhs::traces { extern vhs::Trace trace_##tag; }
-#define VHS_TRACE_DEFINE(tag) namespace vhs::traces { vhs::Trace trace_##tag { #tag, "VHS_TRACE_"#tag }; }
-#define VHS_TRACE(tag, fmt, ...) vhs::traces::trace_##tag.print(FMT_STRING(fmt), ##__VA_ARGS__)
+// Trace levels. Setting VHS_TRACE_<TAG>=1 at runtime enables info traces, 2 also enables the verbose traces emitted from
+// per-frame paths. VHS_TRACE_MAX_LEVEL caps what is compiled in at all.
+#define VHS_TRACE_LEVEL_NONE 0
+#define VHS_TRACE_LEVEL_INFO 1
+#define VHS_TRACE_LEVEL_VERBOSE 2
+
+#ifndef VHS_TRACE_MAX_LEVEL
+#define VHS_TRACE_MAX_LEVEL VHS_TRACE_LEVEL_VERBOSE
+#endif
+
+#define VHS_TRACE_DECLARE(tag) namespace vhs::traces { struct tag_##tag; extern vhs::Trace trace_##tag; }
+#define VHS_TRACE_DEFINE(tag) namespace vhs::traces { struct tag_##tag; vhs::Trace trace_##tag { #tag, "VHS_TRACE_"#tag }; }
+
+// Lower the compile-time level for a single tag. Must come after the declaration and before any traces using the tag.
+#define VHS_TRACE_SET_LEVEL(tag, level) namespace vhs::traces \
+    { template <> inline constexpr int trace_level<tag_##tag> = std::min(level, VHS_TRACE_MAX_LEVEL); }
+
+// Both levels are checked before the arguments are evaluated, so disabled traces cost a predicted branch at runtime and
+// nothing at all once compiled out.
+#define VHS_TRACE_AT(level, tag, fmt, ...) do \
+    { \
+        if constexpr (vhs::traces::trace_level<vhs::traces::tag_##tag> >= (level)) \
+        { \
+            if (__builtin_expect(vhs::traces::trace_##tag.enabled(level), 0)) \
+                vhs::traces::trace_##tag.print(FMT_STRING(fmt), ##__VA_ARGS__); \
+        } \
+    } while (false)
+
+#define VHS_TRACE(tag, fmt, ...) VHS_TRACE_AT(VHS_TRACE_LEVEL_INFO, tag, fmt, ##__VA_ARGS__)
+#define VHS_TRACE_VERBOSE(tag, fmt, ...) VHS_TRACE_AT(VHS_TRACE_LEVEL_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+// Timeline events for the Chrome trace, names must outlive the program so are expected to be literals.
+#define VHS_TRACE_CONCAT_INNER(a, b) a##b
+#define VHS_TRACE_CONCAT(a, b) VHS_TRACE_CONCAT_INNER(a, b)
+#define VHS_TRACE_SCOPE(tag, name) vhs::TraceScope VHS_TRACE_CONCAT(vhs_trace_scope_, __LINE__) { vhs::traces::trace_##tag, name }
+#define VHS_TRACE_COUNTER(tag, name, value) do \
+    { \
+        if constexpr (vhs::traces::trace_level<vhs::traces::tag_##tag> >= VHS_TRACE_LEVEL_INFO) \
+            vhs::trace_counter(vhs::traces::trace_##tag, name, value); \
+    } while (false)
 
 
 namespace vhs
 {
-    // Environment variable controlled tracing.
+    // Environment variable controlled tracing. Setting VHS_TRACE_CHROME to a path also records scopes and counters from
+    // every tag and writes them out as a Chrome trace when the program exits.
     class Trace
     {
     public:
@@ -32,29 +73,85 @@ namespace vhs
         Trace& operator=(Trace&&) = delete;
 
 
+        // Callers are expected to check enabled first, which the macros do before evaluating any arguments.
         template <class Fmt, class ... Args>
         void print(Fmt&& fmt, Args&&... args)
         {
-            if (enabled_)
-            {
-                const auto now = std::chrono::high_resolution_clock::now();
-                const auto now_ms = std::chrono::duration<double, std::milli> { now - start_time_ }.count();
-                const auto thread = "main";
+            const auto now = std::chrono::high_resolution_clock::now();
+            const auto now_ms = std::chrono::duration<double, std::milli> { now - start_time_ }.count();
 
-                const auto message = fmt::format(FMT_STRING("[{} {:.3f} {}] "), tag_, now_ms * 0.001, thread)
-                    + fmt::format(std::forward<Fmt>(fmt), std::forward<Args>(args)...) + "\n";
+            const auto message = fmt::format(FMT_STRING("[{} {:.3f} {}] "), tag_, now_ms * 0.001, trace_thread_name())
+                + fmt::format(std::forward<Fmt>(fmt), std::forward<Args>(args)...) + "\n";
 
-                std::cout << message;
-            }
+            std::cout << message;
+        }
+
+        bool enabled(int level) const { return level_ >= level; }
+
+        const char* tag() const { return tag_; }
+
+        // Whether events are being recorded for the Chrome trace.
+        static bool recording() { return recording_; }
+
+        // Nanoseconds since tracing started.
+        static uint64_t now_ns()
+        {
+            const auto now = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_time_).count();
         }
 
     private:
+        static const std::string& trace_thread_name();
+
         static std::chrono::time_point<std::chrono::high_resolution_clock> start_time_;
         static bool start_time_initialised_;
+        static bool recording_;
 
         const char* tag_;
-        bool enabled_ = false;
+        int level_ = VHS_TRACE_LEVEL_NONE;
     };
+
+    namespace traces
+    {
+        // Highest level compiled in for each tag.
+        template <class Tag>
+        inline constexpr int trace_level = VHS_TRACE_MAX_LEVEL;
+    }
+
+    // Record a duration event covering the lifetime of the scope.
+    class TraceScope
+    {
+    public:
+        TraceScope() = delete;
+        TraceScope(const TraceScope&) = delete;
+        TraceScope(TraceScope&&) = delete;
+
+        TraceScope(const Trace& trace, const char* name) :
+            trace_ { trace.tag() },
+            name_ { name },
+            start_ns_ { Trace::recording() ? Trace::now_ns() : 0 }
+        { }
+
+        ~TraceScope();
+
+
+        TraceScope& operator=(const TraceScope&) = delete;
+        TraceScope& operator=(TraceScope&&) = delete;
+
+    private:
+        const char* trace_;
+        const char* name_;
+        uint64_t start_ns_;
+    };
+
+    // Record the value of a counter at the current time.
+    void trace_counter(const Trace& trace, const char* name, double value);
+
+    // Name the calling thread in both the text and Chrome traces.
+    void set_trace_thread_name(std::string_view name);
+
+    // Copy a name whose storage doesn't last long enough for an event, returning a pointer valid until exit.
+    const char* trace_intern(std::string_view name);
 }
 
 #endif